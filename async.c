@@ -0,0 +1,263 @@
+#include "async.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+typedef struct {
+    ss_async_t *async;
+    pthread_t thread;
+    ss_encrypt_stream_t stream;  // this worker's own, single-threaded
+} async_worker_t;
+
+struct ss_async {
+    size_t threads;
+    async_worker_t *workers;
+    bool has_pub;
+    const ss_priv_key_t *key;  // NULL without decryption
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;  // signalled when a job is queued or on stop
+
+    ss_job_t *queued;       // submitted, not yet started, oldest first
+    ss_job_t *queued_tail;
+    ss_job_t *done;         // finished, waiting for ss_async_reap
+    ss_job_t *done_tail;
+    size_t depth;
+    size_t in_flight;       // queued or running
+    int event;              // eventfd counting completions in done
+    bool stopping;
+};
+
+// Appends a job to a linked queue
+static void enqueue(ss_job_t **head, ss_job_t **tail, ss_job_t *job) {
+    job->next = NULL;
+    if (*tail == NULL) {
+        *head = job;
+    } else {
+        (*tail)->next = job;
+    }
+    *tail = job;
+}
+
+// Removes the oldest job from a linked queue, or returns NULL if it is empty
+static ss_job_t *dequeue(ss_job_t **head, ss_job_t **tail) {
+    ss_job_t *job = *head;
+    if (job != NULL) {
+        *head = job->next;
+        if (*head == NULL) {
+            *tail = NULL;
+        }
+        job->next = NULL;
+    }
+    return job;
+}
+
+//
+// Runs one job through the file paths over in-memory files, as ssd does.
+// fmemopen rejects empty buffers on some libcs, so empty inputs read from
+// /dev/null instead.
+//
+static void run_job(async_worker_t *worker, ss_job_t *job) {
+    FILE *infile = job->input_length > 0
+                       ? fmemopen((void *)job->input, job->input_length, "r")
+                       : fopen("/dev/null", "r");
+    char *output = NULL;
+    size_t output_length = 0;
+    FILE *outfile = open_memstream(&output, &output_length);
+
+    bool ok = infile != NULL && outfile != NULL;
+    if (ok && job->op == SS_JOB_DECRYPT) {
+        ok = ss_decrypt_file_pool(infile, outfile, worker->async->key, NULL);
+    } else if (ok) {
+        ss_format_t format = job->op == SS_JOB_ENCRYPT_BINARY ? SS_FORMAT_BINARY
+                             : job->op == SS_JOB_ENCRYPT_HYBRID
+                                 ? SS_FORMAT_HYBRID
+                                 : SS_FORMAT_HEX;
+        ok = ss_encrypt_stream_file(&worker->stream, infile, outfile, format);
+    }
+    if (infile != NULL) {
+        fclose(infile);
+    }
+    if (outfile != NULL) {
+        fclose(outfile);  // output is only valid from here on
+    }
+
+    job->ok = ok;
+    if (ok) {
+        job->output = (uint8_t *)output;
+        job->output_length = output_length;
+    } else {
+        free(output);
+    }
+}
+
+static void *worker_main(void *data) {
+    async_worker_t *worker = data;
+    ss_async_t *async = worker->async;
+
+    pthread_mutex_lock(&async->lock);
+    while (true) {
+        while (!async->stopping && async->queued == NULL) {
+            pthread_cond_wait(&async->work_ready, &async->lock);
+        }
+        // Stopping still finishes whatever was queued
+        ss_job_t *job = dequeue(&async->queued, &async->queued_tail);
+        if (job == NULL) {
+            break;
+        }
+        pthread_mutex_unlock(&async->lock);
+
+        run_job(worker, job);
+
+        pthread_mutex_lock(&async->lock);
+        async->in_flight--;
+        if (job->callback != NULL) {
+            // Unlocked, so the callback may submit the next job
+            pthread_mutex_unlock(&async->lock);
+            job->callback(job, job->arg);
+            pthread_mutex_lock(&async->lock);
+        } else {
+            enqueue(&async->done, &async->done_tail, job);
+            uint64_t one = 1;
+            ssize_t written = write(async->event, &one, sizeof(one));
+            (void)written;  // Only fails if the counter would overflow
+        }
+    }
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+ss_async_t *ss_async_create(mpz_srcptr modulus_n, const ss_priv_key_t *key,
+                            size_t threads, size_t depth) {
+    ss_async_t *async = calloc(1, sizeof(ss_async_t));
+    if (async == NULL) {
+        return NULL;
+    }
+    async->threads = threads == 0 ? 1 : threads;
+    async->depth = depth == 0 ? 1 : depth;
+    async->has_pub = modulus_n != NULL;
+    async->key = key;
+    async->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    async->workers = calloc(async->threads, sizeof(async_worker_t));
+    if (async->event < 0 || async->workers == NULL) {
+        if (async->event >= 0) {
+            close(async->event);
+        }
+        free(async->workers);
+        free(async);
+        return NULL;
+    }
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->work_ready, NULL);
+
+    size_t started = 0;
+    for (; started < async->threads; started++) {
+        async_worker_t *worker = &async->workers[started];
+        worker->async = async;
+        if (async->has_pub &&
+            !ss_encrypt_stream_init_pool(&worker->stream, modulus_n, NULL)) {
+            break;
+        }
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            if (async->has_pub) {
+                ss_encrypt_stream_clear(&worker->stream);
+            }
+            break;
+        }
+    }
+    // Run with however many workers could be started
+    async->threads = started;
+    if (started == 0) {
+        ss_async_destroy(async);
+        return NULL;
+    }
+    return async;
+}
+
+bool ss_async_submit(ss_async_t *async, ss_job_op_t op,
+                     const uint8_t *input, size_t length,
+                     ss_job_fn callback, void *arg) {
+    bool available = op == SS_JOB_DECRYPT ? async->key != NULL
+                                          : async->has_pub;
+    if (!available) {
+        return false;
+    }
+    ss_job_t *job = calloc(1, sizeof(ss_job_t));
+    if (job == NULL) {
+        return false;
+    }
+    job->op = op;
+    job->input = input;
+    job->input_length = length;
+    job->callback = callback;
+    job->arg = arg;
+
+    pthread_mutex_lock(&async->lock);
+    if (async->in_flight >= async->depth) {
+        pthread_mutex_unlock(&async->lock);
+        free(job);
+        return false;  // Backpressure: the caller retries after a completion
+    }
+    async->in_flight++;
+    enqueue(&async->queued, &async->queued_tail, job);
+    pthread_cond_signal(&async->work_ready);
+    pthread_mutex_unlock(&async->lock);
+    return true;
+}
+
+int ss_async_eventfd(const ss_async_t *async) { return async->event; }
+
+size_t ss_async_reap(ss_async_t *async, ss_job_t **jobs, size_t max) {
+    size_t taken = 0;
+    pthread_mutex_lock(&async->lock);
+    while (taken < max && async->done != NULL) {
+        jobs[taken++] = dequeue(&async->done, &async->done_tail);
+    }
+    if (async->done == NULL) {
+        // Workers post under the lock, so no completion is lost here
+        uint64_t count = 0;
+        ssize_t got = read(async->event, &count, sizeof(count));
+        (void)got;  // EAGAIN when already clear
+    }
+    pthread_mutex_unlock(&async->lock);
+    return taken;
+}
+
+void ss_job_free(ss_job_t *job) {
+    if (job == NULL) {
+        return;
+    }
+    free(job->output);
+    free(job);
+}
+
+void ss_async_destroy(ss_async_t *async) {
+    if (async == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&async->lock);
+    async->stopping = true;
+    pthread_cond_broadcast(&async->work_ready);
+    pthread_mutex_unlock(&async->lock);
+
+    for (size_t i = 0; i < async->threads; i++) {
+        pthread_join(async->workers[i].thread, NULL);
+        if (async->has_pub) {
+            ss_encrypt_stream_clear(&async->workers[i].stream);
+        }
+    }
+    ss_job_t *job = NULL;
+    while ((job = dequeue(&async->done, &async->done_tail)) != NULL) {
+        ss_job_free(job);
+    }
+
+    close(async->event);
+    pthread_mutex_destroy(&async->lock);
+    pthread_cond_destroy(&async->work_ready);
+    free(async->workers);
+    free(async);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <gmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ss.h"
+
+//
+// Asynchronous encryption and decryption for event loops. Jobs go onto a
+// bounded queue served by worker threads the engine owns, each with its own
+// key contexts, so submitting never blocks on an exponentiation. A finished
+// job is either handed to its callback on the worker thread, or queued for
+// ss_async_reap with the engine's eventfd made readable.
+//
+typedef struct ss_async ss_async_t;
+
+// What a job does with its input
+typedef enum {
+    SS_JOB_ENCRYPT_HEX,    // plaintext in, hex ciphertext out
+    SS_JOB_ENCRYPT_BINARY, // plaintext in, binary container out
+    SS_JOB_ENCRYPT_HYBRID, // plaintext in, hybrid container out
+    SS_JOB_DECRYPT,        // any ciphertext format in, plaintext out
+} ss_job_op_t;
+
+typedef struct ss_job ss_job_t;
+
+//
+// Completion callback, run on the worker thread that finished the job. The
+// job then belongs to the callback, which must eventually ss_job_free it.
+//
+// job: the finished job.
+// arg: the argument given to ss_async_submit.
+//
+typedef void (*ss_job_fn)(ss_job_t *job, void *arg);
+
+//
+// A finished job, as given to its callback or taken by ss_async_reap. The
+// caller reads the result fields; the engine touches nothing after that.
+//
+struct ss_job {
+    ss_job_op_t op;
+    const uint8_t *input;   // borrowed until the job completes
+    size_t input_length;
+    ss_job_fn callback;     // NULL to complete through ss_async_reap
+    void *arg;              // passed to callback; free for the caller's use otherwise
+    bool ok;                // the operation succeeded
+    uint8_t *output;        // result, allocated with malloc, or NULL on failure
+    size_t output_length;
+    ss_job_t *next;         // queue link, owned by the engine
+};
+
+//
+// Creates an engine with its own worker threads. Either key may be missing,
+// which makes the operations needing it unavailable.
+//
+// modulus_n: the public key modulus, or NULL for no encryption.
+// key:       the private key, or NULL for no decryption. Borrowed; it must
+//            outlive the engine.
+// threads:   the number of worker threads (0 is treated as 1).
+// depth:     the most jobs in flight, queued or running, at once (0 is
+//            treated as 1).
+//
+// Returns a pointer to the new engine, or NULL if it could not be set up
+// (including a modulus too small to encrypt with).
+//
+ss_async_t *ss_async_create(mpz_srcptr modulus_n, const ss_priv_key_t *key,
+                            size_t threads, size_t depth);
+
+//
+// Queues a job without waiting. The job is handed back only through its
+// callback or ss_async_reap: it may finish, and be freed, before this
+// returns.
+//
+// async:    the engine.
+// op:       the operation.
+// input:    the input bytes, which must stay valid until the job completes.
+// length:   the input size in bytes.
+// callback: the completion callback, or NULL to complete through
+//           ss_async_reap.
+// arg:      passed to callback.
+//
+// Returns true if the job was queued, false if depth jobs are already in
+// flight (try again after a completion), the engine has no key for op, or
+// the job could not be allocated.
+//
+bool ss_async_submit(ss_async_t *async, ss_job_op_t op,
+                     const uint8_t *input, size_t length,
+                     ss_job_fn callback, void *arg);
+
+//
+// Returns a non-blocking eventfd that is readable while jobs without a
+// callback wait in ss_async_reap. The descriptor belongs to the engine.
+//
+int ss_async_eventfd(const ss_async_t *async);
+
+//
+// Takes finished jobs without a callback, oldest first, without waiting.
+// The eventfd is cleared once none are left, so after it fires call this
+// until it returns fewer than max.
+//
+// async: the engine.
+// jobs:  room for max job handles, now owned by the caller (output).
+// max:   the most jobs to take.
+//
+// Returns the number of jobs taken.
+//
+size_t ss_async_reap(ss_async_t *async, ss_job_t **jobs, size_t max);
+
+//
+// Frees a finished job and its output. Does nothing for NULL.
+//
+void ss_job_free(ss_job_t *job);
+
+//
+// Finishes every queued job, stops the workers and frees the engine. Jobs
+// still waiting in ss_async_reap are freed too. Does nothing for NULL.
+//
+void ss_async_destroy(ss_async_t *async);
@@ -0,0 +1,407 @@
+#include <gmp.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "async.h"
+#include "numtheory.h"
+#include "randstate.h"
+#include "ss.h"
+
+#define OPTIONS "b:i:k:m:s:o:h"
+
+// Jobs the -k plaintext is split into for the asynchronous runs, and how
+// many of them may be in flight at once
+#define ASYNC_JOBS  64
+#define ASYNC_DEPTH 8
+
+// Modulus sizes measured when -b is not given
+static const uint64_t default_sizes[] = { 1024, 2048, 3072, 4096 };
+
+// Per-size state shared by all the benchmarked operations
+typedef struct {
+    uint64_t bits;        // modulus size in bits
+    uint64_t iterations;  // Miller-Rabin iterations
+    mpz_t prime_p, prime_q, modulus_n, modulus_pq, private_key_d;
+    mpz_t base, exponent, result, plaintext, ciphertext, scratch;
+    ss_priv_key_t key;
+    pow_mod_ctx_t encrypt_ctx;       // Montgomery context for n
+    pow_mod_schedule_t encrypt_plan; // schedule for the exponent n
+} bench_state_t;
+
+typedef void (*bench_fn)(bench_state_t *bench);
+
+/**
+ * Returns the current monotonic time in seconds.
+ */
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void bench_make_prime(bench_state_t *bench) {
+    make_prime(bench->scratch, bench->bits / 2, bench->iterations);
+}
+
+static void bench_is_prime(bench_state_t *bench) {
+    is_prime(bench->prime_p, bench->iterations);
+}
+
+static void bench_pow_mod(bench_state_t *bench) {
+    pow_mod(bench->result, bench->base, bench->exponent, bench->modulus_n);
+}
+
+static void bench_pow_mod_schedule(bench_state_t *bench) {
+    pow_mod_ctx_schedule(&bench->encrypt_ctx, bench->result, bench->plaintext,
+                         &bench->encrypt_plan, bench->modulus_n);
+}
+
+static void bench_mod_inverse(bench_state_t *bench) {
+    mod_inverse(bench->result, bench->base, bench->modulus_n);
+}
+
+// ss_make_pub and ss_make_priv initialize their outputs, so these pass
+// fresh variables and clear them again
+static void bench_make_pub(bench_state_t *bench) {
+    mpz_t p, q, n;
+    ss_make_pub(p, q, n, bench->bits, bench->iterations);
+    mpz_clears(p, q, n, NULL);
+}
+
+static void bench_make_priv(bench_state_t *bench) {
+    mpz_t d, pq;
+    ss_make_priv(d, pq, bench->prime_p, bench->prime_q);
+    mpz_clears(d, pq, NULL);
+}
+
+static void bench_encrypt(bench_state_t *bench) {
+    ss_encrypt(bench->result, bench->plaintext, bench->modulus_n);
+}
+
+static void bench_decrypt(bench_state_t *bench) {
+    ss_decrypt(bench->result, bench->ciphertext, bench->private_key_d,
+               bench->modulus_pq);
+}
+
+static void bench_decrypt_crt(bench_state_t *bench) {
+    ss_decrypt_key(bench->result, bench->ciphertext, &bench->key);
+}
+
+/**
+ * Writes one JSON result object, preceded by a separator unless it is the
+ * first.
+ */
+static void emit_result(FILE *out, bool *first, const char *op,
+                        uint64_t bits, const char *unit, double value,
+                        uint64_t reps, double seconds) {
+    fprintf(out,
+            "%s\n    {\"op\": \"%s\", \"bits\": %" PRIu64 ", \"reps\": %" PRIu64 ", "
+            "\"seconds\": %.6f, \"%s\": %.3f}",
+            *first ? "" : ",", op, bits, reps, seconds, unit, value);
+    *first = false;
+}
+
+/**
+ * Runs an operation repeatedly until at least min_time seconds have passed
+ * and reports the mean time per call in microseconds.
+ */
+static void run_op(FILE *out, bool *first, const char *op,
+                   bench_state_t *bench, bench_fn fn, double min_time) {
+    uint64_t reps = 0;
+    double start = now_seconds();
+    double elapsed = 0.0;
+    do {
+        fn(bench);
+        reps++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < min_time);
+    emit_result(out, first, op, bench->bits, "us_per_op",
+                elapsed / (double)reps * 1e6, reps, elapsed);
+}
+
+/**
+ * Runs count jobs through an asynchronous engine the way an event loop
+ * would: keep submitting until the engine pushes back, wait on its eventfd,
+ * reap, repeat.
+ *
+ * Returns:
+ *   The elapsed time in seconds; results[i] holds the finished job i.
+ */
+static double run_jobs(ss_async_t *async, ss_job_op_t op,
+                       const ss_buffer_t *inputs, size_t count,
+                       ss_job_t **results) {
+    struct pollfd event = { ss_async_eventfd(async), POLLIN, 0 };
+    size_t submitted = 0;
+    size_t finished = 0;
+    double start = now_seconds();
+    while (finished < count) {
+        while (submitted < count &&
+               ss_async_submit(async, op, inputs[submitted].data,
+                               inputs[submitted].length, NULL,
+                               (void *)(uintptr_t)submitted)) {
+            submitted++;
+        }
+        poll(&event, 1, -1);
+        ss_job_t *jobs[ASYNC_DEPTH];
+        size_t got = 0;
+        do {
+            got = ss_async_reap(async, jobs, ASYNC_DEPTH);
+            for (size_t i = 0; i < got; i++) {
+                results[(uintptr_t)jobs[i]->arg] = jobs[i];
+            }
+            finished += got;
+        } while (got == ASYNC_DEPTH);
+    }
+    return now_seconds() - start;
+}
+
+/**
+ * Measures the asynchronous job API: the plaintext is encrypted as
+ * ASYNC_JOBS binary-container jobs and the results are decrypted again,
+ * all on one worker thread, and the output is checked against the input.
+ */
+static void run_async(FILE *out, bool *first, bench_state_t *bench,
+                      uint8_t *data, size_t length) {
+    ss_async_t *async = ss_async_create(bench->modulus_n, &bench->key, 1,
+                                        ASYNC_DEPTH);
+    if (async == NULL) {
+        fprintf(stderr, "Error: Cannot create the asynchronous engine\n");
+        exit(1);
+    }
+    ss_buffer_t inputs[ASYNC_JOBS];
+    ss_job_t *encrypted[ASYNC_JOBS];
+    ss_job_t *decrypted[ASYNC_JOBS];
+    size_t share = length / ASYNC_JOBS;
+    for (size_t i = 0; i < ASYNC_JOBS; i++) {
+        inputs[i].data = &data[i * share];
+        inputs[i].length = i + 1 < ASYNC_JOBS ? share : length - i * share;
+    }
+    double mb = (double)length / 1e6;
+
+    double elapsed = run_jobs(async, SS_JOB_ENCRYPT_BINARY, inputs,
+                              ASYNC_JOBS, encrypted);
+    emit_result(out, first, "ss_async_encrypt", bench->bits, "mb_per_s",
+                mb / elapsed, ASYNC_JOBS, elapsed);
+
+    ss_buffer_t ciphertexts[ASYNC_JOBS];
+    for (size_t i = 0; i < ASYNC_JOBS; i++) {
+        ciphertexts[i].data = encrypted[i]->output;
+        ciphertexts[i].length = encrypted[i]->output_length;
+    }
+    elapsed = run_jobs(async, SS_JOB_DECRYPT, ciphertexts, ASYNC_JOBS,
+                       decrypted);
+    emit_result(out, first, "ss_async_decrypt", bench->bits, "mb_per_s",
+                mb / elapsed, ASYNC_JOBS, elapsed);
+
+    for (size_t i = 0; i < ASYNC_JOBS; i++) {
+        if (!encrypted[i]->ok || !decrypted[i]->ok ||
+            decrypted[i]->output_length != inputs[i].length ||
+            (inputs[i].length > 0 &&
+             memcmp(decrypted[i]->output, inputs[i].data,
+                    inputs[i].length) != 0)) {
+            fprintf(stderr, "Error: Asynchronous job %zu did not round-trip\n",
+                    i);
+            exit(1);
+        }
+        ss_job_free(encrypted[i]);
+        ss_job_free(decrypted[i]);
+    }
+    ss_async_destroy(async);
+}
+
+/**
+ * Measures ss_encrypt_file and the two file decryption paths over a
+ * temporary file of random plaintext and reports throughput in MB/s of
+ * plaintext.
+ */
+static void run_files(FILE *out, bool *first, bench_state_t *bench,
+                      size_t kib) {
+    size_t length = kib * 1024;
+    uint8_t *data = (uint8_t *)malloc(length);
+    for (size_t i = 0; i < length; i++) {
+        data[i] = (uint8_t)randstate_uniform(NULL, 256);
+    }
+
+    FILE *plain = tmpfile();
+    FILE *cipher = tmpfile();
+    FILE *decoded = tmpfile();
+    if (plain == NULL || cipher == NULL || decoded == NULL) {
+        fprintf(stderr, "Error: Cannot create temporary files\n");
+        exit(1);
+    }
+    fwrite(data, 1, length, plain);
+    double mb = (double)length / 1e6;
+
+    rewind(plain);
+    double start = now_seconds();
+    ss_encrypt_file(plain, cipher, bench->modulus_n);
+    fflush(cipher);
+    double elapsed = now_seconds() - start;
+    emit_result(out, first, "ss_encrypt_file", bench->bits, "mb_per_s",
+                mb / elapsed, 1, elapsed);
+
+    rewind(cipher);
+    start = now_seconds();
+    ss_decrypt_file(cipher, decoded, bench->private_key_d, bench->modulus_pq);
+    fflush(decoded);
+    elapsed = now_seconds() - start;
+    emit_result(out, first, "ss_decrypt_file", bench->bits, "mb_per_s",
+                mb / elapsed, 1, elapsed);
+
+    rewind(cipher);
+    rewind(decoded);
+    start = now_seconds();
+    ss_decrypt_file_key(cipher, decoded, &bench->key);
+    fflush(decoded);
+    elapsed = now_seconds() - start;
+    emit_result(out, first, "ss_decrypt_file_key", bench->bits, "mb_per_s",
+                mb / elapsed, 1, elapsed);
+
+    run_async(out, first, bench, data, length);
+
+    fclose(plain);
+    fclose(cipher);
+    fclose(decoded);
+    free(data);
+}
+
+/**
+ * Generates a key of the given size and benchmarks every operation with it.
+ */
+static void run_size(FILE *out, bool *first, uint64_t bits,
+                     uint64_t iterations, double min_time, size_t kib) {
+    bench_state_t bench;
+    bench.bits = bits;
+    bench.iterations = iterations;
+    mpz_inits(bench.base, bench.exponent, bench.result, bench.plaintext,
+              bench.ciphertext, bench.scratch, NULL);
+    ss_priv_key_init(&bench.key);
+
+    // These initialize the key variables themselves
+    ss_make_pub(bench.prime_p, bench.prime_q, bench.modulus_n, bits,
+                iterations);
+    ss_make_priv(bench.private_key_d, bench.modulus_pq, bench.prime_p,
+                 bench.prime_q);
+    ss_priv_key_set_crt(&bench.key, bench.modulus_pq, bench.private_key_d,
+                        bench.prime_p, bench.prime_q);
+    mpz_urandomm(bench.base, state, bench.modulus_n);
+    mpz_urandomm(bench.exponent, state, bench.modulus_n);
+    mpz_urandomm(bench.plaintext, state, bench.modulus_pq);
+    ss_encrypt(bench.ciphertext, bench.plaintext, bench.modulus_n);
+    pow_mod_ctx_init(&bench.encrypt_ctx, bench.modulus_n);
+    pow_mod_schedule_init(&bench.encrypt_plan, bench.modulus_n);
+
+    run_op(out, first, "make_prime", &bench, bench_make_prime, min_time);
+    run_op(out, first, "is_prime", &bench, bench_is_prime, min_time);
+    run_op(out, first, "pow_mod", &bench, bench_pow_mod, min_time);
+    run_op(out, first, "mod_inverse", &bench, bench_mod_inverse, min_time);
+    run_op(out, first, "ss_make_pub", &bench, bench_make_pub, min_time);
+    run_op(out, first, "ss_make_priv", &bench, bench_make_priv, min_time);
+    run_op(out, first, "ss_encrypt", &bench, bench_encrypt, min_time);
+    run_op(out, first, "pow_mod_schedule", &bench, bench_pow_mod_schedule,
+           min_time);
+    run_op(out, first, "ss_decrypt", &bench, bench_decrypt, min_time);
+    run_op(out, first, "ss_decrypt_key", &bench, bench_decrypt_crt,
+           min_time);
+    run_files(out, first, &bench, kib);
+
+    pow_mod_schedule_clear(&bench.encrypt_plan);
+    pow_mod_ctx_clear(&bench.encrypt_ctx);
+    ss_priv_key_clear(&bench.key);
+    mpz_clears(bench.prime_p, bench.prime_q, bench.modulus_n,
+               bench.modulus_pq, bench.private_key_d, bench.base,
+               bench.exponent, bench.result, bench.plaintext,
+               bench.ciphertext, bench.scratch, NULL);
+}
+
+int main(int argc, char **argv) {
+    int option;
+    uint64_t bits = 0;  // 0 runs every default size
+    uint64_t iterations = 50;
+    size_t kib = 256;
+    double min_time = 0.5;
+    uint64_t random_seed = 2023;
+    FILE *out = stdout;
+
+    while ((option = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (option) {
+            case 'b':
+                bits = (uint64_t)strtoull(optarg, NULL, 10);
+                break;
+            case 'i':
+                iterations = (uint64_t)strtoull(optarg, NULL, 10);
+                break;
+            case 'k':
+                kib = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                min_time = strtod(optarg, NULL);
+                break;
+            case 's':
+                random_seed = (uint64_t)strtoull(optarg, NULL, 10);
+                break;
+            case 'o':
+                out = fopen(optarg, "w");
+                if (out == NULL) {
+                    printf("Error: Cannot open file %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'h':
+                // clang-format off
+                printf(
+                    "SYNOPSIS\n"
+                    "   Benchmarks SS key generation, encryption, decryption and number theory\n"
+                    "   primitives and prints the results as JSON.\n"
+                    "\n"
+                    "USAGE\n"
+                    "   %s [-b:i:k:m:s:o:h] [-b bits] [-i iterations] [-k kib] [-m seconds] [-s seed] [-o output_file]\n"
+                    "\n"
+                    "OPTIONS\n"
+                    "   -b bits         Modulus size to measure (default: 1024, 2048, 3072 and 4096).\n"
+                    "   -i iterations   Miller-Rabin iterations (default: 50).\n"
+                    "   -k kib          Plaintext size for the file throughput runs in KiB (default: 256).\n"
+                    "   -m seconds      Minimum time spent on each operation (default: 0.5).\n"
+                    "   -s seed         Random seed (default: 2023).\n"
+                    "   -o output_file  Writes the JSON results to a file (default: stdout).\n"
+                    "   -h              Prints this help message.\n",
+                    argv[0]);
+                // clang-format on
+                exit(0);
+            default:
+                fprintf(stderr, "Invalid option: -%c\n", optopt);
+                exit(1);
+        }
+    }
+
+    randstate_init(random_seed);
+
+    fprintf(out,
+            "{\n  \"seed\": %" PRIu64 ",\n  \"iterations\": %" PRIu64 ",\n"
+            "  \"min_time\": %.3f,\n  \"file_kib\": %zu,\n  \"results\": [",
+            random_seed, iterations, min_time, kib);
+    bool first = true;
+    if (bits != 0) {
+        run_size(out, &first, bits, iterations, min_time, kib);
+    } else {
+        for (size_t i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]);
+             i++) {
+            run_size(out, &first, default_sizes[i], iterations, min_time,
+                     kib);
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    randstate_clear();
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <gmp.h>
+
+#include "codec.h"
+
+// Writes the low width bytes of value big-endian into out, zero-filling
+// above the value. Nails are never enabled in the GMP builds we link.
+static void put_bytes(uint8_t *out, size_t width, const mpz_t value) {
+    const mp_limb_t *limbs = mpz_limbs_read(value);
+    size_t size = mpz_size(value);
+    uint8_t *end = &out[width];
+    for (size_t i = 0; i < size && end > out; i++) {
+        mp_limb_t limb = limbs[i];
+        for (size_t b = 0; b < sizeof(mp_limb_t) && end > out; b++) {
+            *--end = (uint8_t)limb;
+            limb >>= 8;
+        }
+    }
+    memset(out, 0, (size_t)(end - out));
+}
+
+// Returns byte index of a nonnegative value, counting from the least
+// significant byte
+static uint8_t byte_at(const mpz_t value, size_t index) {
+    size_t bit = 8 * index;
+    mp_limb_t limb = mpz_getlimbn(value, (mp_size_t)(bit / GMP_NUMB_BITS));
+    return (uint8_t)(limb >> (bit % GMP_NUMB_BITS));
+}
+
+void ss_codec_export_slot(uint8_t *slot, size_t width, const mpz_t value) {
+    put_bytes(slot, width, value);
+}
+
+void ss_codec_import_slot(mpz_t value, const uint8_t *slot, size_t width) {
+    mpz_import(value, width, 1, 1, 1, 0, slot);
+}
+
+void ss_codec_import_plain(mpz_t value, const uint8_t *data, size_t length) {
+    mpz_import(value, length, 1, 1, 1, 0, data);
+    for (size_t b = 0; b < 8; b++) {
+        if ((SS_CODEC_PAD >> b) & 1) {
+            mpz_setbit(value, 8 * length + b);
+        }
+    }
+}
+
+size_t ss_codec_export_plain(uint8_t *out, size_t capacity,
+                             const mpz_t value) {
+    if (mpz_sgn(value) <= 0) {
+        return SS_CODEC_INVALID;
+    }
+    size_t length = (mpz_sizeinbase(value, 2) + 7) / 8 - 1;
+    if (length > capacity || byte_at(value, length) != SS_CODEC_PAD) {
+        return SS_CODEC_INVALID;
+    }
+    put_bytes(out, length, value);
+    return length;
+}
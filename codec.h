@@ -0,0 +1,65 @@
+#ifndef SS_CODEC_H
+#define SS_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <gmp.h>
+
+// Byte prepended to every plaintext block so leading zero bytes survive the
+// round trip through a bignum
+#define SS_CODEC_PAD 0xFF
+
+// Returned instead of a length for a block that does not decode
+#define SS_CODEC_INVALID SIZE_MAX
+
+/**
+ * Exports a value into a fixed-width big-endian slot, zero-padding on the
+ * left, directly from its limbs. The value must fit in width bytes; a wider
+ * value has its high bytes dropped rather than overrunning the slot.
+ *
+ * Args:
+ *   slot (uint8_t*): The slot to fill (output).
+ *   width (size_t): The slot width in bytes.
+ *   value (const mpz_t): The value to export.
+ */
+void ss_codec_export_slot(uint8_t *slot, size_t width, const mpz_t value);
+
+/**
+ * Imports a value from a fixed-width big-endian slot.
+ *
+ * Args:
+ *   value (mpz_t): The imported value (output).
+ *   slot (const uint8_t*): The slot to read.
+ *   width (size_t): The slot width in bytes.
+ */
+void ss_codec_import_slot(mpz_t value, const uint8_t *slot, size_t width);
+
+/**
+ * Imports a plaintext block as SS_CODEC_PAD followed by data, reading data
+ * where it lies. value should have room for 8 * (length + 1) bits so the
+ * import does not reallocate.
+ *
+ * Args:
+ *   value (mpz_t): The padded block (output).
+ *   data (const uint8_t*): The plaintext bytes.
+ *   length (size_t): The number of plaintext bytes.
+ */
+void ss_codec_import_plain(mpz_t value, const uint8_t *data, size_t length);
+
+/**
+ * Exports a decrypted block without its pad byte straight into the caller's
+ * buffer.
+ *
+ * Args:
+ *   out (uint8_t*): Room for capacity bytes (output).
+ *   capacity (size_t): The most plaintext bytes a block may carry.
+ *   value (const mpz_t): The decrypted, padded block.
+ *
+ * Returns:
+ *   The number of bytes written, or SS_CODEC_INVALID (nothing written) if
+ * the block does not start with the pad byte or would exceed capacity.
+ */
+size_t ss_codec_export_plain(uint8_t *out, size_t capacity, const mpz_t value);
+
+#endif // SS_CODEC_H
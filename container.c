@@ -0,0 +1,146 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <gmp.h>
+
+#include "container.h"
+
+// Offset of the block count field within the header
+#define COUNT_OFFSET 16
+
+void ss_container_put_be32(uint8_t *out, uint32_t value) {
+    for (int i = 3; i >= 0; i--) {
+        out[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+static void put_be64(uint8_t *out, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+        out[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+uint32_t ss_container_get_be32(const uint8_t *in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static uint64_t get_be64(const uint8_t *in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+size_t ss_container_block_width(uint32_t modulus_bits) {
+    return ((size_t)modulus_bits + 7) / 8;
+}
+
+size_t ss_container_block_size(uint32_t modulus_bits) {
+    size_t sqrt_bits = ((size_t)modulus_bits + 1) / 2;
+    return sqrt_bits == 0 ? 0 : (sqrt_bits - 1) / 8;
+}
+
+void ss_container_encode_header(uint8_t *raw,
+                                const ss_container_header_t *header) {
+    memset(raw, 0, SS_CONTAINER_HEADER_SIZE);
+    memcpy(raw, SS_CONTAINER_MAGIC, SS_CONTAINER_MAGIC_SIZE);
+    raw[4] = header->version;
+    ss_container_put_be32(&raw[8], header->modulus_bits);
+    ss_container_put_be32(&raw[12], header->block_size);
+    put_be64(&raw[COUNT_OFFSET], header->block_count);
+}
+
+bool ss_container_decode_header(ss_container_header_t *header,
+                                const uint8_t *raw) {
+    if (memcmp(raw, SS_CONTAINER_MAGIC, SS_CONTAINER_MAGIC_SIZE) != 0) {
+        return false;
+    }
+    header->version = raw[4];
+    header->modulus_bits = ss_container_get_be32(&raw[8]);
+    header->block_size = ss_container_get_be32(&raw[12]);
+    header->block_count = get_be64(&raw[COUNT_OFFSET]);
+    return (header->version == SS_CONTAINER_VERSION ||
+            header->version == SS_CONTAINER_VERSION_HYBRID) &&
+           header->modulus_bits <= SS_CONTAINER_MAX_MODULUS_BITS &&
+           header->block_size >= 2 &&
+           header->block_size ==
+               ss_container_block_size(header->modulus_bits);
+}
+
+bool ss_container_write_header(const ss_container_header_t *header,
+                               FILE *outfile) {
+    uint8_t raw[SS_CONTAINER_HEADER_SIZE];
+    ss_container_encode_header(raw, header);
+    return fwrite(raw, 1, sizeof(raw), outfile) == sizeof(raw);
+}
+
+bool ss_container_patch_count(FILE *outfile, long header_offset,
+                              uint64_t block_count) {
+    // Return to the saved position rather than SEEK_END: memory streams
+    // measure their end from the last write, which is the patched count.
+    long end = ftell(outfile);
+    if (header_offset < 0 || end < 0 ||
+        fseek(outfile, header_offset + COUNT_OFFSET, SEEK_SET) != 0) {
+        return false;
+    }
+    uint8_t raw[8];
+    put_be64(raw, block_count);
+    bool written = fwrite(raw, 1, sizeof(raw), outfile) == sizeof(raw);
+    return fseek(outfile, end, SEEK_SET) == 0 && written;
+}
+
+bool ss_container_detect(FILE *infile) {
+    // Only one byte of pushback is portable, so decide on the first byte
+    int first = getc(infile);
+    if (first == EOF) {
+        return false;
+    }
+    if (first != SS_CONTAINER_MAGIC[0]) {
+        ungetc(first, infile);
+        return false;
+    }
+    char rest[SS_CONTAINER_MAGIC_SIZE - 1];
+    return fread(rest, 1, sizeof(rest), infile) == sizeof(rest) &&
+           memcmp(rest, &SS_CONTAINER_MAGIC[1], sizeof(rest)) == 0;
+}
+
+bool ss_container_read_header(ss_container_header_t *header, FILE *infile) {
+    // The magic was consumed by ss_container_detect
+    uint8_t raw[SS_CONTAINER_HEADER_SIZE];
+    memcpy(raw, SS_CONTAINER_MAGIC, SS_CONTAINER_MAGIC_SIZE);
+    size_t rest = SS_CONTAINER_HEADER_SIZE - SS_CONTAINER_MAGIC_SIZE;
+    if (fread(&raw[SS_CONTAINER_MAGIC_SIZE], 1, rest, infile) != rest) {
+        return false;
+    }
+    return ss_container_decode_header(header, raw);
+}
+
+bool ss_container_skip(FILE *infile, uint64_t bytes) {
+    if (bytes == 0) {
+        return true;
+    }
+    if (bytes <= (uint64_t)INT64_MAX &&
+        fseeko(infile, (off_t)bytes, SEEK_CUR) == 0) {
+        return true;
+    }
+    uint8_t discard[1 << 12];
+    while (bytes > 0) {
+        size_t wanted = bytes < sizeof(discard) ? (size_t)bytes
+                                                : sizeof(discard);
+        size_t got = fread(discard, 1, wanted, infile);
+        if (got == 0) {
+            return false;
+        }
+        bytes -= got;
+    }
+    return true;
+}
@@ -0,0 +1,178 @@
+#ifndef SS_CONTAINER_H
+#define SS_CONTAINER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <gmp.h>
+
+// Leading bytes of a binary ciphertext container. Hex ciphertext never
+// starts with 'S', which lets decoders tell the two formats apart.
+#define SS_CONTAINER_MAGIC "SSCB"
+#define SS_CONTAINER_MAGIC_SIZE 4
+
+#define SS_CONTAINER_VERSION 1
+
+// Version of hybrid containers, whose blocks hold a wrapped session key
+// followed by symmetrically encrypted records (see hybrid.h)
+#define SS_CONTAINER_VERSION_HYBRID 2
+
+// Magic, version, 3 reserved bytes, modulus bits, block size, block count
+#define SS_CONTAINER_HEADER_SIZE 24
+
+// Largest modulus a container header may declare. Far beyond any key this
+// tool makes, but it keeps a damaged header from sizing huge buffers.
+#define SS_CONTAINER_MAX_MODULUS_BITS (1u << 20)
+
+// Block count written when the output cannot be rewound to patch the header
+// (pipes, sockets); the decoder then reads blocks until end of file.
+#define SS_CONTAINER_COUNT_UNKNOWN UINT64_MAX
+
+/**
+ * Header of a binary ciphertext container. All fields are stored big-endian
+ * and are followed by block_count ciphertext blocks, each exactly
+ * ss_container_block_width(modulus_bits) bytes wide. Every block but the
+ * last carries block_size - 1 plaintext bytes, so plaintext byte x lives in
+ * block x / (block_size - 1) and any range can be decrypted by seeking.
+ */
+typedef struct {
+    uint8_t version;       // SS_CONTAINER_VERSION or SS_CONTAINER_VERSION_HYBRID
+    uint32_t modulus_bits; // bit length of the public modulus n
+    uint32_t block_size;   // plaintext block size in bytes
+    uint64_t block_count;  // number of blocks, or SS_CONTAINER_COUNT_UNKNOWN
+} ss_container_header_t;
+
+/**
+ * Returns the fixed width in bytes of a ciphertext block under a modulus.
+ *
+ * Args:
+ *   modulus_bits (uint32_t): The bit length of the public modulus n.
+ *
+ * Returns:
+ *   The number of bytes needed to hold any value below the modulus.
+ */
+size_t ss_container_block_width(uint32_t modulus_bits);
+
+/**
+ * Returns the plaintext block size, including the 0xFF pad, that encryption
+ * uses under a modulus: the bytes that fit below its square root.
+ *
+ * Args:
+ *   modulus_bits (uint32_t): The bit length of the public modulus n.
+ *
+ * Returns:
+ *   The block size in bytes, 0 if the modulus is too small for any.
+ */
+size_t ss_container_block_size(uint32_t modulus_bits);
+
+/**
+ * Writes a 32-bit value big-endian, as every field of the container formats
+ * and key files is stored.
+ *
+ * Args:
+ *   out (uint8_t*): The 4 bytes to write (output).
+ *   value (uint32_t): The value.
+ */
+void ss_container_put_be32(uint8_t *out, uint32_t value);
+
+/**
+ * Reads a big-endian 32-bit value.
+ *
+ * Args:
+ *   in (const uint8_t*): The 4 bytes to read.
+ *
+ * Returns:
+ *   The value.
+ */
+uint32_t ss_container_get_be32(const uint8_t *in);
+
+/**
+ * Serializes the magic bytes and header of a binary container into memory,
+ * e.g. the start of a mapped output file.
+ *
+ * Args:
+ *   raw (uint8_t*): SS_CONTAINER_HEADER_SIZE bytes to fill (output).
+ *   header (const ss_container_header_t*): The header to serialize.
+ */
+void ss_container_encode_header(uint8_t *raw, const ss_container_header_t *header);
+
+/**
+ * Parses the magic bytes and header of a binary container held in memory.
+ *
+ * Args:
+ *   header (ss_container_header_t*): The parsed header (output).
+ *   raw (const uint8_t*): SS_CONTAINER_HEADER_SIZE bytes to parse.
+ *
+ * Returns:
+ *   true if raw holds the magic and a supported header whose block size is
+ *   the one its modulus size gives, false otherwise.
+ */
+bool ss_container_decode_header(ss_container_header_t *header, const uint8_t *raw);
+
+/**
+ * Writes the magic bytes and header of a binary container.
+ *
+ * Args:
+ *   header (const ss_container_header_t*): The header to write.
+ *   outfile (FILE*): The file to write to.
+ *
+ * Returns:
+ *   true on success, false if the write failed.
+ */
+bool ss_container_write_header(const ss_container_header_t *header, FILE *outfile);
+
+/**
+ * Rewrites the block count of a header that was written at header_offset.
+ * The file position is restored to where it was afterwards.
+ *
+ * Args:
+ *   outfile (FILE*): The seekable file holding the container.
+ *   header_offset (long): The offset the header was written at.
+ *   block_count (uint64_t): The final number of blocks.
+ *
+ * Returns:
+ *   true if the count was patched, false if the file is not seekable.
+ */
+bool ss_container_patch_count(FILE *outfile, long header_offset, uint64_t block_count);
+
+/**
+ * Checks whether a stream starts with the container magic. If it does, the
+ * magic is consumed; otherwise the stream is left where it was so it can be
+ * read as hex.
+ *
+ * Args:
+ *   infile (FILE*): The file to inspect.
+ *
+ * Returns:
+ *   true if the stream holds a binary container, false otherwise.
+ */
+bool ss_container_detect(FILE *infile);
+
+/**
+ * Reads the rest of a container header after ss_container_detect.
+ *
+ * Args:
+ *   header (ss_container_header_t*): The parsed header (output).
+ *   infile (FILE*): The file to read from.
+ *
+ * Returns:
+ *   true if a supported header was read, false otherwise.
+ */
+bool ss_container_read_header(ss_container_header_t *header, FILE *infile);
+
+/**
+ * Advances a stream past bytes it does not need, seeking when it can and
+ * reading and discarding otherwise (pipes, sockets).
+ *
+ * Args:
+ *   infile (FILE*): The file to advance.
+ *   bytes (uint64_t): The number of bytes to skip.
+ *
+ * Returns:
+ *   true if the bytes were skipped, false if a non-seekable stream ended
+ * first.
+ */
+bool ss_container_skip(FILE *infile, uint64_t bytes);
+
+#endif // SS_CONTAINER_H
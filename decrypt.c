@@ -1,3 +1,4 @@
+#include <getopt.h>
 #include <gmp.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -9,10 +10,20 @@
 #include <unistd.h>
 
 #include "numtheory.h"
+#include "pool.h"
 #include "randstate.h"
+#include "service.h"
 #include "ss.h"
+#include "stats.h"
 
-#define OPTIONS "i:o:n:vh"
+#define OPTIONS "i:o:n:t:a:S:O:L:vh"
+
+// Long spellings of the range options
+static const struct option long_options[] = {
+    { "offset", required_argument, NULL, 'O' },
+    { "length", required_argument, NULL, 'L' },
+    { NULL, 0, NULL, 0 },
+};
 
 /**
  * Opens a file with the specified mode and handles errors.
@@ -37,6 +48,11 @@ FILE *open_file(const char *filepath, const char *mode) {
 int main(int argc, char **argv) {
     int option;
     bool verbose_mode = false;
+    size_t threads = 1;
+    pool_affinity_t affinity = POOL_AFFINITY_NONE;
+    char *socket_path = NULL;  // Decrypt locally unless a service is named
+    uint64_t offset = 0;       // Plaintext range to write
+    uint64_t length = SS_DECRYPT_TO_END;
 
     // Default private key file
     char *private_key_file = malloc(sizeof(char) * 100);
@@ -49,7 +65,8 @@ int main(int argc, char **argv) {
     FILE *output_file = stdout;
 
     // Parse command-line arguments
-    while ((option = getopt(argc, argv, OPTIONS)) != -1) {
+    while ((option = getopt_long(argc, argv, OPTIONS, long_options, NULL)) !=
+           -1) {
         switch (option) {
             case 'i':
                 input_filepath = optarg;
@@ -64,6 +81,25 @@ int main(int argc, char **argv) {
                 strcpy(private_key_file,
                        optarg);  // Update private key file path
                 break;
+            case 't':
+                threads = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'a':
+                if (!pool_parse_affinity(optarg, &affinity)) {
+                    fprintf(stderr, "Invalid placement: %s\n", optarg);
+                    exit(1);
+                }
+                pool_set_affinity(affinity);
+                break;
+            case 'S':
+                socket_path = optarg;
+                break;
+            case 'O':
+                offset = (uint64_t)strtoull(optarg, NULL, 10);
+                break;
+            case 'L':
+                length = (uint64_t)strtoull(optarg, NULL, 10);
+                break;
             case 'v':
                 verbose_mode = true;  // Enable verbose mode
                 break;
@@ -74,13 +110,19 @@ int main(int argc, char **argv) {
                     "   Decrypts encrypted files using the corresponding private key.\n"
                     "\n"
                     "USAGE\n"
-                    "   %s [-i:o:n:vh] [-i input_file] [-o output_file] [-n private_key_file]\n"
+                    "   %s [-i:o:n:t:a:S:O:L:vh] [-i input_file] [-o output_file] [-n private_key_file] [-t threads] [-a placement] [-S socket] [-O offset] [-L length]\n"
                     "\n"
                     "OPTIONS\n"
                     "   -i              Specifies the input file to decrypt (default: stdin).\n"
                     "   -o              Specifies the output file to decrypt (default: stdout).\n"
                     "   -n              Specifies the file containing the private key (default: ss.priv).\n"
-                    "   -v              Enables verbose output.\n"
+                    "   -t threads      Number of threads to decrypt with (default: 1).\n"
+                    "   -a placement    Pins worker threads: none, cpu or numa (default: none).\n"
+                    "   -S socket       Decrypts through the ssd service listening on socket.\n"
+                    "   -O, --offset n  Writes the plaintext from byte n on (default: 0).\n"
+                    "   -L, --length n  Writes at most n bytes of plaintext (default: all).\n"
+                    "                   Binary and hybrid ciphertext only decrypt the blocks covering the range.\n"
+                    "   -v              Enables verbose output, with a JSON stats line on stderr.\n"
                     "   -h              Prints this help message.\n",
                     argv[0]);
                 // clang-format on
@@ -91,33 +133,67 @@ int main(int argc, char **argv) {
                 exit(1);
         }
     }
+    // The service already holds the key, so nothing is parsed here
+    if (socket_path != NULL) {
+        if (offset != 0 || length != SS_DECRYPT_TO_END) {
+            fprintf(stderr, "Error: -O and -L need local decryption\n");
+            exit(1);
+        }
+        char error[256];
+        if (!ss_service_file(socket_path, SS_SERVICE_DECRYPT, input_file,
+                             output_file, error, sizeof(error))) {
+            fprintf(stderr, "Error: %s\n", error);
+            exit(1);
+        }
+        fclose(input_file);
+        fclose(output_file);
+        free(private_key_file);
+        return 0;
+    }
+
+    if (verbose_mode) {
+        stats_enable();
+    }
+
     // Open private key file
     FILE *private_key_fp = open_file(private_key_file, "r");
 
-    // Initialize GMP variables
-    mpz_t private_key_modulus, private_key_exponent;
-    mpz_inits(private_key_modulus, private_key_exponent, NULL);
-
-    // Read private key from file
-    ss_read_priv(private_key_modulus, private_key_exponent, private_key_fp);
+    // Read private key from file, including CRT values when present
+    ss_priv_key_t private_key;
+    ss_priv_key_init(&private_key);
+    if (!ss_read_priv_key(&private_key, private_key_fp)) {
+        fprintf(stderr, "Error: Invalid private key file %s\n",
+                private_key_file);
+        exit(1);
+    }
 
     // Verbose output: Display private key information
     if (verbose_mode) {
         gmp_printf("Private key modulus (pq, %u bits) = %Zd\n",
-                   mpz_sizeinbase(private_key_modulus, 2), private_key_modulus);
+                   mpz_sizeinbase(private_key.modulus_pq, 2),
+                   private_key.modulus_pq);
         gmp_printf("Private key exponent (d, %u bits) = %Zd\n",
-                   mpz_sizeinbase(private_key_exponent, 2),
-                   private_key_exponent);
+                   mpz_sizeinbase(private_key.private_key_d, 2),
+                   private_key.private_key_d);
+        printf("CRT decryption: %s\n", private_key.has_crt ? "yes" : "no");
+    }
+    // Decrypt the input file; the ciphertext format is detected automatically
+    if (!ss_decrypt_file_range(input_file, output_file, &private_key, threads,
+                               offset, length)) {
+        fprintf(stderr, ferror(output_file)
+                            ? "Error: Cannot write the plaintext\n"
+                            : "Error: Malformed or truncated ciphertext, or wrong key\n");
+        exit(1);
     }
-    // Decrypt the input file
-    ss_decrypt_file(input_file, output_file, private_key_exponent,
-                    private_key_modulus);
 
     // Clear GMP variables and close files
-    mpz_clears(private_key_modulus, private_key_exponent, NULL);
+    ss_priv_key_clear(&private_key);
     fclose(private_key_fp);
     fclose(input_file);
     fclose(output_file);
+    if (verbose_mode) {
+        stats_print(stderr, "decrypt");
+    }
 
     // Free dynamically allocated memory
     free(private_key_file);
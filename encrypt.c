@@ -1,17 +1,38 @@
 #include <gmp.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "keyfile.h"
 #include "numtheory.h"
+#include "pool.h"
 #include "randstate.h"
+#include "service.h"
 #include "ss.h"
-#define OPTIONS "i:o:n:vh"
+#include "stats.h"
+#define OPTIONS "i:o:n:K:D:t:a:f:S:vh"
+
+/**
+ * Checks whether a public modulus leaves room for any plaintext in a block.
+ *
+ * Args:
+ *   modulus_n (const mpz_t): The public key modulus.
+ *
+ * Returns:
+ *   true if the modulus can encrypt, false if it is too small.
+ */
+static bool modulus_fits(const mpz_t modulus_n) {
+    ss_key_meta_t meta;
+    ss_key_meta_init(&meta, modulus_n);
+    return meta.block_size >= 2;
+}
 
 /**
  * Opens a file with the specified mode and handles errors.
@@ -33,16 +54,131 @@ FILE *open_file(const char *filepath, const char *mode) {
     return file;
 }
 
+/**
+ * Picks the output file name of a keyring key: its username, unless that is
+ * empty, could leave the output directory or belongs to an earlier key too.
+ */
+static void keyring_output_path(char *path, size_t size, const char *dir,
+                                const ss_keyring_t *ring, size_t index,
+                                const char *username) {
+    bool usable = username[0] != '\0' && username[0] != '.' &&
+                  strchr(username, '/') == NULL &&
+                  ss_keyring_find(ring, username) == (ptrdiff_t)index;
+    if (usable) {
+        snprintf(path, size, "%s/%s.ss", dir, username);
+    } else {
+        snprintf(path, size, "%s/key%zu.ss", dir, index);
+    }
+}
+
+/**
+ * Encrypts the input once for every -n key and every key of a keyring. The
+ * k-th -o output goes with the k-th -n key (a lone -n key may use stdout),
+ * and keyring keys are written to <dir>/<username>.ss.
+ */
+static void encrypt_multi(FILE *input_file, char **key_files,
+                          size_t key_count, FILE **outputs,
+                          size_t output_count, const char *keyring_file,
+                          const char *output_dir, ss_format_t format,
+                          size_t threads, bool verbose_mode) {
+    if (key_count > 1 ? output_count != key_count : output_count > key_count) {
+        fprintf(stderr, "Error: Give one -o per -n key\n");
+        exit(1);
+    }
+    ss_keyring_t ring = { 0 };
+    if (keyring_file != NULL && !ss_keyring_open(&ring, keyring_file)) {
+        fprintf(stderr, "Error: Cannot read keyring %s\n", keyring_file);
+        exit(1);
+    }
+    size_t count = key_count + ring.count;
+    if (count == 0) {
+        fprintf(stderr, "Error: Keyring %s holds no keys\n", keyring_file);
+        exit(1);
+    }
+
+    // Every recipient holds an output open until the end
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < count + 16) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    mpz_t *moduli = (mpz_t *)malloc(count * sizeof(mpz_t));
+    FILE **outfiles = (FILE **)malloc(count * sizeof(FILE *));
+    char username[SS_USERNAME_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        mpz_init(moduli[i]);
+        if (i < key_count) {
+            FILE *public_key_fp = open_file(key_files[i], "r");
+            if (!ss_read_pub_key(moduli[i], username, sizeof(username),
+                                 public_key_fp)) {
+                fprintf(stderr, "Error: Invalid public key file %s\n",
+                        key_files[i]);
+                exit(1);
+            }
+            fclose(public_key_fp);
+            outfiles[i] = output_count > 0 ? outputs[i] : stdout;
+        } else {
+            size_t index = i - key_count;
+            if (!ss_keyring_get(&ring, index, moduli[i], username,
+                                sizeof(username))) {
+                fprintf(stderr, "Error: Invalid key %zu in keyring %s\n",
+                        index, keyring_file);
+                exit(1);
+            }
+            char path[PATH_MAX];
+            keyring_output_path(path, sizeof(path), output_dir, &ring, index,
+                                username);
+            outfiles[i] = open_file(path, "w+");
+        }
+        if (verbose_mode) {
+            printf("Username: %s (%zu bits)\n", username,
+                   mpz_sizeinbase(moduli[i], 2));
+        }
+    }
+    ss_keyring_close(&ring);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!modulus_fits(moduli[i])) {
+            fprintf(stderr, "Error: A public modulus is too small to encrypt with\n");
+            exit(1);
+        }
+    }
+    if (!ss_encrypt_file_multi(input_file, outfiles, moduli, count, format,
+                               threads)) {
+        fprintf(stderr, format == SS_FORMAT_HYBRID
+                            ? "Error: Cannot write hybrid ciphertext\n"
+                            : "Error: Cannot write ciphertext\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        mpz_clear(moduli[i]);
+        fclose(outfiles[i]);
+    }
+    free(moduli);
+    free(outfiles);
+}
+
 int main(int argc, char **argv) {
     // Command-line option variables
     int option;
     bool verbose_mode = false;
+    size_t threads = 1;
+    pool_affinity_t affinity = POOL_AFFINITY_NONE;
+    ss_format_t format = SS_FORMAT_HEX;
+    char *socket_path = NULL;  // Encrypt locally unless a service is named
 
-    // Default file paths
-    char *public_key_file = malloc(sizeof(char) * 100);
-    strcpy(public_key_file, "ss.pub");
+    // Default file paths; -n and -o may be repeated to encrypt for several
+    // keys, and there cannot be more of either than arguments
+    const char *public_key_file = "ss.pub";
+    char **key_files = (char **)malloc(sizeof(char *) * argc);
+    size_t key_count = 0;
+    FILE **outputs = (FILE **)malloc(sizeof(FILE *) * argc);
+    size_t output_count = 0;
+    const char *keyring_file = NULL;  // Every key of a keyring, with -K
+    const char *output_dir = ".";     // Where keyring outputs are written
 
-    char *username = malloc(sizeof(char) * 100);
+    char *username = malloc(sizeof(char) * SS_USERNAME_SIZE);
 
     // Input and output file pointers
     FILE *input_file = stdin;    // Default to standard input
@@ -57,11 +193,44 @@ int main(int argc, char **argv) {
             }
             case 'o': {
                 char *output_filepath = optarg;  // Get output file path
-                output_file = open_file(output_filepath, "w");
+                // Read/write so a binary container can be mapped
+                output_file = open_file(output_filepath, "w+");
+                outputs[output_count++] = output_file;
                 break;
             }
             case 'n':
-                strcpy(public_key_file, optarg);  // Update public key file path
+                key_files[key_count++] = optarg;  // Add a public key file
+                break;
+            case 'K':
+                keyring_file = optarg;
+                break;
+            case 'D':
+                output_dir = optarg;
+                break;
+            case 't':
+                threads = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'a':
+                if (!pool_parse_affinity(optarg, &affinity)) {
+                    fprintf(stderr, "Invalid placement: %s\n", optarg);
+                    exit(1);
+                }
+                pool_set_affinity(affinity);
+                break;
+            case 'f':
+                if (strcmp(optarg, "hex") == 0) {
+                    format = SS_FORMAT_HEX;
+                } else if (strcmp(optarg, "binary") == 0) {
+                    format = SS_FORMAT_BINARY;
+                } else if (strcmp(optarg, "hybrid") == 0) {
+                    format = SS_FORMAT_HYBRID;
+                } else {
+                    fprintf(stderr, "Invalid format: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'S':
+                socket_path = optarg;
                 break;
             case 'v':
                 verbose_mode = true;  // Enable verbose mode
@@ -74,13 +243,20 @@ int main(int argc, char **argv) {
                     "   Encrypts files using a public key.\n"
                     "\n"
                     "USAGE\n"
-                    "   %s [-i:o:n:vh] [-i input_file] [-o output_file] [-n public_key_file]\n"
+                    "   %s [-i:o:n:K:D:t:a:f:S:vh] [-i input_file] [-o output_file] [-n public_key_file] [-K keyring] [-D dir] [-t threads] [-a placement] [-f format] [-S socket]\n"
                     "\n"
                     "OPTIONS\n"
                     "   -i              Specifies the input file to encrypt (default: stdin).\n"
                     "   -o              Specifies the output file to encrypt (default: stdout).\n"
-                    "   -n              Specifies the public key file (default: ss.pub).\n"
-                    "   -v              Enables verbose output.\n"
+                    "   -n              Specifies the public key file (default: ss.pub). Repeat -n and -o\n"
+                    "                   in pairs to encrypt for several keys in one pass over the input.\n"
+                    "   -K keyring      Also encrypts for every key of a binary keyring.\n"
+                    "   -D dir          Directory for keyring outputs, named <username>.ss (default: .).\n"
+                    "   -t threads      Number of threads to encrypt with (default: 1).\n"
+                    "   -a placement    Pins worker threads: none, cpu or numa (default: none).\n"
+                    "   -f format       Ciphertext format, hex, binary or hybrid (default: hex).\n"
+                    "   -S socket       Encrypts through the ssd service listening on socket.\n"
+                    "   -v              Enables verbose output, with a JSON stats line on stderr.\n"
                     "   -h              Prints this help message.\n",
                     argv[0]);
                 // clang-format on
@@ -92,10 +268,62 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (key_count == 1) {
+        public_key_file = key_files[0];
+    }
+    bool multi = key_count > 1 || keyring_file != NULL;
+    if (multi && socket_path != NULL) {
+        fprintf(stderr, "Error: -S encrypts for the service's key only\n");
+        exit(1);
+    }
+    if (!multi && output_count > 1) {
+        fprintf(stderr, "Error: Give one -o per -n key\n");
+        exit(1);
+    }
+
+    // The service already holds the key, so nothing is parsed here
+    if (socket_path != NULL) {
+        char error[256];
+        uint8_t op = format == SS_FORMAT_BINARY   ? SS_SERVICE_ENCRYPT_BINARY
+                     : format == SS_FORMAT_HYBRID ? SS_SERVICE_ENCRYPT_HYBRID
+                                                  : SS_SERVICE_ENCRYPT_HEX;
+        if (!ss_service_file(socket_path, op, input_file, output_file, error,
+                             sizeof(error))) {
+            fprintf(stderr, "Error: %s\n", error);
+            exit(1);
+        }
+        fclose(input_file);
+        fclose(output_file);
+        free(username);
+        free(key_files);
+        free(outputs);
+        return 0;
+    }
+
+    if (verbose_mode) {
+        stats_enable();
+    }
+    if (multi) {
+        encrypt_multi(input_file, key_files, key_count, outputs, output_count,
+                      keyring_file, output_dir, format, threads, verbose_mode);
+        fclose(input_file);
+        if (verbose_mode) {
+            stats_print(stderr, "encrypt");
+        }
+        free(username);
+        free(key_files);
+        free(outputs);
+        return 0;
+    }
     FILE *public_key_fp = open_file(public_key_file, "r");
     mpz_t public_modulus_n;
     mpz_init(public_modulus_n);
-    ss_read_pub(public_modulus_n, username, public_key_fp);
+    if (!ss_read_pub_key(public_modulus_n, username, SS_USERNAME_SIZE,
+                         public_key_fp)) {
+        fprintf(stderr, "Error: Invalid public key file %s\n",
+                public_key_file);
+        exit(1);
+    }
 
     // Verbose output: Display user and public modulus information
     if (verbose_mode) {
@@ -105,15 +333,29 @@ int main(int argc, char **argv) {
     }
 
     // Encrypt the input file using the public key
-    ss_encrypt_file(input_file, output_file, public_modulus_n);
+    if (!modulus_fits(public_modulus_n)) {
+        fprintf(stderr, "Error: Public modulus is too small to encrypt with\n");
+        exit(1);
+    }
+    if (!ss_encrypt_file_format(input_file, output_file, public_modulus_n,
+                                format, threads)) {
+        fprintf(stderr, format == SS_FORMAT_HYBRID
+                            ? "Error: Cannot write hybrid ciphertext\n"
+                            : "Error: Cannot write ciphertext\n");
+        exit(1);
+    }
 
     // Clear GMP variables and close files
     mpz_clear(public_modulus_n);
     fclose(public_key_fp);
     fclose(input_file);
     fclose(output_file);
+    if (verbose_mode) {
+        stats_print(stderr, "encrypt");
+    }
 
     // Free dynamically allocated memory
     free(username);
-    free(public_key_file);
+    free(key_files);
+    free(outputs);
 }
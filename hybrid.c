@@ -0,0 +1,351 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <gmp.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include "container.h"
+#include "hybrid.h"
+#include "ss.h"
+#include "stats.h"
+
+#define DIGEST_SIZE 32  // SHA-256 of the container preamble
+#define LENGTH_SIZE 4   // record length word
+
+// The nonce of record index: the base nonce with index in its last 8 bytes
+static void record_nonce(uint8_t *nonce, const uint8_t *base, uint64_t index) {
+    memcpy(nonce, base, SS_HYBRID_NONCE_SIZE);
+    for (int i = SS_HYBRID_NONCE_SIZE - 1; i >= SS_HYBRID_NONCE_SIZE - 8;
+         i--) {
+        nonce[i] ^= (uint8_t)index;
+        index >>= 8;
+    }
+}
+
+// Fills the associated data of a record: preamble digest, then length word
+static void record_aad(uint8_t *aad, const uint8_t *digest, uint32_t word) {
+    memcpy(aad, digest, DIGEST_SIZE);
+    ss_container_put_be32(&aad[DIGEST_SIZE], word);
+}
+
+/**
+ * Seals or opens one record from in into data, which may be the same buffer.
+ * On sealing the tag is produced; on opening it is checked.
+ */
+static bool crypt_record(EVP_CIPHER_CTX *cipher, bool seal,
+                         const uint8_t *base_nonce, uint64_t index,
+                         const uint8_t *digest, uint32_t word,
+                         const uint8_t *in, uint8_t *data, size_t length,
+                         uint8_t *tag) {
+    uint8_t nonce[SS_HYBRID_NONCE_SIZE];
+    uint8_t aad[DIGEST_SIZE + LENGTH_SIZE];
+    record_nonce(nonce, base_nonce, index);
+    record_aad(aad, digest, word);
+
+    int out = 0;
+    if (EVP_CipherInit_ex(cipher, NULL, NULL, NULL, nonce, seal ? 1 : 0) != 1 ||
+        EVP_CipherUpdate(cipher, NULL, &out, aad, sizeof(aad)) != 1 ||
+        (length > 0 &&
+         EVP_CipherUpdate(cipher, data, &out, in, (int)length) != 1)) {
+        return false;
+    }
+    if (!seal && EVP_CIPHER_CTX_ctrl(cipher, EVP_CTRL_GCM_SET_TAG,
+                                     SS_HYBRID_TAG_SIZE, tag) != 1) {
+        return false;
+    }
+    if (EVP_CipherFinal_ex(cipher, &data[length], &out) != 1) {
+        return false;  // On opening: the tag did not match
+    }
+    return !seal || EVP_CIPHER_CTX_ctrl(cipher, EVP_CTRL_GCM_GET_TAG,
+                                        SS_HYBRID_TAG_SIZE, tag) == 1;
+}
+
+/**
+ * Starts an AES-256-GCM context for the session key; the nonce and direction
+ * are set per record.
+ */
+static EVP_CIPHER_CTX *start_cipher(const uint8_t *key, bool seal) {
+    EVP_CIPHER_CTX *cipher = EVP_CIPHER_CTX_new();
+    if (cipher == NULL) {
+        return NULL;
+    }
+    if (EVP_CipherInit_ex(cipher, EVP_aes_256_gcm(), NULL, NULL, NULL,
+                          seal ? 1 : 0) != 1 ||
+        EVP_CIPHER_CTX_ctrl(cipher, EVP_CTRL_GCM_SET_IVLEN,
+                            SS_HYBRID_NONCE_SIZE, NULL) != 1 ||
+        EVP_CipherInit_ex(cipher, NULL, NULL, key, NULL, seal ? 1 : 0) != 1) {
+        EVP_CIPHER_CTX_free(cipher);
+        return NULL;
+    }
+    return cipher;
+}
+
+// One recipient of a hybrid encryption: its own session key and preamble
+typedef struct {
+    uint8_t key[SS_HYBRID_KEY_SIZE];
+    uint8_t *preamble;            // header, wrapped session key, base nonce
+    size_t preamble_size;
+    uint8_t digest[DIGEST_SIZE];  // SHA-256 of the preamble
+    EVP_CIPHER_CTX *cipher;
+} sender_t;
+
+/**
+ * Draws a fresh session key and base nonce for one recipient, wraps the key
+ * with SS and writes the preamble.
+ */
+static bool start_sender(sender_t *sender, ss_encrypt_ctx_t *ctx,
+                         FILE *outfile) {
+    size_t chunk = ctx->block_size - 1;
+    size_t wrapped = (SS_HYBRID_KEY_SIZE + chunk - 1) / chunk;
+    sender->preamble_size = SS_CONTAINER_HEADER_SIZE +
+                            wrapped * ctx->cipher_width + SS_HYBRID_NONCE_SIZE;
+    sender->preamble = (uint8_t *)malloc(sender->preamble_size);
+    if (sender->preamble == NULL) {
+        return false;
+    }
+    uint8_t *nonce =
+        &sender->preamble[sender->preamble_size - SS_HYBRID_NONCE_SIZE];
+    if (RAND_bytes(sender->key, sizeof(sender->key)) != 1 ||
+        RAND_bytes(nonce, SS_HYBRID_NONCE_SIZE) != 1 ||
+        (sender->cipher = start_cipher(sender->key, true)) == NULL) {
+        return false;
+    }
+
+    ss_container_header_t header = {
+        SS_CONTAINER_VERSION_HYBRID,
+        (uint32_t)mpz_sizeinbase(ctx->modulus_n, 2),
+        (uint32_t)ctx->block_size, wrapped
+    };
+    ss_container_encode_header(sender->preamble, &header);
+    ss_encrypt_ctx_blocks(ctx, sender->key, sizeof(sender->key),
+                          &sender->preamble[SS_CONTAINER_HEADER_SIZE]);
+    ss_encrypt_ctx_wipe(ctx);
+    stats_add(STATS_BYTES_OUT, sender->preamble_size);
+    return EVP_Digest(sender->preamble, sender->preamble_size,
+                      sender->digest, NULL, EVP_sha256(), NULL) == 1 &&
+           fwrite(sender->preamble, 1, sender->preamble_size, outfile) ==
+               sender->preamble_size;
+}
+
+// Seals one record of plaintext for a recipient and writes it
+static bool seal_record(sender_t *sender, uint64_t index, const uint8_t *data,
+                        size_t length, bool final, uint8_t *record,
+                        FILE *outfile) {
+    const uint8_t *nonce =
+        &sender->preamble[sender->preamble_size - SS_HYBRID_NONCE_SIZE];
+    uint32_t word = (uint32_t)length | (final ? SS_HYBRID_FINAL : 0);
+    ss_container_put_be32(record, word);
+    size_t size = LENGTH_SIZE + length + SS_HYBRID_TAG_SIZE;
+    stats_add(STATS_BYTES_OUT, size);
+    return crypt_record(sender->cipher, true, nonce, index, sender->digest,
+                        word, data, &record[LENGTH_SIZE], length,
+                        &record[LENGTH_SIZE + length]) &&
+           fwrite(record, 1, size, outfile) == size;
+}
+
+static void finish_sender(sender_t *sender) {
+    OPENSSL_cleanse(sender->key, sizeof(sender->key));
+    EVP_CIPHER_CTX_free(sender->cipher);
+    free(sender->preamble);
+}
+
+// Reads the next record of plaintext; a full record is only final if
+// nothing follows it
+static size_t read_record(FILE *infile, uint8_t *data, bool *final) {
+    uint64_t start = stats_now();
+    size_t length = fread(data, 1, SS_HYBRID_RECORD_SIZE, infile);
+    if (length < SS_HYBRID_RECORD_SIZE) {
+        *final = true;
+    } else {
+        int next = getc(infile);
+        *final = next == EOF;
+        if (!*final) {
+            ungetc(next, infile);
+        }
+    }
+    stats_add_since(STATS_IO_NS, start);
+    stats_add(STATS_BYTES_IN, length);
+    return length;
+}
+
+bool ss_hybrid_encrypt_file(ss_encrypt_ctx_t *ctx, FILE *infile,
+                            FILE *outfile) {
+    return ss_hybrid_encrypt_files(&ctx, 1, infile, &outfile);
+}
+
+bool ss_hybrid_encrypt_files(ss_encrypt_ctx_t *const *contexts, size_t count,
+                             FILE *infile, FILE *const *outfiles) {
+    sender_t *senders = (sender_t *)calloc(count, sizeof(sender_t));
+    uint8_t *data = (uint8_t *)malloc(SS_HYBRID_RECORD_SIZE);
+    uint8_t *record = (uint8_t *)malloc(LENGTH_SIZE + SS_HYBRID_RECORD_SIZE +
+                                        SS_HYBRID_TAG_SIZE);
+    bool ok = senders != NULL && data != NULL && record != NULL;
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = start_sender(&senders[i], contexts[i], outfiles[i]);
+    }
+
+    // Each record is read once and sealed for every recipient in turn
+    bool final = false;
+    for (uint64_t index = 0; ok && !final; index++) {
+        size_t length = read_record(infile, data, &final);
+        for (size_t i = 0; ok && i < count; i++) {
+            ok = seal_record(&senders[i], index, data, length, final, record,
+                             outfiles[i]);
+        }
+    }
+
+    for (size_t i = 0; senders != NULL && i < count; i++) {
+        finish_sender(&senders[i]);
+    }
+    free(senders);
+    free(data);
+    free(record);
+    return ok;
+}
+
+/**
+ * Moves past the records before *index, stopping at the final record instead
+ * if the plaintext ends before *index, which then becomes that record's
+ * index. A regular file is located from its size, since every record but
+ * the last is full; a stream is read record by record, and when it stops
+ * early the final record's length word, already consumed, is left in word.
+ *
+ * Returns:
+ *   true if a record at *index can be read next, false if the records are
+ * malformed or end without a final one.
+ */
+static bool seek_record(FILE *infile, uint64_t *index, uint8_t *word,
+                        bool *have_word) {
+    uint64_t record_size = LENGTH_SIZE + SS_HYBRID_RECORD_SIZE +
+                           SS_HYBRID_TAG_SIZE;
+    *have_word = false;
+    struct stat st;
+    off_t position = ftello(infile);
+    if (position >= 0 && fstat(fileno(infile), &st) == 0 &&
+        S_ISREG(st.st_mode)) {
+        if (st.st_size <= position) {
+            return false;
+        }
+        uint64_t last = ((uint64_t)(st.st_size - position) - 1) / record_size;
+        if (*index > last) {
+            *index = last;
+        }
+        return ss_container_skip(infile, *index * record_size);
+    }
+    for (uint64_t i = 0; i < *index; i++) {
+        if (fread(word, 1, LENGTH_SIZE, infile) != LENGTH_SIZE) {
+            return false;
+        }
+        if ((ss_container_get_be32(word) & SS_HYBRID_FINAL) != 0) {
+            *index = i;
+            *have_word = true;
+            return true;
+        }
+        if (ss_container_get_be32(word) != SS_HYBRID_RECORD_SIZE ||
+            !ss_container_skip(infile,
+                               SS_HYBRID_RECORD_SIZE + SS_HYBRID_TAG_SIZE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ss_hybrid_decrypt_file(ss_decrypt_ctx_t *ctx,
+                            const ss_container_header_t *header,
+                            FILE *infile, FILE *outfile, uint64_t offset,
+                            uint64_t length) {
+    size_t width = ss_container_block_width(header->modulus_bits);
+    size_t plain_width = ctx->plain_width;
+    if (header->block_count == 0 ||
+        header->block_count > SS_HYBRID_KEY_SIZE) {
+        return false;  // Every wrapped block carries at least one key byte
+    }
+    size_t wrapped = (size_t)header->block_count;
+    size_t preamble_size =
+        SS_CONTAINER_HEADER_SIZE + wrapped * width + SS_HYBRID_NONCE_SIZE;
+    uint8_t *preamble = (uint8_t *)malloc(preamble_size);
+    uint8_t *key = (uint8_t *)malloc(wrapped * (plain_width - 1));
+    uint8_t *record = (uint8_t *)malloc(SS_HYBRID_RECORD_SIZE +
+                                        SS_HYBRID_TAG_SIZE);
+    EVP_CIPHER_CTX *cipher = NULL;
+    uint8_t digest[DIGEST_SIZE];
+
+    // Unwrap the session key; under the wrong private key the blocks do not
+    // decode, and a forged key would fail the first tag anyway
+    bool ok = preamble != NULL && key != NULL && record != NULL;
+    if (ok) {
+        ss_container_encode_header(preamble, header);
+        size_t rest = preamble_size - SS_CONTAINER_HEADER_SIZE;
+        ok = fread(&preamble[SS_CONTAINER_HEADER_SIZE], 1, rest, infile) ==
+             rest;
+        stats_add(STATS_BYTES_IN, preamble_size);
+    }
+    if (ok) {
+        size_t key_length = ss_decrypt_ctx_blocks(
+            ctx, &preamble[SS_CONTAINER_HEADER_SIZE], wrapped, width, key);
+        ok = key_length == SS_HYBRID_KEY_SIZE &&
+             EVP_Digest(preamble, preamble_size, digest, NULL, EVP_sha256(),
+                        NULL) == 1 &&
+             (cipher = start_cipher(key, false)) != NULL;
+    }
+    const uint8_t *nonce = &preamble[preamble_size - SS_HYBRID_NONCE_SIZE];
+
+    // Every record but the last is full, so records before the range are
+    // skipped without being decrypted; each record's nonce depends only on
+    // its index, so decryption can start anywhere. A range past the end
+    // starts at the final record, which is still checked, and writes nothing.
+    uint64_t index = offset / SS_HYBRID_RECORD_SIZE;
+    uint64_t wanted_index = index;
+    uint8_t word_bytes[LENGTH_SIZE];
+    bool have_word = false;
+    uint64_t limit = length;
+    ok = ok && (limit == 0 ||
+                seek_record(infile, &index, word_bytes, &have_word));
+    uint64_t skip = index < wanted_index
+                        ? UINT64_MAX
+                        : offset - index * SS_HYBRID_RECORD_SIZE;
+
+    bool final = false;
+    for (; ok && !final && limit > 0; index++) {
+        uint64_t start = stats_now();
+        ok = have_word ||
+             fread(word_bytes, 1, LENGTH_SIZE, infile) == LENGTH_SIZE;
+        have_word = false;
+        uint32_t word = ok ? ss_container_get_be32(word_bytes) : 0;
+        size_t size = word & ~SS_HYBRID_FINAL;
+        final = (word & SS_HYBRID_FINAL) != 0;
+        ok = ok && size <= SS_HYBRID_RECORD_SIZE &&
+             (final || size == SS_HYBRID_RECORD_SIZE) &&
+             fread(record, 1, size + SS_HYBRID_TAG_SIZE, infile) ==
+                 size + SS_HYBRID_TAG_SIZE;
+        stats_add_since(STATS_IO_NS, start);
+        stats_add(STATS_BYTES_IN, LENGTH_SIZE + size + SS_HYBRID_TAG_SIZE);
+
+        // Nothing reaches the output before its tag has been checked
+        ok = ok && crypt_record(cipher, false, nonce, index, digest, word,
+                                record, record, size, &record[size]);
+        size_t drop = skip < size ? (size_t)skip : size;
+        skip -= drop;
+        size_t wanted = size - drop < limit ? size - drop : (size_t)limit;
+        limit -= wanted;
+        ok = ok && fwrite(&record[drop], 1, wanted, outfile) == wanted;
+        stats_add(STATS_BYTES_OUT, ok ? wanted : 0);
+    }
+    // Anything after the final record was not written by us
+    ok = ok && (!final || getc(infile) == EOF);
+
+    if (key != NULL) {
+        OPENSSL_cleanse(key, wrapped * (plain_width - 1));
+    }
+    ss_decrypt_ctx_wipe(ctx);
+    EVP_CIPHER_CTX_free(cipher);
+    free(preamble);
+    free(key);
+    free(record);
+    return ok;
+}
@@ -0,0 +1,88 @@
+#ifndef SS_HYBRID_H
+#define SS_HYBRID_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "container.h"
+#include "ss.h"
+
+// Hybrid containers (SS_FORMAT_HYBRID) carry a random AES-256-GCM session
+// key wrapped with SS, then the payload encrypted under that key:
+//
+//   container header, version SS_CONTAINER_VERSION_HYBRID, with block_count
+//       the number of SS blocks holding the wrapped key
+//   block_count fixed-width SS ciphertext slots (the session key)
+//   SS_HYBRID_NONCE_SIZE bytes of base nonce
+//   records: a 32-bit big-endian word (SS_HYBRID_FINAL | plaintext length),
+//       the ciphertext, then an SS_HYBRID_TAG_SIZE byte tag
+//
+// Record i uses the base nonce with i XORed into its last 8 bytes, and
+// authenticates the SHA-256 of everything before the first record plus its
+// own length word, so records cannot be reordered, truncated, moved to
+// another container or have their final flag stripped.
+#define SS_HYBRID_KEY_SIZE    32
+#define SS_HYBRID_NONCE_SIZE  12
+#define SS_HYBRID_TAG_SIZE    16
+#define SS_HYBRID_RECORD_SIZE (1u << 16)  // plaintext bytes per record
+#define SS_HYBRID_FINAL       0x80000000u // set on the last record
+
+/**
+ * Encrypts a file into a hybrid container: one SS encryption of a fresh
+ * session key, then AES-256-GCM over the payload in SS_HYBRID_RECORD_SIZE
+ * records.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): An encryption context for the public key.
+ *   infile (FILE*): The file containing the plaintext.
+ *   outfile (FILE*): The file to write the container to.
+ *
+ * Returns:
+ *   true on success, false if no session key could be generated or the
+ * cipher failed.
+ */
+bool ss_hybrid_encrypt_file(ss_encrypt_ctx_t *ctx, FILE *infile, FILE *outfile);
+
+/**
+ * Encrypts a file into one hybrid container per recipient, reading the
+ * plaintext once. Every recipient gets its own session key and base nonce,
+ * so no two containers share a GCM key stream.
+ *
+ * Args:
+ *   contexts (ss_encrypt_ctx_t* const*): An encryption context per recipient.
+ *   count (size_t): The number of recipients.
+ *   infile (FILE*): The file containing the plaintext.
+ *   outfiles (FILE* const*): The file to write each recipient's container to.
+ *
+ * Returns:
+ *   true on success, false if no session key could be generated, the cipher
+ * failed or a container could not be written.
+ */
+bool ss_hybrid_encrypt_files(ss_encrypt_ctx_t *const *contexts, size_t count, FILE *infile, FILE *const *outfiles);
+
+/**
+ * Decrypts the plaintext bytes [offset, offset + length) of a hybrid
+ * container whose header has already been read. Only the records covering
+ * the range are read, and each record's plaintext is written only after its
+ * tag checks out. If the range stops before the final record, the rest of
+ * the container is not checked. A range that starts at or past the end of
+ * the plaintext writes nothing and succeeds, as it does for the other
+ * formats; the final record is still read and its tag checked.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): A decryption context for the private key.
+ *   header (const ss_container_header_t*): The container header.
+ *   infile (FILE*): The file positioned just after the header.
+ *   outfile (FILE*): The file to write the plaintext to.
+ *   offset (uint64_t): The first plaintext byte to write.
+ *   length (uint64_t): The number of bytes to write (UINT64_MAX for all).
+ *
+ * Returns:
+ *   true on success, false if the container is malformed, truncated,
+ * tampered with or was made for another key.
+ */
+bool ss_hybrid_decrypt_file(ss_decrypt_ctx_t *ctx, const ss_container_header_t *header, FILE *infile, FILE *outfile, uint64_t offset, uint64_t length);
+
+#endif
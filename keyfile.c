@@ -0,0 +1,435 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "container.h"
+#include "keyfile.h"
+#include "ss.h"
+
+// Bytes read at a time from streams whose size is unknown (pipes)
+#define READ_CHUNK (1 << 12)
+
+// A bounds-checked position within a record held in memory
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+} cursor_t;
+
+// A public key record located in memory, not yet imported
+typedef struct {
+    uint32_t block_size;
+    const uint8_t *username;
+    size_t username_length;
+    const uint8_t *modulus;
+    size_t modulus_length;
+} pub_record_t;
+
+static void put_be16(uint8_t *out, uint16_t value) {
+    out[0] = (uint8_t)(value >> 8);
+    out[1] = (uint8_t)value;
+}
+
+static void put_header(uint8_t *out, uint8_t kind) {
+    memcpy(out, SS_KEYFILE_MAGIC, SS_KEYFILE_MAGIC_SIZE);
+    out[4] = SS_KEYFILE_VERSION;
+    out[5] = kind;
+    out[6] = 0;
+    out[7] = 0;
+}
+
+static size_t field_size(const mpz_t value) {
+    return 4 + (mpz_sgn(value) == 0 ? 0 : mpz_sizeinbase(value, 256));
+}
+
+static uint8_t *put_field(uint8_t *out, const mpz_t value) {
+    size_t count = 0;
+    mpz_export(&out[4], &count, 1, 1, 1, 0, value);
+    ss_container_put_be32(out, (uint32_t)count);
+    return &out[4 + count];
+}
+
+static uint32_t block_size_of(const mpz_t modulus) {
+    ss_key_meta_t meta;
+    ss_key_meta_init(&meta, modulus);
+    return (uint32_t)meta.block_size;
+}
+
+static size_t pub_record_size(const mpz_t modulus_n, size_t username_length) {
+    return 4 + 2 + username_length + field_size(modulus_n);
+}
+
+static uint8_t *put_pub_record(uint8_t *out, const mpz_t modulus_n,
+                               const char *username, size_t username_length) {
+    ss_container_put_be32(out, block_size_of(modulus_n));
+    put_be16(&out[4], (uint16_t)username_length);
+    memcpy(&out[6], username, username_length);
+    return put_field(&out[6 + username_length], modulus_n);
+}
+
+// Builds the header (if header_kind is nonzero) and one public key record
+static uint8_t *encode_pub(const mpz_t modulus_n, const char *username,
+                           uint8_t header_kind, size_t *size) {
+    if (username == NULL) {
+        username = "";
+    }
+    size_t username_length = strlen(username);
+    if (username_length > UINT16_MAX) {
+        return NULL;
+    }
+    size_t header = header_kind != 0 ? SS_KEYFILE_HEADER_SIZE : 0;
+    *size = header + pub_record_size(modulus_n, username_length);
+    uint8_t *raw = (uint8_t *)malloc(*size);
+    if (raw == NULL) {
+        return NULL;
+    }
+    if (header_kind != 0) {
+        put_header(raw, header_kind);
+    }
+    put_pub_record(&raw[header], modulus_n, username, username_length);
+    return raw;
+}
+
+static bool take(cursor_t *cursor, size_t bytes, const uint8_t **out) {
+    if (bytes > cursor->size - cursor->offset) {
+        return false;
+    }
+    *out = &cursor->data[cursor->offset];
+    cursor->offset += bytes;
+    return true;
+}
+
+static bool take_field(cursor_t *cursor, const uint8_t **bytes,
+                       size_t *length) {
+    const uint8_t *raw;
+    if (!take(cursor, 4, &raw)) {
+        return false;
+    }
+    *length = ss_container_get_be32(raw);
+    return take(cursor, *length, bytes);
+}
+
+static bool take_import(cursor_t *cursor, mpz_t value) {
+    const uint8_t *bytes;
+    size_t length;
+    if (!take_field(cursor, &bytes, &length)) {
+        return false;
+    }
+    mpz_import(value, length, 1, 1, 1, 0, bytes);
+    return true;
+}
+
+static bool take_pub_record(cursor_t *cursor, pub_record_t *record) {
+    const uint8_t *raw;
+    if (!take(cursor, 6, &raw)) {
+        return false;
+    }
+    record->block_size = ss_container_get_be32(raw);
+    record->username_length = ((size_t)raw[4] << 8) | raw[5];
+    return take(cursor, record->username_length, &record->username) &&
+           memchr(record->username, 0, record->username_length) == NULL &&
+           take_field(cursor, &record->modulus, &record->modulus_length) &&
+           record->modulus_length != 0;
+}
+
+static bool load_pub_record(const pub_record_t *record, mpz_t modulus_n,
+                            char *username, size_t username_size) {
+    if (username != NULL) {
+        if (record->username_length >= username_size) {
+            return false;
+        }
+        memcpy(username, record->username, record->username_length);
+        username[record->username_length] = '\0';
+    }
+    mpz_import(modulus_n, record->modulus_length, 1, 1, 1, 0,
+               record->modulus);
+    return mpz_sgn(modulus_n) != 0 &&
+           block_size_of(modulus_n) == record->block_size;
+}
+
+// Checks the header bytes that follow the magic and returns the kind, or 0
+static uint8_t take_header(cursor_t *cursor) {
+    const uint8_t *raw;
+    size_t rest = SS_KEYFILE_HEADER_SIZE - SS_KEYFILE_MAGIC_SIZE;
+    if (!take(cursor, rest, &raw) || raw[0] != SS_KEYFILE_VERSION) {
+        return 0;
+    }
+    return raw[1];
+}
+
+// Reads a stream to its end with as few reads as its size allows
+static uint8_t *read_rest(FILE *infile, size_t *size) {
+    struct stat st;
+    off_t position = ftello(infile);
+    size_t capacity = READ_CHUNK;
+    if (fstat(fileno(infile), &st) == 0 && S_ISREG(st.st_mode) &&
+        position >= 0 && st.st_size > position) {
+        // One byte over, so a single fread also sees end of file
+        capacity = (size_t)(st.st_size - position) + 1;
+    }
+    uint8_t *data = (uint8_t *)malloc(capacity);
+    *size = 0;
+    while (data != NULL) {
+        *size += fread(&data[*size], 1, capacity - *size, infile);
+        if (*size < capacity) {
+            if (ferror(infile)) {
+                free(data);
+                return NULL;
+            }
+            return data;
+        }
+        capacity *= 2;
+        uint8_t *grown = (uint8_t *)realloc(data, capacity);
+        if (grown == NULL) {
+            free(data);
+        }
+        data = grown;
+    }
+    return NULL;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+bool ss_keyfile_write_pub(const mpz_t modulus_n, const char *username,
+                          FILE *pbfile) {
+    size_t size;
+    uint8_t *raw = encode_pub(modulus_n, username, SS_KEYFILE_PUBLIC, &size);
+    if (raw == NULL) {
+        return false;
+    }
+    bool written = fwrite(raw, 1, size, pbfile) == size;
+    free(raw);
+    return written;
+}
+
+bool ss_keyfile_write_priv(const ss_priv_key_t *key, FILE *pvfile) {
+    size_t size = SS_KEYFILE_HEADER_SIZE + 4 + 1 +
+                  field_size(key->modulus_pq) + field_size(key->private_key_d);
+    if (key->has_crt) {
+        size += field_size(key->prime_p) + field_size(key->prime_q) +
+                field_size(key->d_mod_p1) + field_size(key->d_mod_q1) +
+                field_size(key->q_inv_p);
+    }
+    uint8_t *raw = (uint8_t *)malloc(size);
+    if (raw == NULL) {
+        return false;
+    }
+    put_header(raw, SS_KEYFILE_PRIVATE);
+    uint8_t *out = &raw[SS_KEYFILE_HEADER_SIZE];
+    ss_container_put_be32(out, block_size_of(key->modulus_pq));
+    out[4] = key->has_crt ? SS_KEYFILE_CRT : 0;
+    out = put_field(&out[5], key->modulus_pq);
+    out = put_field(out, key->private_key_d);
+    if (key->has_crt) {
+        out = put_field(out, key->prime_p);
+        out = put_field(out, key->prime_q);
+        out = put_field(out, key->d_mod_p1);
+        out = put_field(out, key->d_mod_q1);
+        put_field(out, key->q_inv_p);
+    }
+    bool written = fwrite(raw, 1, size, pvfile) == size;
+    // The buffer held the private exponent
+    memset(raw, 0, size);
+    free(raw);
+    return written;
+}
+
+bool ss_keyfile_detect(FILE *infile) {
+    // Only one byte of pushback is portable, so decide on the first byte
+    int first = getc(infile);
+    if (first == EOF) {
+        return false;
+    }
+    if (first != SS_KEYFILE_MAGIC[0]) {
+        ungetc(first, infile);
+        return false;
+    }
+    char rest[SS_KEYFILE_MAGIC_SIZE - 1];
+    return fread(rest, 1, sizeof(rest), infile) == sizeof(rest) &&
+           memcmp(rest, &SS_KEYFILE_MAGIC[1], sizeof(rest)) == 0;
+}
+
+bool ss_keyfile_read_pub(mpz_t modulus_n, char *username, size_t username_size,
+                         FILE *pbfile) {
+    // The magic was consumed by ss_keyfile_detect
+    cursor_t cursor = { 0 };
+    uint8_t *data = read_rest(pbfile, &cursor.size);
+    if (data == NULL) {
+        return false;
+    }
+    cursor.data = data;
+    uint8_t kind = take_header(&cursor);
+    pub_record_t record;
+    bool valid = (kind == SS_KEYFILE_PUBLIC || kind == SS_KEYFILE_KEYRING) &&
+                 take_pub_record(&cursor, &record) &&
+                 (kind == SS_KEYFILE_KEYRING || cursor.offset == cursor.size) &&
+                 load_pub_record(&record, modulus_n, username, username_size);
+    free(data);
+    return valid;
+}
+
+bool ss_keyfile_read_priv(ss_priv_key_t *key, FILE *pvfile) {
+    // The magic was consumed by ss_keyfile_detect
+    cursor_t cursor = { 0 };
+    uint8_t *data = read_rest(pvfile, &cursor.size);
+    if (data == NULL) {
+        return false;
+    }
+    cursor.data = data;
+    const uint8_t *raw = NULL;
+    bool valid = take_header(&cursor) == SS_KEYFILE_PRIVATE &&
+                 take(&cursor, 5, &raw) &&
+                 take_import(&cursor, key->modulus_pq) &&
+                 take_import(&cursor, key->private_key_d);
+    key->has_crt = valid && (raw[4] & SS_KEYFILE_CRT) != 0;
+    if (key->has_crt) {
+        valid = take_import(&cursor, key->prime_p) &&
+                take_import(&cursor, key->prime_q) &&
+                take_import(&cursor, key->d_mod_p1) &&
+                take_import(&cursor, key->d_mod_q1) &&
+                take_import(&cursor, key->q_inv_p);
+    }
+    valid = valid && cursor.offset == cursor.size &&
+            mpz_sgn(key->modulus_pq) != 0 &&
+            block_size_of(key->modulus_pq) == ss_container_get_be32(raw);
+    if (valid) {
+        ss_key_meta_init(&key->meta, key->modulus_pq);
+    } else {
+        key->has_crt = false;
+    }
+    memset(data, 0, cursor.size);
+    free(data);
+    return valid;
+}
+
+bool ss_keyring_open(ss_keyring_t *ring, const char *path) {
+    memset(ring, 0, sizeof(*ring));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < SS_KEYFILE_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    ring->data = (const uint8_t *)data;
+    ring->size = (size_t)st.st_size;
+
+    // Index every record; validating them all now keeps lookups bounds-safe
+    cursor_t cursor = { ring->data, ring->size, SS_KEYFILE_MAGIC_SIZE };
+    bool ok = memcmp(ring->data, SS_KEYFILE_MAGIC, SS_KEYFILE_MAGIC_SIZE) ==
+                  0 &&
+              take_header(&cursor) == SS_KEYFILE_KEYRING;
+    size_t capacity = 0;
+    while (ok && cursor.offset < cursor.size) {
+        if (ring->count == capacity) {
+            capacity = capacity == 0 ? 64 : 2 * capacity;
+            size_t *offsets =
+                (size_t *)realloc(ring->offsets, capacity * sizeof(size_t));
+            if (offsets == NULL) {
+                ok = false;
+                break;
+            }
+            ring->offsets = offsets;
+        }
+        ring->offsets[ring->count] = cursor.offset;
+        pub_record_t record;
+        ok = take_pub_record(&cursor, &record);
+        ring->count++;
+    }
+    if (!ok) {
+        ss_keyring_close(ring);
+    }
+    return ok;
+}
+
+void ss_keyring_close(ss_keyring_t *ring) {
+    if (ring->data != NULL) {
+        munmap((void *)ring->data, ring->size);
+    }
+    free(ring->offsets);
+    memset(ring, 0, sizeof(*ring));
+}
+
+bool ss_keyring_get(const ss_keyring_t *ring, size_t index, mpz_t modulus_n,
+                    char *username, size_t username_size) {
+    if (index >= ring->count) {
+        return false;
+    }
+    cursor_t cursor = { ring->data, ring->size, ring->offsets[index] };
+    pub_record_t record;
+    return take_pub_record(&cursor, &record) &&
+           load_pub_record(&record, modulus_n, username, username_size);
+}
+
+ptrdiff_t ss_keyring_find(const ss_keyring_t *ring, const char *username) {
+    size_t length = strlen(username);
+    for (size_t i = 0; i < ring->count; i++) {
+        cursor_t cursor = { ring->data, ring->size, ring->offsets[i] };
+        pub_record_t record;
+        if (take_pub_record(&cursor, &record) &&
+            record.username_length == length &&
+            memcmp(record.username, username, length) == 0) {
+            return (ptrdiff_t)i;
+        }
+    }
+    return -1;
+}
+
+bool ss_keyring_append(const char *path, const mpz_t modulus_n,
+                       const char *username) {
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // A new keyring gets its header in the same write as its first key
+    struct stat st;
+    uint8_t header[SS_KEYFILE_HEADER_SIZE];
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size != 0) {
+        cursor_t cursor = { header, sizeof(header), SS_KEYFILE_MAGIC_SIZE };
+        ok = pread(fd, header, sizeof(header), 0) == sizeof(header) &&
+             memcmp(header, SS_KEYFILE_MAGIC, SS_KEYFILE_MAGIC_SIZE) == 0 &&
+             take_header(&cursor) == SS_KEYFILE_KEYRING;
+    }
+    size_t size = 0;
+    uint8_t *raw = NULL;
+    if (ok) {
+        raw = encode_pub(modulus_n, username,
+                         st.st_size == 0 ? SS_KEYFILE_KEYRING : 0, &size);
+        ok = raw != NULL && write_all(fd, raw, size) && fdatasync(fd) == 0;
+    }
+    free(raw);
+    flock(fd, LOCK_UN);
+    return close(fd) == 0 && ok;
+}
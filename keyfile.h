@@ -0,0 +1,184 @@
+#ifndef SS_KEYFILE_H
+#define SS_KEYFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <gmp.h>
+
+#include "ss.h"
+
+// Leading bytes of a binary key file or keyring. Hex key files never start
+// with 'S', which lets ss_read_pub_key and ss_read_priv_key tell them apart.
+#define SS_KEYFILE_MAGIC "SSKB"
+#define SS_KEYFILE_MAGIC_SIZE 4
+
+#define SS_KEYFILE_VERSION 1
+
+// Magic, version, kind, 2 reserved bytes
+#define SS_KEYFILE_HEADER_SIZE 8
+
+// What a binary key file holds, stored in the byte after the version
+#define SS_KEYFILE_PUBLIC  1 // one public key record
+#define SS_KEYFILE_PRIVATE 2 // one private key record
+#define SS_KEYFILE_KEYRING 3 // public key records back to back until end of file
+
+// Private key flag: p, q and the CRT values follow pq and d
+#define SS_KEYFILE_CRT 0x01
+
+// Binary key records follow the header. All fields are big-endian, and
+// every integer is a 32-bit byte count followed by its magnitude, so a key
+// loads with one read and one mpz_import per integer:
+//
+//   public:  32-bit block size, 16-bit username length, username, n
+//   private: 32-bit block size, 8-bit flags, pq, d, then p, q,
+//            d mod (p-1), d mod (q-1) and q^-1 mod p if SS_KEYFILE_CRT is set
+//
+// The block size is stored so readers can reject a record whose modulus was
+// damaged without dividing anything.
+
+/**
+ * A keyring mapped read-only, with the offset of every public key record
+ * indexed by ss_keyring_open. Looking a key up never reads the file again.
+ */
+typedef struct {
+    const uint8_t *data; // the mapped file
+    size_t size;
+    size_t *offsets;     // start of each record
+    size_t count;
+} ss_keyring_t;
+
+/**
+ * Writes a public key as a binary key file.
+ *
+ * Args:
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   username (const char*): The associated username, NULL for none.
+ *   pbfile (FILE*): The file to write to.
+ *
+ * Returns:
+ *   true on success, false if the username is too long or the write failed.
+ */
+bool ss_keyfile_write_pub(const mpz_t modulus_n, const char *username, FILE *pbfile);
+
+/**
+ * Writes a private key as a binary key file, with its CRT values if it has
+ * them.
+ *
+ * Args:
+ *   key (const ss_priv_key_t*): The private key.
+ *   pvfile (FILE*): The file to write to.
+ *
+ * Returns:
+ *   true on success, false if the write failed.
+ */
+bool ss_keyfile_write_priv(const ss_priv_key_t *key, FILE *pvfile);
+
+/**
+ * Checks whether a stream starts with the key file magic. If it does, the
+ * magic is consumed; otherwise the stream is left where it was so it can be
+ * read as hex.
+ *
+ * Args:
+ *   infile (FILE*): The file to inspect.
+ *
+ * Returns:
+ *   true if the stream holds a binary key file, false otherwise.
+ */
+bool ss_keyfile_detect(FILE *infile);
+
+/**
+ * Reads the rest of a binary public key file after ss_keyfile_detect. A
+ * keyring is accepted too and yields its first key.
+ *
+ * Args:
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   username (char*): The associated username, NUL-terminated (output).
+ *   username_size (size_t): The size of the username buffer.
+ *   pbfile (FILE*): The file to read from.
+ *
+ * Returns:
+ *   true if a valid key was read, false if the file is malformed or the
+ *   username does not fit.
+ */
+bool ss_keyfile_read_pub(mpz_t modulus_n, char *username, size_t username_size, FILE *pbfile);
+
+/**
+ * Reads the rest of a binary private key file after ss_keyfile_detect.
+ *
+ * Args:
+ *   key (ss_priv_key_t*): The initialized key to read into (output).
+ *   pvfile (FILE*): The file to read from.
+ *
+ * Returns:
+ *   true if a valid key was read, false if the file is malformed.
+ */
+bool ss_keyfile_read_priv(ss_priv_key_t *key, FILE *pvfile);
+
+/**
+ * Maps a keyring and indexes its records. Every record is bounds-checked
+ * here, so later lookups cannot run off the mapping.
+ *
+ * Args:
+ *   ring (ss_keyring_t*): The keyring to open (output).
+ *   path (const char*): The keyring file.
+ *
+ * Returns:
+ *   true on success, false if the file cannot be mapped or is malformed.
+ */
+bool ss_keyring_open(ss_keyring_t *ring, const char *path);
+
+/**
+ * Unmaps a keyring and frees its index.
+ *
+ * Args:
+ *   ring (ss_keyring_t*): The keyring to close.
+ */
+void ss_keyring_close(ss_keyring_t *ring);
+
+/**
+ * Loads one key of a keyring.
+ *
+ * Args:
+ *   ring (const ss_keyring_t*): The open keyring.
+ *   index (size_t): The key to load, below ring->count.
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   username (char*): The associated username, NUL-terminated, or NULL if not wanted (output).
+ *   username_size (size_t): The size of the username buffer.
+ *
+ * Returns:
+ *   true if the key was loaded, false if its block size does not match its
+ *   modulus or the username does not fit.
+ */
+bool ss_keyring_get(const ss_keyring_t *ring, size_t index, mpz_t modulus_n, char *username, size_t username_size);
+
+/**
+ * Finds the first key of a keyring with the given username, comparing names
+ * in the mapping without loading any modulus.
+ *
+ * Args:
+ *   ring (const ss_keyring_t*): The open keyring.
+ *   username (const char*): The username to look for.
+ *
+ * Returns:
+ *   The index of the key, or -1 if no key has that username.
+ */
+ptrdiff_t ss_keyring_find(const ss_keyring_t *ring, const char *username);
+
+/**
+ * Appends a public key to a keyring, creating the file (with its header) if
+ * it does not exist. The file is locked while appending, so concurrent
+ * keygens can share a keyring.
+ *
+ * Args:
+ *   path (const char*): The keyring file.
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   username (const char*): The associated username, NULL for none.
+ *
+ * Returns:
+ *   true on success, false if the file is not a keyring or the write failed.
+ */
+bool ss_keyring_append(const char *path, const mpz_t modulus_n, const char *username);
+
+#endif // SS_KEYFILE_H
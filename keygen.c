@@ -1,5 +1,7 @@
 #include <gmp.h>
+#include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,11 +10,14 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "keyfile.h"
 #include "numtheory.h"
+#include "pool.h"
 #include "randstate.h"
 #include "ss.h"
+#include "stats.h"
 
-#define OPTIONS "b:i:n:d:s:vh"
+#define OPTIONS "b:i:n:d:s:t:a:P:F:f:K:vh"
 
 /**
  * Opens a file with the specified mode and handles errors.
@@ -38,7 +43,7 @@ int main(int argc, char **argv) {
     // Default values for command-line options
     int option;
     uint32_t total_bits = 10;
-    uint32_t prime_test_iters = 50;
+    uint64_t prime_test_iters = 50;
     char *public_key_file = (char *)malloc(sizeof(char) * 100);
     char *private_key_file = (char *)malloc(sizeof(char) * 100);
 
@@ -46,7 +51,13 @@ int main(int argc, char **argv) {
     strcpy(private_key_file, "ss.priv");
 
     uint32_t random_seed = time(NULL);
-    bool verbose_mode = true;
+    bool verbose_mode = false;
+    size_t threads = 1;
+    pool_affinity_t affinity = POOL_AFFINITY_NONE;
+    const char *prime_pool_file = NULL;  // Search for every prime by default
+    size_t fill_depth = 0;               // Non-zero: fill the pool and exit
+    bool binary_keys = false;            // Hex key files by default
+    const char *keyring_file = NULL;     // Keyring to add the public key to
 
     // Parse command-line options
     while ((option = getopt(argc, argv, OPTIONS)) != -1) {
@@ -55,7 +66,15 @@ int main(int argc, char **argv) {
                 total_bits = (uint32_t)strtoul(optarg, NULL, 10);
                 break;
             case 'i':
-                prime_test_iters = (uint32_t)strtoul(optarg, NULL, 10);
+                // "bpsw" or "bpsw+N" selects Baillie-PSW plus N random rounds
+                if (strncmp(optarg, "bpsw", 4) == 0) {
+                    prime_test_iters = IS_PRIME_BPSW;
+                    if (optarg[4] == '+') {
+                        prime_test_iters |= strtoull(&optarg[5], NULL, 10);
+                    }
+                } else {
+                    prime_test_iters = (uint64_t)strtoull(optarg, NULL, 10);
+                }
                 break;
             case 'n':
                 strcpy(public_key_file, optarg);
@@ -66,6 +85,35 @@ int main(int argc, char **argv) {
             case 's':
                 random_seed = (uint32_t)strtoul(optarg, NULL, 10);
                 break;
+            case 't':
+                threads = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'a':
+                if (!pool_parse_affinity(optarg, &affinity)) {
+                    fprintf(stderr, "Invalid placement: %s\n", optarg);
+                    exit(1);
+                }
+                pool_set_affinity(affinity);
+                break;
+            case 'P':
+                prime_pool_file = optarg;
+                break;
+            case 'F':
+                fill_depth = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                if (strcmp(optarg, "hex") == 0) {
+                    binary_keys = false;
+                } else if (strcmp(optarg, "binary") == 0) {
+                    binary_keys = true;
+                } else {
+                    fprintf(stderr, "Invalid format: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'K':
+                keyring_file = optarg;
+                break;
             case 'v':
                 verbose_mode = true;
                 break;
@@ -75,16 +123,25 @@ int main(int argc, char **argv) {
                     "   Generates public and private keys for the S-S cryptosystem.\n"
                     "\n"
                     "USAGE\n"
-                    "   %s [-b:i:n:d:s:vh] [-b bits] [-i iters] [-n public_key_file] "
-                    "[-d private_key_file] [-s seed]\n"
+                    "   %s [-b:i:n:d:s:t:a:P:F:f:K:vh] [-b bits] [-i iters] [-n public_key_file] "
+                    "[-d private_key_file] [-s seed] [-t threads] [-a placement] [-P prime_pool] [-F depth] "
+                    "[-f format] [-K keyring]\n"
                     "\n"
                     "OPTIONS\n"
                     "   -b bits               Specify the number of bits for the public modulus (default: 10).\n"
-                    "   -i iterations         Number of Miller-Rabin primality test iterations (default: 50).\n"
+                    "   -i iterations         Number of Miller-Rabin primality test iterations (default: 50), or\n"
+                    "                         bpsw[+N] for the Baillie-PSW test plus N random rounds.\n"
                     "   -n public_key_file    Path to the public key file (default: ss.pub).\n"
                     "   -d private_key_file   Path to the private key file (default: ss.priv).\n"
                     "   -s seed               Random seed for initialization (default: UNIX time).\n"
-                    "   -v                    Enable verbose output.\n"
+                    "   -t threads            Number of threads to search for primes with (default: 1).\n"
+                    "   -a placement          Pins worker threads: none, cpu (one CPU each) or numa\n"
+                    "                         (spread over NUMA nodes) (default: none).\n"
+                    "   -P prime_pool         Draws p and q from a prime pool file, searching only on a miss.\n"
+                    "   -F depth              Fills the -P pool to depth primes per size for -b bits and exits.\n"
+                    "   -f format             Key file format, hex or binary (default: hex).\n"
+                    "   -K keyring            Also appends the public key to a binary keyring file.\n"
+                    "   -v                    Enable verbose output, with a JSON stats line on stderr.\n"
                     "   -h                    Display this help message.\n",
                     argv[0]);
                 exit(0);
@@ -94,26 +151,98 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (verbose_mode) {
+        stats_enable();
+    }
+
+    // Initialize random state
+    randstate_t rng;
+    randstate_init_r(&rng, random_seed);
+
+    // Fill mode stocks the pool for this key size instead of making a key
+    if (fill_depth > 0) {
+        if (prime_pool_file == NULL) {
+            fprintf(stderr, "Error: -F needs a prime pool file (-P)\n");
+            exit(1);
+        }
+        uint64_t min_bits, max_bits;
+        ss_make_pub_prime_range(total_bits, &min_bits, &max_bits);
+        ptrdiff_t added =
+            ss_prime_pool_fill(prime_pool_file, min_bits, max_bits, fill_depth,
+                               prime_test_iters, threads, &rng);
+        if (added < 0) {
+            fprintf(stderr, "Error: Cannot use prime pool %s\n",
+                    prime_pool_file);
+            exit(1);
+        }
+        if (verbose_mode) {
+            printf("Added %td primes of %" PRIu64 " to %" PRIu64 " bits\n",
+                   added, min_bits, max_bits);
+            stats_print(stderr, "keygen");
+        }
+        randstate_clear_r(&rng);
+        free(public_key_file);
+        free(private_key_file);
+        return 0;
+    }
+    ss_prime_pool_t prime_pool;
+    if (prime_pool_file != NULL &&
+        !ss_prime_pool_open(&prime_pool, prime_pool_file)) {
+        fprintf(stderr, "Error: Cannot use prime pool %s\n", prime_pool_file);
+        exit(1);
+    }
+
     // Open files for public and private keys
     FILE *public_key_fp = open_file(public_key_file, "w");
     FILE *private_key_fp = open_file(private_key_file, "w");
 
-    // Initialize random state
-    randstate_init(random_seed);
-
-    // Generate public key
+    // Generate public key, releasing the pool as soon as p and q are drawn
     mpz_t prime_p, prime_q, modulus_n;
-    ss_make_pub(prime_p, prime_q, modulus_n, total_bits, prime_test_iters);
+    ss_make_pub_pooled(prime_p, prime_q, modulus_n, total_bits,
+                       prime_test_iters, threads, &rng,
+                       prime_pool_file != NULL ? &prime_pool : NULL);
+    if (prime_pool_file != NULL) {
+        ss_prime_pool_close(&prime_pool);
+    }
     char *username = getenv("USER");
-    ss_write_pub(modulus_n, username, public_key_fp);
+    if (binary_keys) {
+        if (!ss_keyfile_write_pub(modulus_n, username, public_key_fp)) {
+            fprintf(stderr, "Error: Cannot write public key %s\n",
+                    public_key_file);
+            exit(1);
+        }
+    } else {
+        ss_write_pub(modulus_n, username, public_key_fp);
+    }
+    if (keyring_file != NULL &&
+        !ss_keyring_append(keyring_file, modulus_n, username)) {
+        fprintf(stderr, "Error: Cannot add the public key to keyring %s\n",
+                keyring_file);
+        exit(1);
+    }
 
     // Generate private key
     mpz_t private_key_d, modulus_pq;
     ss_make_priv(private_key_d, modulus_pq, prime_p, prime_q);
-    ss_write_priv(modulus_pq, private_key_d, private_key_fp);
+
+    // Store p, q and the CRT values alongside pq and d for fast decryption
+    ss_priv_key_t private_key;
+    ss_priv_key_init(&private_key);
+    ss_priv_key_set_crt(&private_key, modulus_pq, private_key_d, prime_p,
+                        prime_q);
+    if (binary_keys) {
+        if (!ss_keyfile_write_priv(&private_key, private_key_fp)) {
+            fprintf(stderr, "Error: Cannot write private key %s\n",
+                    private_key_file);
+            exit(1);
+        }
+    } else {
+        ss_write_priv_key(&private_key, private_key_fp);
+    }
+    ss_priv_key_clear(&private_key);
 
     // Clear random state
-    randstate_clear();
+    randstate_clear_r(&rng);
 
     if (verbose_mode) {
         printf("Username: %s\n", username);
@@ -127,6 +256,7 @@ int main(int argc, char **argv) {
                    mpz_sizeinbase(modulus_pq, 2), modulus_pq);
         gmp_printf("private_key_d (%u bits) = %Zd\n",
                    mpz_sizeinbase(private_key_d, 2), private_key_d);
+        stats_print(stderr, "keygen");
     }
 
     // Cleanup GMP variables and close files
@@ -0,0 +1,74 @@
+#include "mont_ifma.h"
+
+#include <stdlib.h>
+
+#if defined(__AVX512F__) && defined(__AVX512IFMA__)
+
+#include <immintrin.h>
+
+bool mont_ifma_available(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512ifma");
+}
+
+void mont_ifma_mul(size_t digits, uint64_t *r, const uint64_t *a,
+                   const uint64_t *b, const uint64_t *modulus,
+                   uint64_t inverse, uint64_t *scratch) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i mask =
+        _mm512_set1_epi64((long long)((1ULL << MONT_IFMA_DIGIT_BITS) - 1));
+    const __m512i k = _mm512_set1_epi64((long long)inverse);
+    __m512i *acc = (__m512i *)scratch;
+    for (size_t j = 0; j <= 2 * digits; j++) {
+        acc[j] = zero;
+    }
+
+    // Operand scanning: add a_i * b and q_i * m into acc[i ..], q_i chosen so
+    // that digit i becomes zero. The 52-bit products leave 12 bits of room in
+    // every word, so carries are only propagated once at the end.
+    for (size_t i = 0; i < digits; i++) {
+        __m512i ai = _mm512_load_si512(&a[i * MONT_IFMA_LANES]);
+        __m512i x = _mm512_madd52lo_epu64(acc[i], ai, _mm512_load_si512(b));
+        __m512i q = _mm512_madd52lo_epu64(zero, x, k);
+        __m512i m0 = _mm512_set1_epi64((long long)modulus[0]);
+        x = _mm512_madd52lo_epu64(x, q, m0);
+        __m512i high = _mm512_madd52hi_epu64(zero, ai, _mm512_load_si512(b));
+        high = _mm512_madd52hi_epu64(high, q, m0);
+        // Digit i is now zero; its carry moves up with the high halves
+        high = _mm512_add_epi64(high, _mm512_srli_epi64(x, MONT_IFMA_DIGIT_BITS));
+        for (size_t j = 1; j < digits; j++) {
+            __m512i bj = _mm512_load_si512(&b[j * MONT_IFMA_LANES]);
+            __m512i mj = _mm512_set1_epi64((long long)modulus[j]);
+            x = _mm512_add_epi64(acc[i + j], high);
+            x = _mm512_madd52lo_epu64(x, ai, bj);
+            acc[i + j] = _mm512_madd52lo_epu64(x, q, mj);
+            high = _mm512_madd52hi_epu64(zero, ai, bj);
+            high = _mm512_madd52hi_epu64(high, q, mj);
+        }
+        acc[i + digits] = _mm512_add_epi64(acc[i + digits], high);
+    }
+
+    // The upper half is the result; normalise it back to 52-bit digits
+    __m512i carry = zero;
+    for (size_t j = 0; j < digits; j++) {
+        __m512i x = _mm512_add_epi64(acc[digits + j], carry);
+        _mm512_store_si512(&r[j * MONT_IFMA_LANES], _mm512_and_si512(x, mask));
+        carry = _mm512_srli_epi64(x, MONT_IFMA_DIGIT_BITS);
+    }
+}
+
+#else
+
+bool mont_ifma_available(void) {
+    return false;
+}
+
+void mont_ifma_mul(size_t digits, uint64_t *r, const uint64_t *a,
+                   const uint64_t *b, const uint64_t *modulus,
+                   uint64_t inverse, uint64_t *scratch) {
+    (void)digits, (void)r, (void)a, (void)b, (void)modulus, (void)inverse;
+    (void)scratch;
+    abort();  // Callers check mont_ifma_available first
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef MONT_IFMA_H
+#define MONT_IFMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Values handled together by one call of the kernel, one per 64-bit lane of
+// an AVX-512 register. The kernel works on lane-sliced values: n digits are
+// stored as n groups of MONT_IFMA_LANES words, group j holding digit j of
+// every lane, so each group is one 64-byte vector. Arrays passed to the
+// kernel must be aligned to 64 bytes.
+#define MONT_IFMA_LANES 8
+
+// Bits per digit; the IFMA instructions multiply the low 52 bits of each lane
+#define MONT_IFMA_DIGIT_BITS 52
+
+/**
+ * Reports whether the kernel was built in and the CPU supports AVX-512 IFMA.
+ *
+ * Returns:
+ *   true if mont_ifma_mul may be called.
+ */
+bool mont_ifma_available(void);
+
+/**
+ * Almost-Montgomery multiplication of eight pairs of values under one odd
+ * modulus m: r = a * b * 2^(-52 * digits) mod m in every lane. With
+ * 4 * m < 2^(52 * digits) and both inputs below 2 * m, the result is below
+ * 2 * m again, so results can be fed back in without a final subtraction.
+ *
+ * Args:
+ *   digits (size_t): The number of 52-bit digits per value.
+ *   r (uint64_t*): The lane-sliced result; may alias a or b (output).
+ *   a (const uint64_t*): The first lane-sliced operand.
+ *   b (const uint64_t*): The second lane-sliced operand.
+ *   modulus (const uint64_t*): The digits of m, one word each, shared by all
+ * lanes.
+ *   inverse (uint64_t): -m^-1 mod 2^52.
+ *   scratch (uint64_t*): Room for 2 * digits + 1 lane-sliced digits.
+ */
+void mont_ifma_mul(size_t digits, uint64_t *r, const uint64_t *a,
+                   const uint64_t *b, const uint64_t *modulus,
+                   uint64_t inverse, uint64_t *scratch);
+
+#endif
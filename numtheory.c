@@ -1,16 +1,24 @@
 #include <gmp.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "mont_ifma.h"
+#include "numtheory.h"
 #include "randstate.h"
+#include "stats.h"
 
 // Global random state for generating random numbers
 gmp_randstate_t state;
 
 /**
- * Computes the greatest common divisor (GCD) of two integers using the
- * Euclidean algorithm.
+ * Computes the greatest common divisor (GCD) of two integers. Uses GMP's
+ * mpz_gcd, which switches from binary GCD to Lehmer steps and subquadratic
+ * half-GCD as the operands grow, and works in place with no temporaries.
  *
  * Args:
  *   gcd_result (mpz_t): The output variable to store the GCD (output).
@@ -18,26 +26,13 @@ gmp_randstate_t state;
  *   num2 (const mpz_t): The second input integer.
  */
 void gcd(mpz_t gcd_result, const mpz_t num1, const mpz_t num2) {
-    mpz_t current_num1, current_num2, temp;
-    mpz_init_set(current_num1, num1);
-    mpz_init_set(current_num2, num2);
-    mpz_init(temp);
-
-    // Euclidean algorithm: Repeat until the second number (current_num2)
-    // becomes 0.
-    while (mpz_cmp_ui(current_num2, 0) != 0) {
-        mpz_set(temp, current_num2);
-        mpz_mod(current_num2, current_num1, current_num2);
-        mpz_set(current_num1, temp);
-    }
-    mpz_set(gcd_result, current_num1);
-    mpz_clears(current_num1, current_num2, temp, (mpz_ptr)NULL);
-    return;
+    mpz_gcd(gcd_result, num1, num2);
 }
 
 /**
- * Computes the modular inverse of a modulo n using the Extended Euclidean
- * Algorithm. If the modular inverse does not exist, the output is set to 0.
+ * Computes the modular inverse of a modulo n with GMP's mpz_invert, an
+ * extended half-GCD that only tracks the one cofactor it needs. If the
+ * modular inverse does not exist, the output is set to 0.
  *
  * Args:
  *   inverse (mpz_t): The output variable to store the modular inverse (output).
@@ -45,49 +40,559 @@ void gcd(mpz_t gcd_result, const mpz_t num1, const mpz_t num2) {
  *   modulus (const mpz_t): The modulus.
  */
 void mod_inverse(mpz_t inverse, const mpz_t value, const mpz_t modulus) {
-    mpz_t cur_modulus, cur_value, coef_modulus, coef_value;
-    // Init : value * 1 + modulus * 0 = gcd(value, modulus) = value (for now)
-    mpz_init_set(cur_modulus, modulus);
-    mpz_init_set(cur_value, value);
-    mpz_init_set_ui(coef_modulus, 0);
-    mpz_init_set_ui(coef_value, 1);
-
-    mpz_t q, tmp, mul_result, sub_result;
-    mpz_inits(q, tmp, mul_result, sub_result, (mpz_ptr)NULL);
-    while (mpz_cmp_ui(cur_value, 0) != 0) {
-        mpz_fdiv_q(q, cur_modulus, cur_value);
-        // Euclidean algorithm
-        mpz_set(tmp, cur_modulus);
-        mpz_set(cur_modulus, cur_value);
-        mpz_mul(mul_result, q, cur_value);
-        mpz_sub(sub_result, tmp, mul_result);
-        mpz_set(cur_value, sub_result);
-
-        // Update the Bézout’s coeffient, proof :
-        // https://hackmd.io/@Koios/rJ_lER719
-        mpz_set(tmp, coef_modulus);
-        mpz_set(coef_modulus, coef_value);
-        mpz_mul(mul_result, q, coef_value);
-        mpz_sub(sub_result, tmp, mul_result);
-        mpz_set(coef_value, sub_result);
-    }
-    mpz_clears(q, tmp, mul_result, sub_result, (mpz_ptr)NULL);
-
-    if (mpz_cmp_ui(cur_modulus, 1) > 0) {
+    // Every value is the inverse of 0 modulo 1; keep returning the 0 the
+    // extended Euclid loop used to produce
+    if (mpz_cmp_ui(modulus, 1) == 0 ||
+        mpz_invert(inverse, value, modulus) == 0) {
         mpz_set_ui(inverse, 0);
-    } else if (mpz_cmp_ui(coef_modulus, 0) < 0) {
-        mpz_add(coef_modulus, coef_modulus, modulus);
-        mpz_set(inverse, coef_modulus);
-    } else {
-        mpz_set(inverse, coef_modulus);
     }
-    mpz_clears(cur_modulus, cur_value, coef_modulus, coef_value, (mpz_ptr)NULL);
-    return;
+}
+
+/**
+ * Computes lcm(num1, num2) and the inverse of value modulo it in one pass.
+ * The lcm is formed as (num1 / gcd) * num2, so the full product is never
+ * built, and value is reduced modulo the lcm before the extended GCD runs
+ * on operands of equal size.
+ *
+ * Args:
+ *   inverse (mpz_t): The inverse of value modulo the lcm, or 0 if there is
+ * none (output).
+ *   lcm (mpz_t): The least common multiple of num1 and num2 (output).
+ *   value (const mpz_t): The value to invert.
+ *   num1 (const mpz_t): The first positive integer.
+ *   num2 (const mpz_t): The second positive integer.
+ */
+void lcm_mod_inverse(mpz_t inverse, mpz_t lcm, const mpz_t value,
+                     const mpz_t num1, const mpz_t num2) {
+    mpz_t reduced;
+    mpz_init(reduced);
+    mpz_gcd(reduced, num1, num2);
+    mpz_divexact(lcm, num1, reduced);
+    mpz_mul(lcm, lcm, num2);
+    mpz_mod(reduced, value, lcm);
+    mod_inverse(inverse, reduced, lcm);
+    mpz_clear(reduced);
+}
+
+/**
+ * Computes -m^-1 mod 2^GMP_NUMB_BITS for an odd limb m by Newton iteration.
+ *
+ * Args:
+ *   limb (mp_limb_t): The odd low limb of the modulus.
+ *
+ * Returns:
+ *   The negated inverse used by Montgomery reduction.
+ */
+static mp_limb_t negated_limb_inverse(mp_limb_t limb) {
+    // limb * limb == 1 (mod 8), so limb is its own inverse to 3 bits; every
+    // step doubles the number of correct bits.
+    mp_limb_t inverse = limb;
+    for (int i = 0; i < 6; i++) {
+        inverse *= 2 - limb * inverse;
+    }
+    return -inverse;
+}
+
+/**
+ * Montgomery reduction: rp = tp * R^-1 mod m, where tp has 2n limbs and is
+ * destroyed. The result is fully reduced below m.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The modulus context.
+ *   rp (mp_limb_t*): The n-limb result (output).
+ *   tp (mp_limb_t*): The 2n-limb value to reduce.
+ */
+static void mont_redc(const pow_mod_ctx_t *ctx, mp_limb_t *rp,
+                      mp_limb_t *tp) {
+    mp_size_t n = ctx->limbs;
+    for (mp_size_t i = 0; i < n; i++) {
+        // Clear limb i and keep the carry in its slot; it belongs at i + n
+        mp_limb_t q = tp[i] * ctx->limb_inverse;
+        tp[i] = mpn_addmul_1(&tp[i], ctx->modulus, n, q);
+    }
+    mp_limb_t carry = mpn_add_n(rp, &tp[n], tp, n);
+    if (carry != 0 || mpn_cmp(rp, ctx->modulus, n) >= 0) {
+        mpn_sub_n(rp, rp, ctx->modulus, n);
+    }
+}
+
+/**
+ * Montgomery multiplication: rp = ap * bp * R^-1 mod m.
+ */
+static void mont_mul(pow_mod_ctx_t *ctx, mp_limb_t *rp, const mp_limb_t *ap,
+                     const mp_limb_t *bp) {
+    mpn_mul_n(ctx->product, ap, bp, ctx->limbs);
+    mont_redc(ctx, rp, ctx->product);
+}
+
+/**
+ * Montgomery squaring: rp = ap^2 * R^-1 mod m.
+ */
+static void mont_sqr(pow_mod_ctx_t *ctx, mp_limb_t *rp, const mp_limb_t *ap) {
+    mpn_sqr(ctx->product, ap, ctx->limbs);
+    mont_redc(ctx, rp, ctx->product);
+}
+
+/**
+ * Converts a value into an n-limb Montgomery representative, value * R mod m.
+ */
+static void mont_from_mpz(pow_mod_ctx_t *ctx, mp_limb_t *rp,
+                          const mpz_t value) {
+    mp_size_t n = ctx->limbs;
+    mpz_mod(ctx->reduced, value, ctx->modulus_z);
+    mp_size_t size = (mp_size_t)mpz_size(ctx->reduced);
+    mpn_zero(rp, n);
+    if (size > 0) {
+        mpn_copyi(rp, mpz_limbs_read(ctx->reduced), size);
+    }
+    mont_mul(ctx, rp, rp, ctx->r_squared);
+}
+
+/**
+ * Converts an n-limb Montgomery representative back to an ordinary value.
+ */
+static void mont_to_mpz(pow_mod_ctx_t *ctx, mpz_t result,
+                        const mp_limb_t *ap) {
+    mp_size_t n = ctx->limbs;
+    mpn_copyi(ctx->product, ap, n);
+    mpn_zero(&ctx->product[n], n);
+    mp_limb_t *rp = mpz_limbs_write(result, n);
+    mont_redc(ctx, rp, ctx->product);
+    mpz_limbs_finish(result, n);
+}
+
+/**
+ * Picks the sliding window width for an exponent of the given bit length,
+ * balancing the table precomputation against multiplications saved.
+ */
+static unsigned window_bits(mp_bitcnt_t exponent_bits) {
+    static const mp_bitcnt_t thresholds[] = { 7, 25, 81, 241, 673, 1793 };
+    unsigned width = 1;
+    while (width <= 6 && exponent_bits > thresholds[width - 1]) {
+        width++;
+    }
+    return width;
+}
+
+/**
+ * Sliding-window exponentiation in the Montgomery domain:
+ * rp = (base^exponent) * R mod m.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The modulus context (odd modulus).
+ *   rp (mp_limb_t*): The n-limb Montgomery result (output).
+ *   base (const mpz_t): The base.
+ *   exponent (const mpz_t): The non-negative exponent.
+ */
+static void mont_pow(pow_mod_ctx_t *ctx, mp_limb_t *rp, const mpz_t base,
+                     const mpz_t exponent) {
+    mp_size_t n = ctx->limbs;
+    if (mpz_sgn(exponent) == 0) {
+        mpn_copyi(rp, ctx->one, n);
+        return;
+    }
+    mp_bitcnt_t bits = mpz_sizeinbase(exponent, 2);
+    unsigned width = window_bits(bits);
+
+    // table[i] holds base^(2i + 1); grown once and reused across calls
+    size_t entries = (size_t)1 << (width - 1);
+    if (entries > ctx->table_entries) {
+        ctx->table = realloc(ctx->table, entries * n * sizeof(mp_limb_t));
+        ctx->table_entries = entries;
+    }
+    mp_limb_t *table = ctx->table;
+    mp_limb_t *square = ctx->square;
+    mont_from_mpz(ctx, table, base);
+    mont_sqr(ctx, square, table);
+    for (size_t i = 1; i < entries; i++) {
+        mont_mul(ctx, &table[i * n], &table[(i - 1) * n], square);
+    }
+
+    // Scan the exponent from the top, one odd window at a time
+    bool started = false;
+    mp_bitcnt_t i = bits;
+    while (i > 0) {
+        if (!mpz_tstbit(exponent, i - 1)) {
+            mont_sqr(ctx, rp, rp);
+            i--;
+            continue;
+        }
+        // Longest window [i-1 .. low] of at most width bits ending in a 1
+        mp_bitcnt_t low = i > width ? i - width : 0;
+        while (!mpz_tstbit(exponent, low)) {
+            low++;
+        }
+        unsigned long value = 0;
+        for (mp_bitcnt_t j = i; j > low; j--) {
+            value = (value << 1) | mpz_tstbit(exponent, j - 1);
+        }
+        if (started) {
+            for (mp_bitcnt_t j = low; j < i; j++) {
+                mont_sqr(ctx, rp, rp);
+            }
+            mont_mul(ctx, rp, rp, &table[(value >> 1) * n]);
+        } else {
+            mpn_copyi(rp, &table[(value >> 1) * n], n);
+            started = true;
+        }
+        i = low;
+    }
+}
+
+/**
+ * Left-to-right binary exponentiation of 2 in the Montgomery domain:
+ * rp = (2^exponent) * R mod m. Multiplying by the base is a one-bit shift
+ * and at most one subtraction, so only the squarings cost a full
+ * multiplication, and there is no table to build.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The modulus context (odd modulus).
+ *   rp (mp_limb_t*): The n-limb Montgomery result (output).
+ *   exponent (const mpz_t): The non-negative exponent.
+ */
+static void mont_pow_2(pow_mod_ctx_t *ctx, mp_limb_t *rp,
+                       const mpz_t exponent) {
+    mp_size_t n = ctx->limbs;
+    mpn_copyi(rp, ctx->one, n);
+    mp_bitcnt_t i = mpz_sgn(exponent) == 0 ? 0 : mpz_sizeinbase(exponent, 2);
+    bool started = false;
+    while (i > 0) {
+        i--;
+        if (started) {
+            mont_sqr(ctx, rp, rp);
+        }
+        if (mpz_tstbit(exponent, i)) {
+            // rp < m, so 2 * rp needs at most one subtraction
+            mp_limb_t carry = mpn_lshift(rp, rp, n, 1);
+            if (carry != 0 || mpn_cmp(rp, ctx->modulus, n) >= 0) {
+                mpn_sub_n(rp, rp, ctx->modulus, n);
+            }
+            started = true;
+        }
+    }
+}
+
+/**
+ * Recodes an exponent into sliding windows of the given width, filling the
+ * schedule arrays when they are non-NULL.
+ *
+ * Returns:
+ *   The number of windows.
+ */
+static size_t recode_windows(const mpz_t exponent, unsigned width,
+                             pow_mod_schedule_t *schedule) {
+    size_t steps = 0;
+    uint32_t pending = 0;  // squarings since the previous window
+    mp_bitcnt_t i = mpz_sizeinbase(exponent, 2);
+    while (i > 0) {
+        if (!mpz_tstbit(exponent, i - 1)) {
+            pending++;
+            i--;
+            continue;
+        }
+        // Longest window [i-1 .. low] of at most width bits ending in a 1
+        mp_bitcnt_t low = i > width ? i - width : 0;
+        while (!mpz_tstbit(exponent, low)) {
+            low++;
+        }
+        unsigned long value = 0;
+        for (mp_bitcnt_t j = i; j > low; j--) {
+            value = (value << 1) | mpz_tstbit(exponent, j - 1);
+        }
+        if (schedule != NULL) {
+            schedule->squarings[steps] = steps == 0 ? 0 : pending + (i - low);
+            schedule->digits[steps] = (uint32_t)(value >> 1);
+        }
+        steps++;
+        pending = 0;
+        i = low;
+    }
+    if (schedule != NULL) {
+        schedule->tail = pending;
+    }
+    return steps;
+}
+
+/**
+ * Precomputes the sliding-window schedule for a fixed exponent. The window
+ * width is picked by counting the exact number of multiplications each
+ * width needs for this exponent, table included, rather than from the bit
+ * length alone.
+ *
+ * Args:
+ *   schedule (pow_mod_schedule_t*): The schedule to initialize (output).
+ *   exponent (const mpz_t): The non-negative exponent.
+ */
+void pow_mod_schedule_init(pow_mod_schedule_t *schedule,
+                           const mpz_t exponent) {
+    schedule->width = 1;
+    schedule->steps = 0;
+    schedule->squarings = NULL;
+    schedule->digits = NULL;
+    schedule->tail = 0;
+    if (mpz_sgn(exponent) == 0) {
+        return;
+    }
+
+    // Squarings are the same for every width; only multiplications differ.
+    // A width w table costs 2^(w-1) - 1 multiplications plus one squaring.
+    size_t best_cost = SIZE_MAX;
+    for (unsigned width = 1; width <= POW_MOD_MAX_WINDOW; width++) {
+        size_t table = ((size_t)1 << (width - 1)) - 1 + (width > 1);
+        size_t cost = table + recode_windows(exponent, width, NULL) - 1;
+        if (cost < best_cost) {
+            best_cost = cost;
+            schedule->width = width;
+        }
+    }
+    schedule->steps = recode_windows(exponent, schedule->width, NULL);
+    schedule->squarings =
+        (uint32_t *)malloc(schedule->steps * sizeof(uint32_t));
+    schedule->digits = (uint32_t *)malloc(schedule->steps * sizeof(uint32_t));
+    recode_windows(exponent, schedule->width, schedule);
+}
+
+/**
+ * Frees the memory used by an exponent schedule.
+ *
+ * Args:
+ *   schedule (pow_mod_schedule_t*): The schedule to clear.
+ */
+void pow_mod_schedule_clear(pow_mod_schedule_t *schedule) {
+    free(schedule->squarings);
+    free(schedule->digits);
+    schedule->squarings = NULL;
+    schedule->digits = NULL;
+    schedule->steps = 0;
+}
+
+/**
+ * Runs a precomputed schedule in the Montgomery domain:
+ * rp = (base^exponent) * R mod m.
+ */
+static void mont_pow_schedule(pow_mod_ctx_t *ctx, mp_limb_t *rp,
+                              const mpz_t base,
+                              const pow_mod_schedule_t *schedule) {
+    mp_size_t n = ctx->limbs;
+    if (schedule->steps == 0) {
+        mpn_copyi(rp, ctx->one, n);
+        return;
+    }
+
+    size_t entries = (size_t)1 << (schedule->width - 1);
+    if (entries > ctx->table_entries) {
+        ctx->table = realloc(ctx->table, entries * n * sizeof(mp_limb_t));
+        ctx->table_entries = entries;
+    }
+    mp_limb_t *table = ctx->table;
+    mont_from_mpz(ctx, table, base);
+    if (entries > 1) {
+        mont_sqr(ctx, ctx->square, table);
+        for (size_t i = 1; i < entries; i++) {
+            mont_mul(ctx, &table[i * n], &table[(i - 1) * n], ctx->square);
+        }
+    }
+
+    mpn_copyi(rp, &table[schedule->digits[0] * n], n);
+    for (size_t step = 1; step < schedule->steps; step++) {
+        for (uint32_t j = 0; j < schedule->squarings[step]; j++) {
+            mont_sqr(ctx, rp, rp);
+        }
+        mont_mul(ctx, rp, rp, &table[schedule->digits[step] * n]);
+    }
+    for (uint32_t j = 0; j < schedule->tail; j++) {
+        mont_sqr(ctx, rp, rp);
+    }
+}
+
+/**
+ * Initializes a context with no modulus yet, its integers already sized for
+ * moduli of the given size so that setting one does not allocate them.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context to initialize (output).
+ *   bits (mp_bitcnt_t): The expected modulus size in bits.
+ */
+static void pow_mod_ctx_empty(pow_mod_ctx_t *ctx, mp_bitcnt_t bits) {
+    mpz_init2(ctx->modulus_z, bits);
+    mpz_init2(ctx->reduced, 2 * bits + 2 * GMP_NUMB_BITS);
+    ctx->odd = false;
+    ctx->limbs = 0;
+    ctx->capacity = 0;
+    ctx->limbs_buffer = NULL;
+    ctx->table = NULL;
+    ctx->table_entries = 0;
+}
+
+/**
+ * Points an initialized context at a modulus: odd moduli get Montgomery
+ * constants (R = 2^(64 * limbs), -m^-1 mod 2^64, R^2 mod m), even moduli
+ * fall back to plain division-based reduction. Buffers from an earlier
+ * modulus are reused when they are large enough.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context.
+ *   modulus (const mpz_t): The positive modulus.
+ */
+static void pow_mod_ctx_set(pow_mod_ctx_t *ctx, const mpz_t modulus) {
+    mp_size_t n = (mp_size_t)mpz_size(modulus);
+    if (n > 0) {
+        // The table keeps its allocation; count it in entries of n limbs
+        ctx->table_entries =
+            ctx->table_entries * (size_t)ctx->limbs / (size_t)n;
+    }
+    mpz_set(ctx->modulus_z, modulus);
+    ctx->odd = mpz_odd_p(modulus);
+    ctx->limbs = n;
+    if (!ctx->odd) {
+        return;
+    }
+
+    // One allocation for modulus, R^2, 1, squaring scratch, result and the
+    // 2n-limb product
+    if (n > ctx->capacity) {
+        free(ctx->limbs_buffer);
+        ctx->limbs_buffer = malloc(7 * n * sizeof(mp_limb_t));
+        ctx->capacity = n;
+    }
+    ctx->modulus = ctx->limbs_buffer;
+    ctx->r_squared = &ctx->limbs_buffer[n];
+    ctx->one = &ctx->limbs_buffer[2 * n];
+    ctx->square = &ctx->limbs_buffer[3 * n];
+    ctx->result = &ctx->limbs_buffer[4 * n];
+    ctx->product = &ctx->limbs_buffer[5 * n];
+    mpn_copyi(ctx->modulus, mpz_limbs_read(modulus), n);
+    ctx->limb_inverse = negated_limb_inverse(ctx->modulus[0]);
+
+    // R^2 mod m, then 1 in Montgomery form is R mod m = REDC(R^2)
+    mpz_set_ui(ctx->reduced, 0);
+    mpz_setbit(ctx->reduced, 2 * n * GMP_NUMB_BITS);
+    mpz_mod(ctx->reduced, ctx->reduced, modulus);
+    mpn_zero(ctx->r_squared, n);
+    mpn_copyi(ctx->r_squared, mpz_limbs_read(ctx->reduced),
+              (mp_size_t)mpz_size(ctx->reduced));
+    mpn_copyi(ctx->product, ctx->r_squared, n);
+    mpn_zero(&ctx->product[n], n);
+    mont_redc(ctx, ctx->one, ctx->product);
+}
+
+/**
+ * Prepares a reusable exponentiation context for a modulus, with Montgomery
+ * reduction for odd moduli and plain division-based reduction for even ones.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context to initialize (output).
+ *   modulus (const mpz_t): The positive modulus.
+ */
+void pow_mod_ctx_init(pow_mod_ctx_t *ctx, const mpz_t modulus) {
+    pow_mod_ctx_empty(ctx, mpz_sizeinbase(modulus, 2));
+    pow_mod_ctx_set(ctx, modulus);
+}
+
+/**
+ * Frees the memory used by an exponentiation context.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context to clear.
+ */
+void pow_mod_ctx_clear(pow_mod_ctx_t *ctx) {
+    mpz_clears(ctx->modulus_z, ctx->reduced, (mpz_ptr)NULL);
+    free(ctx->limbs_buffer);
+    free(ctx->table);
+    ctx->limbs_buffer = NULL;
+    ctx->table = NULL;
+}
+
+/**
+ * Computes (base^exponent) % modulus with the right-to-left binary method.
+ * Used for even moduli, where Montgomery reduction does not apply.
+ */
+static void pow_mod_plain(mpz_t result, const mpz_t base, const mpz_t exponent,
+                          const mpz_t modulus) {
+    mpz_t current_result, current_base;
+    mpz_init_set_ui(current_result, 1);
+    mpz_init(current_base);
+    mpz_mod(current_base, base, modulus);
+
+    mp_bitcnt_t bits = mpz_sizeinbase(exponent, 2);
+    for (mp_bitcnt_t i = 0; i < bits && mpz_sgn(exponent) > 0; i++) {
+        if (mpz_tstbit(exponent, i)) {
+            mpz_mul(current_result, current_result, current_base);
+            mpz_mod(current_result, current_result, modulus);
+        }
+        mpz_mul(current_base, current_base, current_base);
+        mpz_mod(current_base, current_base, modulus);
+    }
+    mpz_mod(result, current_result, modulus);
+    mpz_clears(current_base, current_result, (mpz_ptr)NULL);
+}
+
+/**
+ * Computes (base^exponent) % modulus using a prepared context.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context for the modulus.
+ *   result (mpz_t): The output variable to store the result (output).
+ *   base (const mpz_t): The base.
+ *   exponent (const mpz_t): The non-negative exponent.
+ */
+void pow_mod_ctx(pow_mod_ctx_t *ctx, mpz_t result, const mpz_t base,
+                 const mpz_t exponent) {
+    if (!ctx->odd) {
+        pow_mod_plain(result, base, exponent, ctx->modulus_z);
+        return;
+    }
+    mont_pow(ctx, ctx->result, base, exponent);
+    mont_to_mpz(ctx, result, ctx->result);
+}
+
+/**
+ * Computes (base^exponent) % modulus using a prepared context and a
+ * precomputed schedule for the exponent.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context for the modulus.
+ *   result (mpz_t): The output variable to store the result (output).
+ *   base (const mpz_t): The base.
+ *   schedule (const pow_mod_schedule_t*): The schedule of the exponent.
+ *   exponent (const mpz_t): The exponent the schedule was built from, used
+ * for even moduli.
+ */
+void pow_mod_ctx_schedule(pow_mod_ctx_t *ctx, mpz_t result, const mpz_t base,
+                          const pow_mod_schedule_t *schedule,
+                          const mpz_t exponent) {
+    if (!ctx->odd) {
+        pow_mod_plain(result, base, exponent, ctx->modulus_z);
+        return;
+    }
+    mont_pow_schedule(ctx, ctx->result, base, schedule);
+    mont_to_mpz(ctx, result, ctx->result);
+}
+
+/**
+ * Computes (value^2) % modulus using a prepared context.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context for the modulus.
+ *   result (mpz_t): The output variable to store the result (output).
+ *   value (const mpz_t): The value to square.
+ */
+void sqr_mod(pow_mod_ctx_t *ctx, mpz_t result, const mpz_t value) {
+    if (!ctx->odd) {
+        mpz_mul(result, value, value);
+        mpz_mod(result, result, ctx->modulus_z);
+        return;
+    }
+    // Plain squaring plus one division beats converting in and out of the
+    // Montgomery domain for a single operation
+    mpz_mul(ctx->reduced, value, value);
+    mpz_mod(result, ctx->reduced, ctx->modulus_z);
 }
 
 /**
  * Computes (base^exponent) % modulus using modular exponentiation.
- * This implementation uses the right-to-left binary method for efficiency.
+ * Builds a one-off context; callers exponentiating repeatedly under the same
+ * modulus should use pow_mod_ctx instead.
  *
  * Args:
  *   result (mpz_t): The output variable to store the result (output).
@@ -97,137 +602,862 @@ void mod_inverse(mpz_t inverse, const mpz_t value, const mpz_t modulus) {
  */
 void pow_mod(mpz_t result, const mpz_t base, const mpz_t exponent,
              const mpz_t modulus) {
-    mpz_t current_result;
-    mpz_init(current_result);
-    // Sets current_result to 1 (multiplicative identity).
-    mpz_set_ui(current_result, 1);
+    pow_mod_ctx_t ctx;
+    pow_mod_ctx_init(&ctx, modulus);
+    pow_mod_ctx(&ctx, result, base, exponent);
+    pow_mod_ctx_clear(&ctx);
+}
 
-    mpz_t current_base, remainder, current_exponent;
-    mpz_inits(current_base, remainder, current_exponent, (mpz_ptr)NULL);
+#define LANE_DIGIT_MASK ((UINT64_C(1) << MONT_IFMA_DIGIT_BITS) - 1)
 
-    mpz_set(current_base, base);
-    mpz_set(current_exponent, exponent);
+/**
+ * Writes a value below 2^(52 * digits) into one lane of a lane-sliced array.
+ *
+ * Args:
+ *   ctx (const pow_mod_lanes_t*): The context giving the number of digits.
+ *   out (uint64_t*): The lane-sliced array (output).
+ *   lane (size_t): The lane to write.
+ *   value (const mpz_t): The non-negative value.
+ */
+static void lanes_import(const pow_mod_lanes_t *ctx, uint64_t *out,
+                         size_t lane, const mpz_t value) {
+    const mp_limb_t *limbs = mpz_limbs_read(value);
+    size_t size = mpz_size(value);
+    for (size_t j = 0; j < ctx->digits; j++) {
+        size_t bit = j * MONT_IFMA_DIGIT_BITS;
+        size_t limb = bit / 64;
+        unsigned shift = bit % 64;
+        uint64_t digit = 0;
+        if (limb < size) {
+            digit = limbs[limb] >> shift;
+            if (shift > 64 - MONT_IFMA_DIGIT_BITS && limb + 1 < size) {
+                digit |= limbs[limb + 1] << (64 - shift);
+            }
+        }
+        out[j * MONT_IFMA_LANES + lane] = digit & LANE_DIGIT_MASK;
+    }
+}
 
-    while (mpz_cmp_si(current_exponent, 0) > 0) {
-        mpz_mod_ui(remainder, current_exponent, 2);
-        if (mpz_cmp_si(remainder, 0) != 0) {  // odd exponent:
-            mpz_mul(current_result, current_result, current_base);
-            mpz_mod(current_result, current_result, modulus);
+/**
+ * Reads one lane of a lane-sliced array back into a value.
+ *
+ * Args:
+ *   ctx (const pow_mod_lanes_t*): The context giving the number of digits.
+ *   value (mpz_t): The value (output).
+ *   in (const uint64_t*): The lane-sliced array.
+ *   lane (size_t): The lane to read.
+ */
+static void lanes_export(const pow_mod_lanes_t *ctx, mpz_t value,
+                         const uint64_t *in, size_t lane) {
+    size_t size = (ctx->digits * MONT_IFMA_DIGIT_BITS + 63) / 64;
+    mp_limb_t *limbs = mpz_limbs_write(value, (mp_size_t)size);
+    mpn_zero(limbs, (mp_size_t)size);
+    for (size_t j = 0; j < ctx->digits; j++) {
+        size_t bit = j * MONT_IFMA_DIGIT_BITS;
+        size_t limb = bit / 64;
+        unsigned shift = bit % 64;
+        uint64_t digit = in[j * MONT_IFMA_LANES + lane];
+        limbs[limb] |= digit << shift;
+        if (shift > 64 - MONT_IFMA_DIGIT_BITS) {
+            limbs[limb + 1] |= digit >> (64 - shift);
         }
-        mpz_mul(current_base, current_base, current_base);
-        mpz_mod(current_base, current_base, modulus);
-        mpz_fdiv_q_ui(current_exponent, current_exponent, 2);
     }
-    mpz_set(result, current_result);
-    mpz_clears(current_base, remainder, current_exponent, current_result,
-               (mpz_ptr)NULL);
+    mpz_limbs_finish(value, (mp_size_t)size);
 }
 
 /**
- * Performs the Miller-Rabin primality test to determine if a number is prime.
+ * Prepares multi-buffer exponentiation for a modulus and exponent. The
+ * vector kernel needs an odd modulus and a positive exponent; anything else
+ * is left to mpz_powm. The exponent's window schedule is precomputed here,
+ * so exponentiating never scans the exponent bits.
  *
  * Args:
- *   number (const mpz_t): The number to test for primality.
- *   iterations (uint64_t): The number of iterations for the test (higher values
- * increase accuracy).
+ *   ctx (pow_mod_lanes_t*): The context to initialize (output).
+ *   modulus (const mpz_t): The positive modulus.
+ *   exponent (const mpz_t): The non-negative exponent shared by every base.
+ */
+void pow_mod_lanes_init(pow_mod_lanes_t *ctx, const mpz_t modulus,
+                        const mpz_t exponent) {
+    mpz_init_set(ctx->modulus, modulus);
+    mpz_init_set(ctx->exponent, exponent);
+    mpz_init2(ctx->scratch, mpz_sizeinbase(modulus, 2));
+    ctx->buffer = NULL;
+    pow_mod_schedule_init(&ctx->schedule, exponent);
+    ctx->vector = GMP_NUMB_BITS == 64 && mpz_odd_p(modulus) &&
+                  mpz_cmp_ui(modulus, 1) > 0 && mpz_sgn(exponent) > 0 &&
+                  mont_ifma_available();
+    if (!ctx->vector) {
+        return;
+    }
+
+    // Two spare bits keep almost-Montgomery results below 2m
+    size_t n = (mpz_sizeinbase(modulus, 2) + 2 + MONT_IFMA_DIGIT_BITS - 1) /
+               MONT_IFMA_DIGIT_BITS;
+    size_t vector = n * MONT_IFMA_LANES;
+    ctx->digits = n;
+
+    // The modulus digits are rounded up to whole vectors so every array
+    // after them stays 64-byte aligned
+    size_t entries = (size_t)1 << (ctx->schedule.width - 1);
+    size_t words = vector + 4 * vector + entries * vector +
+                   (2 * n + 1) * MONT_IFMA_LANES;
+    ctx->buffer = aligned_alloc(64, words * sizeof(uint64_t));
+    memset(ctx->buffer, 0, words * sizeof(uint64_t));
+    ctx->modulus_digits = ctx->buffer;
+    ctx->r_squared = &ctx->buffer[vector];
+    ctx->one = &ctx->buffer[2 * vector];
+    ctx->base = &ctx->buffer[3 * vector];
+    ctx->result = &ctx->buffer[4 * vector];
+    ctx->table = &ctx->buffer[5 * vector];
+    ctx->product = &ctx->table[entries * vector];
+
+    // Digit j of the modulus lands in lane 0 of group j; spread that back
+    // into one word per digit
+    lanes_import(ctx, ctx->result, 0, modulus);
+    for (size_t j = 0; j < n; j++) {
+        ctx->modulus_digits[j] = ctx->result[j * MONT_IFMA_LANES];
+    }
+    uint64_t low = ctx->modulus_digits[0];
+    uint64_t inverse = low;  // correct to 3 bits, doubling every step
+    for (int i = 0; i < 6; i++) {
+        inverse *= 2 - low * inverse;
+    }
+    ctx->inverse = -inverse & LANE_DIGIT_MASK;
+
+    mpz_set_ui(ctx->scratch, 0);
+    mpz_setbit(ctx->scratch, 2 * n * MONT_IFMA_DIGIT_BITS);
+    mpz_mod(ctx->scratch, ctx->scratch, modulus);
+    for (size_t lane = 0; lane < MONT_IFMA_LANES; lane++) {
+        lanes_import(ctx, ctx->r_squared, lane, ctx->scratch);
+        ctx->one[lane] = 1;
+    }
+}
+
+/**
+ * Frees the memory used by a multi-buffer exponentiation context.
+ *
+ * Args:
+ *   ctx (pow_mod_lanes_t*): The context to clear.
+ */
+void pow_mod_lanes_clear(pow_mod_lanes_t *ctx) {
+    free(ctx->buffer);
+    ctx->buffer = NULL;
+    pow_mod_schedule_clear(&ctx->schedule);
+    mpz_clears(ctx->modulus, ctx->exponent, ctx->scratch, NULL);
+}
+
+/**
+ * Zeroes the reduced bases, powers and results a multi-buffer context keeps
+ * from its last group. The modulus digits and constants are left alone.
+ *
+ * Args:
+ *   ctx (pow_mod_lanes_t*): The context to wipe.
+ */
+void pow_mod_lanes_wipe(pow_mod_lanes_t *ctx) {
+    wipe_bignum(ctx->scratch, mpz_sizeinbase(ctx->modulus, 2));
+    if (ctx->buffer != NULL) {
+        // base, result, table and product are contiguous, after one
+        size_t vector = ctx->digits * MONT_IFMA_LANES;
+        size_t entries = (size_t)1 << (ctx->schedule.width - 1);
+        size_t words = 2 * vector + entries * vector +
+                       (2 * ctx->digits + 1) * MONT_IFMA_LANES;
+        memset(ctx->base, 0, words * sizeof(uint64_t));
+    }
+}
+
+/**
+ * Zeroes every limb of a bignum up to the given size and sets it to 0,
+ * keeping its allocation.
+ *
+ * Args:
+ *   value (mpz_t): The bignum to wipe.
+ *   bits (size_t): The bits to clear, at least the largest value it has held.
+ */
+void wipe_bignum(mpz_t value, size_t bits) {
+    size_t limbs = (bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    if (limbs < mpz_size(value)) {
+        limbs = mpz_size(value);
+    }
+    if (limbs > 0) {
+        memset(mpz_limbs_modify(value, (mp_size_t)limbs), 0,
+               limbs * sizeof(mp_limb_t));
+    }
+    mpz_limbs_finish(value, 0);
+}
+
+/**
+ * Returns how many bases callers should hand pow_mod_lanes at a time.
+ *
+ * Args:
+ *   ctx (const pow_mod_lanes_t*): The context.
  *
  * Returns:
- *   true if the number is likely prime, false otherwise.
+ *   POW_MOD_LANES with the vector kernel, 1 without.
  */
-bool is_prime(const mpz_t number, uint64_t iterations) {
-    // Handle small numbers and even cases
-    if (mpz_cmp_ui(number, 1) == 0) {
-        return false;
-    } else if (mpz_cmp_ui(number, 2) == 0) {
+size_t pow_mod_lanes_width(const pow_mod_lanes_t *ctx) {
+    return ctx->vector ? POW_MOD_LANES : 1;
+}
+
+/**
+ * Computes results[i] = (bases[i]^exponent) % modulus for up to
+ * POW_MOD_LANES bases. With the vector kernel every base is brought into
+ * Montgomery form in its own lane and the exponent's precomputed schedule
+ * is replayed once for all of them.
+ *
+ * Args:
+ *   ctx (pow_mod_lanes_t*): The context for the modulus and exponent.
+ *   results (mpz_ptr*): The outputs; results[i] may be bases[i] (output).
+ *   bases (mpz_srcptr*): The bases.
+ *   count (size_t): The number of bases, at most POW_MOD_LANES.
+ */
+void pow_mod_lanes(pow_mod_lanes_t *ctx, mpz_ptr *results,
+                   const mpz_srcptr *bases, size_t count) {
+    if (!ctx->vector || count < POW_MOD_LANES_MIN) {
+        for (size_t i = 0; i < count; i++) {
+            mpz_powm(results[i], bases[i], ctx->exponent, ctx->modulus);
+        }
+        return;
+    }
+
+    size_t n = ctx->digits;
+    size_t vector = n * MONT_IFMA_LANES;
+    const uint64_t *m = ctx->modulus_digits;
+    uint64_t *table = ctx->table;
+    uint64_t *result = ctx->result;
+    for (size_t lane = 0; lane < MONT_IFMA_LANES; lane++) {
+        if (lane < count) {
+            mpz_mod(ctx->scratch, bases[lane], ctx->modulus);
+        } else {
+            mpz_set_ui(ctx->scratch, 0);  // Idle lanes compute 0^e
+        }
+        lanes_import(ctx, ctx->base, lane, ctx->scratch);
+    }
+
+    // table[i] holds base^(2i + 1) in Montgomery form, built from base^2,
+    // which result holds until the windows start
+    const pow_mod_schedule_t *schedule = &ctx->schedule;
+    size_t entries = (size_t)1 << (schedule->width - 1);
+    mont_ifma_mul(n, table, ctx->base, ctx->r_squared, m, ctx->inverse,
+                  ctx->product);
+    if (entries > 1) {
+        mont_ifma_mul(n, result, table, table, m, ctx->inverse, ctx->product);
+        for (size_t i = 1; i < entries; i++) {
+            mont_ifma_mul(n, &table[i * vector], &table[(i - 1) * vector],
+                          result, m, ctx->inverse, ctx->product);
+        }
+    }
+
+    // Every lane shares the exponent, so every lane replays the same windows
+    memcpy(result, &table[schedule->digits[0] * vector],
+           vector * sizeof(uint64_t));
+    for (size_t step = 1; step < schedule->steps; step++) {
+        for (uint32_t j = 0; j < schedule->squarings[step]; j++) {
+            mont_ifma_mul(n, result, result, result, m, ctx->inverse,
+                          ctx->product);
+        }
+        mont_ifma_mul(n, result, result, &table[schedule->digits[step] * vector],
+                      m, ctx->inverse, ctx->product);
+    }
+    for (uint32_t j = 0; j < schedule->tail; j++) {
+        mont_ifma_mul(n, result, result, result, m, ctx->inverse, ctx->product);
+    }
+
+    // Multiplying by 1 leaves Montgomery form with a result of at most m
+    mont_ifma_mul(n, result, result, ctx->one, m, ctx->inverse, ctx->product);
+    for (size_t lane = 0; lane < count; lane++) {
+        lanes_export(ctx, results[lane], result, lane);
+        if (mpz_cmp(results[lane], ctx->modulus) >= 0) {
+            mpz_sub(results[lane], results[lane], ctx->modulus);
+        }
+    }
+}
+
+// Odd primes below this bound form the sieve table used by make_prime
+#define SIEVE_LIMIT 16384
+
+// Below this many bits candidates are too close to the sieve primes
+// themselves, so make_prime draws and tests them directly
+#define SIEVE_MIN_BITS 24
+
+// Odd primes below this bound are multiplied into the product is_prime
+// divides out with a single gcd
+#define TRIAL_LIMIT 1024
+
+static uint32_t sieve_primes[SIEVE_LIMIT / 2];
+static size_t sieve_count = 0;
+static pthread_once_t sieve_once = PTHREAD_ONCE_INIT;
+
+static mpz_t trial_product;
+static pthread_once_t trial_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Fills sieve_primes with the odd primes below SIEVE_LIMIT using the sieve of
+ * Eratosthenes. Runs once per process.
+ */
+static void sieve_init(void) {
+    static bool composite[SIEVE_LIMIT];
+    for (uint32_t i = 3; i < SIEVE_LIMIT; i += 2) {
+        if (composite[i]) {
+            continue;
+        }
+        sieve_primes[sieve_count++] = i;
+        for (uint32_t j = i * i; j < SIEVE_LIMIT; j += 2 * i) {
+            composite[j] = true;
+        }
+    }
+}
+
+/**
+ * Builds trial_product, the product of the odd primes below TRIAL_LIMIT.
+ * Runs once per process.
+ */
+static void trial_init(void) {
+    pthread_once(&sieve_once, sieve_init);
+    mpz_init_set_ui(trial_product, 1);
+    for (size_t i = 0; i < sieve_count && sieve_primes[i] < TRIAL_LIMIT; i++) {
+        mpz_mul_ui(trial_product, trial_product, sieve_primes[i]);
+    }
+}
+
+/**
+ * Looks a number below SIEVE_LIMIT up in the sieve table.
+ *
+ * Args:
+ *   number (unsigned long): The number to look up; must be below SIEVE_LIMIT.
+ *
+ * Returns:
+ *   true if the number is prime, false otherwise.
+ */
+static bool small_prime(unsigned long number) {
+    if (number == 2) {
         return true;
-    } else if (mpz_even_p(number)) {
+    }
+    pthread_once(&sieve_once, sieve_init);
+    size_t low = 0;
+    size_t high = sieve_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (sieve_primes[middle] < number) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < sieve_count && sieve_primes[low] == number;
+}
+
+/**
+ * Runs one Miller-Rabin round: checks whether number is a strong probable
+ * prime to the given base.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The Montgomery context for number.
+ *   base (const mpz_t): The base, in [2, number - 2].
+ *   r (const mpz_t): The odd part of number - 1.
+ *   s (uint64_t): The power of two in number - 1 = 2^s * r.
+ *   minus_one (const mp_limb_t*): number - 1 in Montgomery form.
+ *
+ * Returns:
+ *   true if number passes the round, false if base witnesses that it is
+ * composite.
+ */
+static bool strong_probable_prime(pow_mod_ctx_t *ctx, const mpz_t base,
+                                  const mpz_t r, uint64_t s,
+                                  const mp_limb_t *minus_one) {
+    mp_size_t n = ctx->limbs;
+    mp_limb_t *witness = ctx->result;
+    if (mpz_cmp_ui(base, 2) == 0) {
+        mont_pow_2(ctx, witness, r);
+    } else {
+        mont_pow(ctx, witness, base, r);  // witness = (base^r) % number.
+    }
+
+    // Check if witness is 1 or number - 1
+    if (mpn_cmp(witness, ctx->one, n) == 0 ||
+        mpn_cmp(witness, minus_one, n) == 0) {
+        return true;
+    }
+    // Perform s-1 iterations of squaring, looking for number - 1
+    for (uint64_t j = 1; j <= s - 1; j++) {
+        mont_sqr(ctx, witness, witness);  // witness = (witness^2) % number.
+        if (mpn_cmp(witness, minus_one, n) == 0) {
+            return true;
+        }
+        // Once witness is 1 it stays 1, so number - 1 can no longer appear
+        if (mpn_cmp(witness, ctx->one, n) == 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/**
+ * Halves value modulo an odd modulus, leaving it reduced to [0, modulus).
+ */
+static void halve_mod(mpz_t value, const mpz_t modulus) {
+    mpz_mod(value, value, modulus);
+    if (mpz_odd_p(value)) {
+        mpz_add(value, value, modulus);
+    }
+    mpz_tdiv_q_2exp(value, value, 1);
+}
+
+/**
+ * Performs the strong Lucas probable-prime test with Selfridge's parameters:
+ * D is the first of 5, -7, 9, -11, ... with Jacobi symbol (D/number) = -1,
+ * P = 1 and Q = (1 - D) / 4. Together with a base-2 Miller-Rabin round this
+ * is the Baillie-PSW test, which has no known counterexample.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The temporaries to use.
+ *   number (const mpz_t): The number to test; must be odd and above
+ * SIEVE_LIMIT.
+ *
+ * Returns:
+ *   true if the number is a strong Lucas probable prime, false otherwise.
+ */
+static bool strong_lucas_prime(numtheory_scratch_t *scratch,
+                               const mpz_t number) {
+    // A square has no D with (D/number) = -1, so the search would not end
+    if (mpz_perfect_square_p(number)) {
         return false;
     }
-    // Initialize variables for (number - 1) = (2^s) * r
-    uint64_t s = 1;  // Initial exponent for the power of 2.
-    mpz_t r, number_minus_one;
-    mpz_inits(r, number_minus_one, (mpz_ptr)NULL);
-    mpz_sub_ui(number_minus_one, number, 1);
+    long d = 5;
     while (true) {
-        mpz_fdiv_q_2exp(r, number_minus_one, s);  // r = (number - 1) / 2^s.
-        if (mpz_odd_p(r)) {                       // Stop when r is odd.
+        int jacobi = mpz_si_kronecker(d, number);
+        if (jacobi == -1) {
             break;
         }
-        s++;
+        if (jacobi == 0) {
+            return false;  // |d| is a proper factor, as number > SIEVE_LIMIT
+        }
+        d = d > 0 ? -(d + 2) : -d + 2;
+    }
+    long q = (1 - d) / 4;
+
+    // number + 1 = 2^s * k with k odd
+    mpz_ptr k = scratch->lucas[0];
+    mpz_ptr u = scratch->lucas[1];
+    mpz_ptr v = scratch->lucas[2];
+    mpz_ptr q_k = scratch->lucas[3];
+    mpz_ptr sum = scratch->lucas[4];
+    mpz_add_ui(k, number, 1);
+    uint64_t s = mpz_scan1(k, 0);
+    mpz_tdiv_q_2exp(k, k, s);
+
+    // Walk the bits of k from the top, starting at U_1 = 1, V_1 = P = 1
+    mpz_set_ui(u, 1);
+    mpz_set_ui(v, 1);
+    mpz_set_si(q_k, q);
+    mpz_mod(q_k, q_k, number);
+    for (size_t bit = mpz_sizeinbase(k, 2) - 1; bit-- > 0;) {
+        // U_2m = U_m * V_m, V_2m = V_m^2 - 2 * Q^m
+        mpz_mul(u, u, v);
+        mpz_mod(u, u, number);
+        mpz_mul(v, v, v);
+        mpz_submul_ui(v, q_k, 2);
+        mpz_mod(v, v, number);
+        mpz_mul(q_k, q_k, q_k);
+        mpz_mod(q_k, q_k, number);
+        if (mpz_tstbit(k, bit)) {
+            // U_m+1 = (P * U_m + V_m) / 2, V_m+1 = (D * U_m + P * V_m) / 2
+            mpz_mul_si(sum, u, d);
+            mpz_add(sum, sum, v);
+            mpz_add(u, u, v);
+            halve_mod(u, number);
+            halve_mod(sum, number);
+            mpz_swap(v, sum);
+            mpz_mul_si(q_k, q_k, q);
+            mpz_mod(q_k, q_k, number);
+        }
     }
-    // Initialize variables for Miller-Rabin test
-    mpz_t base, max_random, witness, two;
-    mpz_inits(base, max_random, witness, two, (mpz_ptr)NULL);
 
+    // Strong test: U_k = 0, or V_(2^j * k) = 0 for some 0 <= j < s
+    bool probably_prime = mpz_sgn(u) == 0 || mpz_sgn(v) == 0;
+    for (uint64_t j = 1; j < s && !probably_prime; j++) {
+        mpz_mul(v, v, v);
+        mpz_submul_ui(v, q_k, 2);
+        mpz_mod(v, v, number);
+        mpz_mul(q_k, q_k, q_k);
+        mpz_mod(q_k, q_k, number);
+        probably_prime = mpz_sgn(v) == 0;
+    }
+    return probably_prime;
+}
+
+/**
+ * The tiered primality test behind is_prime_r and make_prime_r: small
+ * numbers are looked up in the sieve table, larger ones go through trial
+ * division (unless the caller has already sieved them), a base-2 Miller-Rabin
+ * round, the strong Lucas test if IS_PRIME_BPSW is set, and then random-base
+ * rounds. Composites almost always fall at the first one or two tiers, so
+ * they cost at most one exponentiation.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The temporaries to use.
+ *   number (const mpz_t): The number to test for primality.
+ *   iterations (uint64_t): The Miller-Rabin round count, the base-2 round
+ * included, or IS_PRIME_BPSW plus a number of extra random rounds.
+ *   rng (randstate_t*): The random state to draw bases from, or NULL for the
+ * global state.
+ *   trial_divide (bool): Whether to divide out the primes below TRIAL_LIMIT
+ * first; make_prime_r has already sieved its candidates.
+ *
+ * Returns:
+ *   true if the number is likely prime, false otherwise.
+ */
+static bool probable_prime(numtheory_scratch_t *scratch, const mpz_t number,
+                           uint64_t iterations, randstate_t *rng,
+                           bool trial_divide) {
+    if (mpz_cmp_ui(number, SIEVE_LIMIT) < 0) {
+        return mpz_sgn(number) > 0 && small_prime(mpz_get_ui(number));
+    } else if (mpz_even_p(number)) {
+        return false;
+    }
+    if (trial_divide) {
+        // trial_product was built by numtheory_scratch_init
+        mpz_gcd(scratch->factor, number, trial_product);
+        if (mpz_cmp_ui(scratch->factor, 1) != 0) {
+            stats_add(STATS_PRIME_TRIAL_REJECTED, 1);
+            return false;  // number exceeds every prime in the product
+        }
+    }
+
+    // (number - 1) = (2^s) * r with r odd
+    mpz_ptr r = scratch->r;
+    mpz_ptr base = scratch->base;
+    mpz_ptr max_random = scratch->max_random;
+    mpz_sub_ui(r, number, 1);
+    uint64_t s = mpz_scan1(r, 0);
+    mpz_tdiv_q_2exp(r, r, s);
     mpz_sub_ui(max_random, number, 4);  // max_random = number - 4.
-    mpz_set_ui(two, 2);                 // Constant value 2.
 
-    // Perform Miller-Rabin test for the given number of iterations
-    for (uint64_t i = 0; i < iterations; i++) {
+    // Precompute the Montgomery constants once for all rounds; 1 and
+    // number - 1 are compared in Montgomery form.
+    pow_mod_ctx_t *ctx = &scratch->ctx;
+    pow_mod_ctx_set(ctx, number);
+    if (ctx->limbs > scratch->minus_one_limbs) {
+        free(scratch->minus_one);
+        scratch->minus_one = malloc(ctx->limbs * sizeof(mp_limb_t));
+        scratch->minus_one_limbs = ctx->limbs;
+    }
+    mp_limb_t *minus_one = scratch->minus_one;
+    mpn_sub_n(minus_one, ctx->modulus, ctx->one, ctx->limbs);
+
+    // Base 2 first: it weeds out nearly every composite that slipped past
+    // trial division, and needs no random draw
+    mpz_set_ui(base, 2);
+    bool probably_prime = strong_probable_prime(ctx, base, r, s, minus_one);
+    if (!probably_prime) {
+        stats_add(STATS_PRIME_BASE2_REJECTED, 1);
+    }
+
+    uint64_t rounds = iterations > 0 ? iterations - 1 : 0;
+    if (iterations & IS_PRIME_BPSW) {
+        if (probably_prime && !strong_lucas_prime(scratch, number)) {
+            stats_add(STATS_PRIME_LUCAS_REJECTED, 1);
+            probably_prime = false;
+        }
+        rounds = iterations & ~IS_PRIME_BPSW;
+    }
+    for (uint64_t i = 0; i < rounds && probably_prime; i++) {
         mpz_urandomm(
-            base, state,
+            base, randstate_gmp(rng),
             max_random);  // Generate random base in range [0, number - 4].
         mpz_add_ui(base, base, 2);  // Shift base to range [2, number - 2].
-        pow_mod(witness, base, r, number);  // witness = (base^r) % number.
-
-        // Check if witness is 1 or number - 1
-        if (mpz_cmp_ui(witness, 1) == 0 ||
-            mpz_cmp(witness, number_minus_one) == 0) {
-            continue;  // This base passes the test; move to the next iteration.
-        }
-        // Perform s-1 iterations of squaring
-        for (uint64_t j = 1;
-             j <= s - 1 && mpz_cmp(witness, number_minus_one) != 0; j++) {
-            pow_mod(witness, witness, two,
-                    number);  // witness = (witness^2) % number.
-
-            // If witness becomes 1, the number is composite
-            if (mpz_cmp_ui(witness, 1) == 0) {
-                mpz_clears(r, base, max_random, witness, number_minus_one, two,
-                           (mpz_ptr)NULL);
-                return false;
-            }
+        probably_prime = strong_probable_prime(ctx, base, r, s, minus_one);
+        if (!probably_prime) {
+            stats_add(STATS_PRIME_RANDOM_REJECTED, 1);
         }
+    }
+    return probably_prime;
+}
 
-        // If witness does not become number - 1, the number is composite
-        if (mpz_cmp(witness, number_minus_one) != 0) {
-            mpz_clears(r, base, max_random, witness, number_minus_one, two,
-                       (mpz_ptr)NULL);
-            return false;
-        }
+/**
+ * Initializes a scratch context sized for numbers of about bit_size bits.
+ * Every integer gets its storage up front, so a test of a number of that
+ * size allocates nothing.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The context to initialize (output).
+ *   bit_size (uint64_t): The expected size of the numbers in bits.
+ */
+void numtheory_scratch_init(numtheory_scratch_t *scratch, uint64_t bit_size) {
+    // Built once here, so the tests themselves need not check
+    pthread_once(&trial_once, trial_init);
+
+    mp_bitcnt_t bits = bit_size + GMP_NUMB_BITS;
+    mpz_init2(scratch->r, bits);
+    mpz_init2(scratch->base, bits);
+    mpz_init2(scratch->max_random, bits);
+    mpz_init2(scratch->factor, bits);
+    for (size_t i = 0; i < 5; i++) {
+        mpz_init2(scratch->lucas[i], 2 * bits);  // products before reduction
     }
-    mpz_clears(r, base, max_random, witness, number_minus_one, two,
-               (mpz_ptr)NULL);
-    return true;  // The number passes all tests and is likely prime.
+    mpz_init2(scratch->start, bits);
+    scratch->minus_one = NULL;
+    scratch->minus_one_limbs = 0;
+    scratch->residues = (uint32_t *)malloc(sieve_count * sizeof(uint32_t));
+    pow_mod_ctx_empty(&scratch->ctx, bits);
 }
 
 /**
- * Generates a random prime number with a specified number of bits.
+ * Frees the memory used by a scratch context.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The context to clear.
+ */
+void numtheory_scratch_clear(numtheory_scratch_t *scratch) {
+    mpz_clears(scratch->r, scratch->base, scratch->max_random,
+               scratch->factor, scratch->start, (mpz_ptr)NULL);
+    for (size_t i = 0; i < 5; i++) {
+        mpz_clear(scratch->lucas[i]);
+    }
+    free(scratch->minus_one);
+    free(scratch->residues);
+    pow_mod_ctx_clear(&scratch->ctx);
+}
+
+/**
+ * Computes (base^exponent) % modulus, pointing the scratch context's
+ * exponentiation context at the modulus instead of building a new one.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The scratch context.
+ *   result (mpz_t): The output variable to store the result (output).
+ *   base (const mpz_t): The base.
+ *   exponent (const mpz_t): The exponent.
+ *   modulus (const mpz_t): The modulus.
+ */
+void pow_mod_scratch(numtheory_scratch_t *scratch, mpz_t result,
+                     const mpz_t base, const mpz_t exponent,
+                     const mpz_t modulus) {
+    pow_mod_ctx_set(&scratch->ctx, modulus);
+    pow_mod_ctx(&scratch->ctx, result, base, exponent);
+}
+
+/**
+ * Performs the Miller-Rabin primality test to determine if a number is prime.
+ *
+ * Args:
+ *   number (const mpz_t): The number to test for primality.
+ *   iterations (uint64_t): The number of iterations for the test (higher values
+ * increase accuracy), or IS_PRIME_BPSW plus a number of extra rounds.
+ *
+ * Returns:
+ *   true if the number is likely prime, false otherwise.
+ */
+bool is_prime(const mpz_t number, uint64_t iterations) {
+    return is_prime_r(number, iterations, NULL);
+}
+
+/**
+ * Performs the Miller-Rabin primality test, drawing bases from the given
+ * random state context instead of the global state. Numbers below
+ * SIEVE_LIMIT are looked up, larger ones are trial divided by one gcd with
+ * the product of the primes below TRIAL_LIMIT, then tested to base 2 (and
+ * the strong Lucas test with IS_PRIME_BPSW) before any random base is drawn.
+ * One Montgomery context is shared by every round.
  *
  * Args:
+ *   number (const mpz_t): The number to test for primality.
+ *   iterations (uint64_t): The number of iterations for the test, the base-2
+ * round included, or IS_PRIME_BPSW plus a number of extra random rounds.
+ *   rng (randstate_t*): The random state to draw bases from, or NULL for the
+ * global state.
+ *
+ * Returns:
+ *   true if the number is likely prime, false otherwise.
+ */
+bool is_prime_r(const mpz_t number, uint64_t iterations,
+                randstate_t *rng) {
+    numtheory_scratch_t scratch;
+    numtheory_scratch_init(&scratch, mpz_sizeinbase(number, 2));
+    bool prime = probable_prime(&scratch, number, iterations, rng, true);
+    numtheory_scratch_clear(&scratch);
+    return prime;
+}
+
+/**
+ * Tests a number like is_prime_r, with the temporaries of a scratch context.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The scratch context.
+ *   number (const mpz_t): The number to test for primality.
+ *   iterations (uint64_t): The number of iterations for the test, the base-2
+ * round included, or IS_PRIME_BPSW plus a number of extra random rounds.
+ *   rng (randstate_t*): The random state to draw bases from, or NULL for the
+ * global state.
+ *
+ * Returns:
+ *   true if the number is likely prime, false otherwise.
+ */
+bool is_prime_scratch(numtheory_scratch_t *scratch, const mpz_t number,
+                      uint64_t iterations, randstate_t *rng) {
+    return probable_prime(scratch, number, iterations, rng, true);
+}
+
+/**
+ * Generates a random prime by direct sampling. Used for sizes too small for
+ * the sieve.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The scratch context.
  *   prime (mpz_t): The output variable to store the generated prime number
- * (output). bit_size (uint64_t): The number of bits for the prime number.
+ * (output).
+ *   bit_size (uint64_t): The number of bits for the prime number.
  *   iterations (uint64_t): The number of iterations for the primality test.
+ *   rng (randstate_t*): The random state to draw candidates from, or NULL for
+ * the global state.
+ *   cancel (const atomic_bool*): Stops the search when set; may be NULL.
+ *
+ * Returns:
+ *   true if a prime was found, false if the search was cancelled.
  */
-void make_prime(mpz_t prime, uint64_t bit_size, uint64_t iterations) {
-    // Variables to calculate the lower bound and initialize the prime
-    mpz_t one, lower_bound;
-    mpz_init_set_ui(one, 1);
-    mpz_init(lower_bound);
-
+static bool make_small_prime(numtheory_scratch_t *scratch, mpz_t prime,
+                             uint64_t bit_size, uint64_t iterations,
+                             randstate_t *rng, const atomic_bool *cancel) {
     // Calculate the smallest number with the bit size: 2^(bit_size - 1)
-    mpz_mul_2exp(lower_bound, one, bit_size - 1);
+    mpz_ptr lower_bound = scratch->start;
+    mpz_set_ui(lower_bound, 0);
+    mpz_setbit(lower_bound, bit_size - 1);
     mpz_set_ui(prime, 0);
 
     // Generate random numbers until a prime is found
-    while (!is_prime(prime, iterations)) {
+    bool found = true;
+    while (!probable_prime(scratch, prime, iterations, rng, true)) {
+        if (cancel != NULL && atomic_load(cancel)) {
+            found = false;
+            break;
+        }
         mpz_urandomb(
-            prime, state,
+            prime, randstate_gmp(rng),
             bit_size);  // Generate a random number with 'bit_size' bits.
         mpz_add(prime, prime, lower_bound);  // Ensure the number is >=
                                              // lower_bound (bit_size bits).
+        stats_add(STATS_PRIME_CANDIDATES, 1);
     }
 
-    mpz_clears(one, lower_bound, (mpz_ptr)NULL);
-    return;
-}
\ No newline at end of file
+    stats_add(STATS_PRIMES_FOUND, found ? 1 : 0);
+    return found;
+}
+
+/**
+ * Generates a random prime number with a specified number of bits.
+ *
+ * Args:
+ *   prime (mpz_t): The output variable to store the generated prime number
+ * (output). bit_size (uint64_t): The number of bits for the prime number.
+ *   iterations (uint64_t): The number of iterations for the primality test.
+ */
+void make_prime(mpz_t prime, uint64_t bit_size, uint64_t iterations) {
+    make_prime_r(prime, bit_size, iterations, NULL, NULL);
+}
+
+/**
+ * Generates a random prime number with a specified number of bits, drawing
+ * from the given random state context. Safe to call from several threads at
+ * once as long as each uses its own context.
+ *
+ * Picks one random odd starting point with the top bit set and walks the odd
+ * numbers above it. The residue of the current candidate modulo every odd
+ * prime below SIEVE_LIMIT is kept up to date with one add per step, so
+ * candidates with a small factor are rejected without touching a bignum; only
+ * survivors go to Miller-Rabin. If the walk would overflow bit_size bits, a
+ * new starting point is drawn.
+ *
+ * Args:
+ *   prime (mpz_t): The output variable to store the generated prime number
+ * (output).
+ *   bit_size (uint64_t): The number of bits for the prime number.
+ *   iterations (uint64_t): The number of iterations for the primality test.
+ *   rng (randstate_t*): The random state to draw candidates from, or NULL for
+ * the global state.
+ *   cancel (const atomic_bool*): Checked before every Miller-Rabin test; the
+ * search gives up once it is set. May be NULL.
+ *
+ * Returns:
+ *   true if a prime was found, false if the search was cancelled.
+ */
+bool make_prime_r(mpz_t prime, uint64_t bit_size, uint64_t iterations,
+                  randstate_t *rng, const atomic_bool *cancel) {
+    numtheory_scratch_t scratch;
+    numtheory_scratch_init(&scratch, bit_size);
+    bool found =
+        make_prime_scratch(&scratch, prime, bit_size, iterations, rng, cancel);
+    numtheory_scratch_clear(&scratch);
+    return found;
+}
+
+/**
+ * Generates a random prime like make_prime_r, with the temporaries of a
+ * scratch context, so that generating many primes allocates nothing per
+ * candidate.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The scratch context.
+ *   prime (mpz_t): The output variable to store the generated prime number
+ * (output).
+ *   bit_size (uint64_t): The number of bits for the prime number.
+ *   iterations (uint64_t): The number of iterations for the primality test.
+ *   rng (randstate_t*): The random state to draw candidates from, or NULL for
+ * the global state.
+ *   cancel (const atomic_bool*): Checked before every Miller-Rabin test; the
+ * search gives up once it is set. May be NULL.
+ *
+ * Returns:
+ *   true if a prime was found, false if the search was cancelled.
+ */
+bool make_prime_scratch(numtheory_scratch_t *scratch, mpz_t prime,
+                        uint64_t bit_size, uint64_t iterations,
+                        randstate_t *rng, const atomic_bool *cancel) {
+    if (bit_size < SIEVE_MIN_BITS) {
+        return make_small_prime(scratch, prime, bit_size, iterations, rng,
+                                cancel);
+    }
+    uint32_t *residues = scratch->residues;
+    mpz_ptr start = scratch->start;
+    bool found = false;
+    while (!found) {
+        // Random odd starting point with exactly bit_size bits
+        mpz_urandomb(start, randstate_gmp(rng), bit_size);
+        mpz_setbit(start, bit_size - 1);
+        mpz_setbit(start, 0);
+        for (size_t i = 0; i < sieve_count; i++) {
+            residues[i] = (uint32_t)mpz_fdiv_ui(start, sieve_primes[i]);
+        }
+
+        // Walk start, start + 2, ... while the top bit stays put
+        for (unsigned long delta = 0;; delta += 2) {
+            bool survivor = true;
+            for (size_t i = 0; i < sieve_count; i++) {
+                if (residues[i] == 0) {
+                    survivor = false;
+                }
+                // Advance to the residue of the next odd candidate
+                residues[i] += 2;
+                if (residues[i] >= sieve_primes[i]) {
+                    residues[i] -= sieve_primes[i];
+                }
+            }
+            stats_add(STATS_PRIME_CANDIDATES, 1);
+            if (!survivor) {
+                stats_add(STATS_PRIME_SIEVE_REJECTED, 1);
+                continue;
+            }
+            if (cancel != NULL && atomic_load(cancel)) {
+                return false;
+            }
+            mpz_add_ui(prime, start, delta);
+            if (mpz_sizeinbase(prime, 2) != bit_size) {
+                break;  // Ran past 2^bit_size; draw a new start
+            }
+            if (probable_prime(scratch, prime, iterations, rng, false)) {
+                stats_add(STATS_PRIMES_FOUND, 1);
+                found = true;
+                break;
+            }
+        }
+    }
+    return true;
+}
@@ -1,18 +1,21 @@
 #ifndef NUMTHEORY_H
 #define NUMTHEORY_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <gmp.h>
 
 #include "randstate.h"
 
-// Extern declaration for the global random state
+// Extern declaration for the global random state used by the non-_r
+// functions; see randstate_t for the thread-safe alternative
 extern gmp_randstate_t state;
 
 /**
- * Computes the greatest common divisor (GCD) of two integers using the Euclidean algorithm.
+ * Computes the greatest common divisor (GCD) of two integers with GMP's subquadratic mpz_gcd.
  *
  * Args:
  *   gcd_result (mpz_t): The output variable to store the GCD (output).
@@ -22,7 +25,7 @@ extern gmp_randstate_t state;
 void gcd(mpz_t gcd_result, const mpz_t num1, const mpz_t num2);
 
 /**
- * Computes the modular inverse of a modulo n using the Extended Euclidean Algorithm.
+ * Computes the modular inverse of a modulo n using a subquadratic extended GCD (mpz_invert).
  * If the modular inverse does not exist, the output is set to 0.
  *
  * Args:
@@ -32,9 +35,135 @@ void gcd(mpz_t gcd_result, const mpz_t num1, const mpz_t num2);
  */
 void mod_inverse(mpz_t inverse, const mpz_t value, const mpz_t modulus);
 
+/**
+ * Computes lcm(num1, num2) and the inverse of value modulo it in one pass, without forming num1 * num2.
+ *
+ * Args:
+ *   inverse (mpz_t): The inverse of value modulo the lcm, or 0 if there is none (output).
+ *   lcm (mpz_t): The least common multiple of num1 and num2 (output).
+ *   value (const mpz_t): The value to invert.
+ *   num1 (const mpz_t): The first positive integer.
+ *   num2 (const mpz_t): The second positive integer.
+ */
+void lcm_mod_inverse(mpz_t inverse, mpz_t lcm, const mpz_t value, const mpz_t num1, const mpz_t num2);
+
+/**
+ * Reusable modular exponentiation state for one modulus.
+ *
+ * For odd moduli this holds the Montgomery constants (R = 2^(64 * limbs),
+ * -m^-1 mod 2^64 and R^2 mod m) plus all scratch limbs, so repeated
+ * exponentiations under the same modulus do no setup work. Even moduli fall
+ * back to division-based reduction. A context must not be shared between
+ * threads.
+ */
+typedef struct {
+    mpz_t modulus_z;        // the modulus
+    mpz_t reduced;          // scratch for conversions
+    bool odd;               // whether Montgomery reduction is used
+    mp_size_t limbs;        // n, the modulus size in limbs
+    mp_size_t capacity;     // the largest n limbs_buffer has room for
+    mp_limb_t limb_inverse; // -m^-1 mod 2^GMP_NUMB_BITS
+    mp_limb_t *limbs_buffer;// backing store for the arrays below
+    mp_limb_t *modulus;     // n limbs
+    mp_limb_t *r_squared;   // n limbs, R^2 mod m
+    mp_limb_t *one;         // n limbs, R mod m (1 in Montgomery form)
+    mp_limb_t *square;      // n limbs of scratch
+    mp_limb_t *result;      // n limbs of scratch
+    mp_limb_t *product;     // 2n limbs of scratch
+    mp_limb_t *table;       // sliding window odd powers
+    size_t table_entries;   // number of n-limb entries in table
+} pow_mod_ctx_t;
+
+// Widest window a schedule may pick
+#define POW_MOD_MAX_WINDOW 8
+
+/**
+ * Precomputed sliding-window recoding of a fixed exponent.
+ *
+ * Exponentiating by the same exponent many times (SS encryption raises every block to n) can reuse this instead of
+ * rescanning the exponent bits on every call. Step 0 loads table entry digits[0]; every later step squares
+ * squarings[i] times and multiplies by table entry digits[i]; tail squarings follow the last step.
+ */
+typedef struct {
+    unsigned width;       // window width; the table holds 2^(width-1) odd powers
+    size_t steps;         // number of windows
+    uint32_t *squarings;  // squarings before each window's multiplication
+    uint32_t *digits;     // table index of each window's odd power
+    uint32_t tail;        // squarings after the last window
+} pow_mod_schedule_t;
+
+/**
+ * Precomputes the sliding-window schedule for a fixed exponent, picking the window width with the fewest
+ * multiplications for this exact exponent.
+ *
+ * Args:
+ *   schedule (pow_mod_schedule_t*): The schedule to initialize (output).
+ *   exponent (const mpz_t): The non-negative exponent.
+ */
+void pow_mod_schedule_init(pow_mod_schedule_t *schedule, const mpz_t exponent);
+
+/**
+ * Frees the memory used by an exponent schedule.
+ *
+ * Args:
+ *   schedule (pow_mod_schedule_t*): The schedule to clear.
+ */
+void pow_mod_schedule_clear(pow_mod_schedule_t *schedule);
+
+/**
+ * Prepares a reusable exponentiation context for a modulus.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context to initialize (output).
+ *   modulus (const mpz_t): The positive modulus.
+ */
+void pow_mod_ctx_init(pow_mod_ctx_t *ctx, const mpz_t modulus);
+
+/**
+ * Frees the memory used by an exponentiation context.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context to clear.
+ */
+void pow_mod_ctx_clear(pow_mod_ctx_t *ctx);
+
+/**
+ * Computes (base^exponent) % modulus using a prepared context.
+ * Odd moduli use left-to-right sliding-window exponentiation with Montgomery multiplication and squaring.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context for the modulus.
+ *   result (mpz_t): The output variable to store the result (output).
+ *   base (const mpz_t): The base.
+ *   exponent (const mpz_t): The non-negative exponent.
+ */
+void pow_mod_ctx(pow_mod_ctx_t *ctx, mpz_t result, const mpz_t base, const mpz_t exponent);
+
+/**
+ * Computes (base^exponent) % modulus using a prepared context and a precomputed schedule for the exponent.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context for the modulus.
+ *   result (mpz_t): The output variable to store the result (output).
+ *   base (const mpz_t): The base.
+ *   schedule (const pow_mod_schedule_t*): The schedule of the exponent.
+ *   exponent (const mpz_t): The exponent the schedule was built from, used for even moduli.
+ */
+void pow_mod_ctx_schedule(pow_mod_ctx_t *ctx, mpz_t result, const mpz_t base, const pow_mod_schedule_t *schedule, const mpz_t exponent);
+
+/**
+ * Computes (value^2) % modulus using a prepared context.
+ *
+ * Args:
+ *   ctx (pow_mod_ctx_t*): The context for the modulus.
+ *   result (mpz_t): The output variable to store the result (output).
+ *   value (const mpz_t): The value to square.
+ */
+void sqr_mod(pow_mod_ctx_t *ctx, mpz_t result, const mpz_t value);
+
 /**
  * Computes (base^exponent) % modulus using modular exponentiation.
- * This implementation uses the right-to-left binary method for efficiency.
+ * Builds a one-off pow_mod_ctx_t; callers exponentiating repeatedly under the same modulus should use pow_mod_ctx.
  *
  * Args:
  *   result (mpz_t): The output variable to store the result (output).
@@ -44,18 +173,178 @@ void mod_inverse(mpz_t inverse, const mpz_t value, const mpz_t modulus);
  */
 void pow_mod(mpz_t result, const mpz_t base, const mpz_t exponent, const mpz_t modulus);
 
+// Bases pow_mod_lanes exponentiates in lockstep
+#define POW_MOD_LANES 8
+
+// Smallest group worth running through the vector kernel: it always pays for all POW_MOD_LANES lanes, which together
+// cost a little over two mpz_powm calls
+#define POW_MOD_LANES_MIN 3
+
+/**
+ * Multi-buffer exponentiation state for one fixed modulus and exponent, as when every block of a file is raised to n
+ * modulo n, or to dp modulo p.
+ *
+ * On CPUs with AVX-512 IFMA and odd moduli, up to POW_MOD_LANES bases are exponentiated together with an
+ * almost-Montgomery multiplication over 52-bit digits, one base per vector lane; the exponent is shared, so its
+ * sliding-window schedule is computed once here and replayed by every group. Otherwise every base goes through mpz_powm on its own. A context must not be shared
+ * between threads.
+ */
+typedef struct {
+    mpz_t modulus;
+    mpz_t exponent;
+    mpz_t scratch;            // reduced bases and results
+    bool vector;              // whether the IFMA kernel is used
+    size_t digits;            // 52-bit digits per value, with 4m < 2^(52 * digits)
+    pow_mod_schedule_t schedule; // sliding windows of the exponent, replayed for every group
+    uint64_t inverse;         // -m^-1 mod 2^52
+    uint64_t *buffer;         // 64-byte aligned backing store for the arrays below
+    uint64_t *modulus_digits; // digits words, shared by all lanes
+    uint64_t *r_squared;      // lane-sliced 2^(104 * digits) mod m
+    uint64_t *one;            // lane-sliced 1
+    uint64_t *base;           // lane-sliced bases
+    uint64_t *result;         // lane-sliced results
+    uint64_t *table;          // 2^(schedule.width - 1) lane-sliced odd powers of the bases
+    uint64_t *product;        // 2 * digits + 1 lane-sliced digits of kernel scratch
+} pow_mod_lanes_t;
+
+/**
+ * Prepares multi-buffer exponentiation for a modulus and exponent, picking the vector kernel when the CPU has it.
+ *
+ * Args:
+ *   ctx (pow_mod_lanes_t*): The context to initialize (output).
+ *   modulus (const mpz_t): The positive modulus.
+ *   exponent (const mpz_t): The non-negative exponent shared by every base.
+ */
+void pow_mod_lanes_init(pow_mod_lanes_t *ctx, const mpz_t modulus, const mpz_t exponent);
+
+/**
+ * Frees the memory used by a multi-buffer exponentiation context.
+ *
+ * Args:
+ *   ctx (pow_mod_lanes_t*): The context to clear.
+ */
+void pow_mod_lanes_clear(pow_mod_lanes_t *ctx);
+
+/**
+ * Zeroes the reduced bases, powers and results a multi-buffer context keeps from its last group, for contexts that
+ * exponentiate secrets.
+ *
+ * Args:
+ *   ctx (pow_mod_lanes_t*): The context to wipe.
+ */
+void pow_mod_lanes_wipe(pow_mod_lanes_t *ctx);
+
+/**
+ * Zeroes every limb of a bignum, up to the given size, and sets it to 0. The bignum keeps its allocation, so give the
+ * size it was initialized with (mpz_init2) to reach every limb a value held.
+ *
+ * Args:
+ *   value (mpz_t): The bignum to wipe.
+ *   bits (size_t): The bits to clear, at least the largest value it has held.
+ */
+void wipe_bignum(mpz_t value, size_t bits);
+
+/**
+ * Returns how many bases callers should hand pow_mod_lanes at a time: POW_MOD_LANES with the vector kernel, 1 when
+ * every base is exponentiated on its own anyway.
+ *
+ * Args:
+ *   ctx (const pow_mod_lanes_t*): The context.
+ *
+ * Returns:
+ *   The preferred group size.
+ */
+size_t pow_mod_lanes_width(const pow_mod_lanes_t *ctx);
+
+/**
+ * Computes results[i] = (bases[i]^exponent) % modulus for a group of bases. Groups of fewer than POW_MOD_LANES_MIN
+ * bases use mpz_powm.
+ *
+ * Args:
+ *   ctx (pow_mod_lanes_t*): The context for the modulus and exponent.
+ *   results (mpz_ptr*): The outputs; results[i] may be bases[i] (output).
+ *   bases (mpz_srcptr*): The non-negative bases.
+ *   count (size_t): The number of bases, at most POW_MOD_LANES.
+ */
+void pow_mod_lanes(pow_mod_lanes_t *ctx, mpz_ptr *results, const mpz_srcptr *bases, size_t count);
+
+// Set in the iterations argument of is_prime, is_prime_r and make_prime_r to run the Baillie-PSW test: a base-2
+// Miller-Rabin round and a strong Lucas test. The remaining bits give a number of extra random-base rounds, usually 0.
+#define IS_PRIME_BPSW ((uint64_t)1 << 63)
+
+/**
+ * Preallocated temporaries for the primality tests, prime generation and modular exponentiation, so that repeated
+ * calls reuse them instead of allocating their own every time. A scratch context must not be shared between threads.
+ */
+typedef struct {
+    mpz_t r;                  // odd part of number - 1
+    mpz_t base;               // Miller-Rabin base
+    mpz_t max_random;         // number - 4, the bound for random bases
+    mpz_t factor;             // gcd with the trial division product
+    mpz_t lucas[5];           // k, U, V, Q^k and scratch of the strong Lucas test
+    mpz_t start;              // make_prime walk start, or the smallest candidate
+    mp_limb_t *minus_one;     // number - 1 in Montgomery form
+    mp_size_t minus_one_limbs;// limbs minus_one has room for
+    uint32_t *residues;       // candidate residues modulo the sieve primes
+    pow_mod_ctx_t ctx;        // set to each number tested, its buffers kept
+} numtheory_scratch_t;
+
+/**
+ * Initializes a scratch context sized for numbers of about bit_size bits. Larger numbers still work; their temporaries grow once and are kept.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The context to initialize (output).
+ *   bit_size (uint64_t): The expected size of the numbers in bits.
+ */
+void numtheory_scratch_init(numtheory_scratch_t *scratch, uint64_t bit_size);
+
+/**
+ * Frees the memory used by a scratch context.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The context to clear.
+ */
+void numtheory_scratch_clear(numtheory_scratch_t *scratch);
+
+/**
+ * Computes (base^exponent) % modulus like pow_mod, reusing the exponentiation context of a scratch context.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The scratch context.
+ *   result (mpz_t): The output variable to store the result (output).
+ *   base (const mpz_t): The base.
+ *   exponent (const mpz_t): The exponent.
+ *   modulus (const mpz_t): The modulus.
+ */
+void pow_mod_scratch(numtheory_scratch_t *scratch, mpz_t result, const mpz_t base, const mpz_t exponent, const mpz_t modulus);
+
 /**
  * Performs the Miller-Rabin primality test to determine if a number is prime.
  *
  * Args:
  *   number (const mpz_t): The number to test for primality.
- *   iterations (uint64_t): The number of iterations for the test (higher values increase accuracy).
+ *   iterations (uint64_t): The number of iterations for the test (higher values increase accuracy), or IS_PRIME_BPSW plus a number of extra rounds.
  *
  * Returns:
  *   true if the number is likely prime, false otherwise.
  */
 bool is_prime(const mpz_t number, uint64_t iterations);
 
+/**
+ * Performs the Miller-Rabin primality test, drawing bases from the given random state context instead of the global
+ * state. Thread-safe as long as each thread uses its own context. Small factors are ruled out by trial division and
+ * base 2 is always tried first, so composites rarely cost more than one exponentiation.
+ *
+ * Args:
+ *   number (const mpz_t): The number to test for primality.
+ *   iterations (uint64_t): The number of iterations for the test, the base-2 round included, or IS_PRIME_BPSW plus a number of extra random rounds.
+ *   rng (randstate_t*): The random state to draw bases from, or NULL for the global state.
+ *
+ * Returns:
+ *   true if the number is likely prime, false otherwise.
+ */
+bool is_prime_r(const mpz_t number, uint64_t iterations, randstate_t *rng);
+
 /**
  * Generates a random prime number with a specified number of bits.
  *
@@ -66,4 +355,51 @@ bool is_prime(const mpz_t number, uint64_t iterations);
  */
 void make_prime(mpz_t prime, uint64_t bit_size, uint64_t iterations);
 
+/**
+ * Generates a random prime number with a specified number of bits, drawing from the given random state context.
+ * Safe to call from several threads at once as long as each uses its own context.
+ *
+ * Args:
+ *   prime (mpz_t): The output variable to store the generated prime number (output).
+ *   bit_size (uint64_t): The number of bits for the prime number.
+ *   iterations (uint64_t): The number of iterations for the primality test.
+ *   rng (randstate_t*): The random state to draw candidates from, or NULL for the global state.
+ *   cancel (const atomic_bool*): The search gives up once this is set; may be NULL.
+ *
+ * Returns:
+ *   true if a prime was found, false if the search was cancelled.
+ */
+bool make_prime_r(mpz_t prime, uint64_t bit_size, uint64_t iterations, randstate_t *rng, const atomic_bool *cancel);
+
+/**
+ * Tests a number like is_prime_r, with the temporaries of a scratch context.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The scratch context.
+ *   number (const mpz_t): The number to test for primality.
+ *   iterations (uint64_t): The number of iterations for the test, the base-2 round included, or IS_PRIME_BPSW plus a number of extra random rounds.
+ *   rng (randstate_t*): The random state to draw bases from, or NULL for the global state.
+ *
+ * Returns:
+ *   true if the number is likely prime, false otherwise.
+ */
+bool is_prime_scratch(numtheory_scratch_t *scratch, const mpz_t number, uint64_t iterations, randstate_t *rng);
+
+/**
+ * Generates a random prime like make_prime_r, with the temporaries of a scratch context, so that generating many primes
+ * allocates nothing per candidate.
+ *
+ * Args:
+ *   scratch (numtheory_scratch_t*): The scratch context.
+ *   prime (mpz_t): The output variable to store the generated prime number (output).
+ *   bit_size (uint64_t): The number of bits for the prime number.
+ *   iterations (uint64_t): The number of iterations for the primality test.
+ *   rng (randstate_t*): The random state to draw candidates from, or NULL for the global state.
+ *   cancel (const atomic_bool*): The search gives up once this is set; may be NULL.
+ *
+ * Returns:
+ *   true if a prime was found, false if the search was cancelled.
+ */
+bool make_prime_scratch(numtheory_scratch_t *scratch, mpz_t prime, uint64_t bit_size, uint64_t iterations, randstate_t *rng, const atomic_bool *cancel);
+
 #endif // NUMTHEORY_H
\ No newline at end of file
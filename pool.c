@@ -0,0 +1,456 @@
+#define _GNU_SOURCE  // CPU sets, thread affinity and sched_getcpu
+
+#include "pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Where sysfs lists the NUMA nodes and the CPUs of each
+#define POOL_NODE_ROOT "/sys/devices/system/node"
+
+typedef struct {
+    // Unclaimed tasks [next, end) of the current run, packed so the owner
+    // claiming from the front and thieves splitting off the back both
+    // update it with a single compare-and-swap. Kept on its own cache line.
+    _Alignas(64) atomic_uint_fast64_t range;
+    pool_t *pool;
+    pthread_t thread;
+    size_t id;        // worker index passed to tasks; the caller is 0
+    size_t node;      // NUMA node it runs on, 0 when unknown
+    size_t *victims;  // the other workers in steal order, same node first
+} pool_worker_t;
+
+struct pool {
+    size_t threads;
+    pool_worker_t *workers;
+    size_t *victims;  // storage behind every worker's victims
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;  // signalled when a new job is posted
+    pthread_cond_t work_done;   // signalled when the last worker leaves a job
+
+    // Current job, identified by generation
+    pool_task_fn fn;
+    void *arg;
+    size_t base;  // index of the job's first task; the ranges count from it
+    atomic_bool cancelled;
+    uint64_t generation;
+    size_t active;  // workers still inside the current job
+    bool stopping;
+};
+
+// CPUs the process may run on, grouped by NUMA node
+typedef struct {
+    size_t count;
+    int cpus[CPU_SETSIZE];
+    size_t nodes[CPU_SETSIZE];  // node of cpus[i], numbered densely from 0
+    size_t node_count;
+} topology_t;
+
+static atomic_int default_affinity = POOL_AFFINITY_NONE;
+
+static uint64_t range_pack(uint32_t next, uint32_t end) {
+    return (uint64_t)end << 32 | next;
+}
+
+static uint32_t range_next(uint64_t range) { return (uint32_t)range; }
+
+static uint32_t range_end(uint64_t range) { return (uint32_t)(range >> 32); }
+
+//
+// Claims the next task from the worker's own range.
+//
+static bool claim(pool_t *pool, pool_worker_t *self, size_t *index) {
+    uint64_t range = atomic_load(&self->range);
+    while (!atomic_load_explicit(&pool->cancelled, memory_order_relaxed)) {
+        uint32_t next = range_next(range);
+        uint32_t end = range_end(range);
+        if (next >= end) {
+            break;
+        }
+        if (atomic_compare_exchange_weak(&self->range, &range,
+                                         range_pack(next + 1, end))) {
+            *index = next;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Takes the back half of the first victim with work left, keeping its first
+// task to run now and the rest as this worker's new range. Gives up once a
+// whole pass finds every range empty; an owner always finishes its own
+// range, so a task missed by a racing pass still runs.
+//
+static bool steal(pool_t *pool, pool_worker_t *self, size_t *index) {
+    bool busy = true;
+    while (busy &&
+           !atomic_load_explicit(&pool->cancelled, memory_order_relaxed)) {
+        busy = false;
+        for (size_t i = 0; i + 1 < pool->threads; i++) {
+            pool_worker_t *victim = &pool->workers[self->victims[i]];
+            uint64_t range = atomic_load(&victim->range);
+            while (range_next(range) < range_end(range)) {
+                busy = true;
+                uint32_t next = range_next(range);
+                uint32_t end = range_end(range);
+                uint32_t middle = next + (end - next) / 2;
+                if (atomic_compare_exchange_weak(&victim->range, &range,
+                                                 range_pack(next, middle))) {
+                    atomic_store(&self->range, range_pack(middle + 1, end));
+                    *index = middle;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+//
+// Runs tasks of the current job, first its own and then stolen ones, until
+// none are left anywhere.
+//
+static void drain(pool_t *pool, size_t worker) {
+    pool_worker_t *self = &pool->workers[worker];
+    size_t index = 0;
+    while (claim(pool, self, &index) || steal(pool, self, &index)) {
+        pool->fn(pool->arg, pool->base + index, worker);
+    }
+}
+
+static void *worker_main(void *data) {
+    pool_worker_t *worker = data;
+    pool_t *pool = worker->pool;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->stopping && pool->generation == seen) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->stopping) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        drain(pool, worker->id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+//
+// Parses a sysfs list such as "0-3,8-11" into set. Returns false if the file
+// cannot be read.
+//
+static bool read_cpu_list(const char *path, cpu_set_t *set) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    CPU_ZERO(set);
+    unsigned first = 0;
+    unsigned last = 0;
+    while (fscanf(file, "%u", &first) == 1) {
+        last = first;
+        int separator = fgetc(file);
+        if (separator == '-') {
+            if (fscanf(file, "%u", &last) != 1) {
+                break;
+            }
+            separator = fgetc(file);
+        }
+        for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (separator != ',') {
+            break;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+//
+// Lists the CPUs this process may run on, node by node. Without a readable
+// NUMA topology every CPU is put on node 0.
+//
+static void read_topology(topology_t *topology) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+    }
+    topology->count = 0;
+    topology->node_count = 0;
+
+    cpu_set_t online;
+    if (read_cpu_list(POOL_NODE_ROOT "/online", &online)) {
+        for (int node = 0; node < CPU_SETSIZE; node++) {
+            char path[64];
+            cpu_set_t cpus;
+            snprintf(path, sizeof(path), POOL_NODE_ROOT "/node%d/cpulist",
+                     node);
+            if (!CPU_ISSET(node, &online) || !read_cpu_list(path, &cpus)) {
+                continue;
+            }
+            size_t found = topology->count;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &cpus) && CPU_ISSET(cpu, &allowed)) {
+                    CPU_CLR(cpu, &allowed);  // listed under this node only
+                    topology->cpus[topology->count] = cpu;
+                    topology->nodes[topology->count++] = topology->node_count;
+                }
+            }
+            if (topology->count > found) {
+                topology->node_count++;
+            }
+        }
+    }
+
+    // Whatever no node claimed, which is everything without sysfs
+    size_t unplaced = topology->count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            topology->cpus[topology->count] = cpu;
+            topology->nodes[topology->count++] = 0;
+        }
+    }
+    if (topology->node_count == 0 && topology->count > unplaced) {
+        topology->node_count = 1;
+    }
+}
+
+//
+// Chooses the CPUs and node of every worker under the given policy, starting
+// from where the caller, worker 0, runs now. Returns false if placement is
+// off or the topology is unknown, leaving every worker unpinned on node 0.
+//
+static bool place_workers(pool_t *pool, pool_affinity_t affinity,
+                          cpu_set_t *sets) {
+    if (affinity == POOL_AFFINITY_NONE) {
+        return false;
+    }
+    topology_t *topology = malloc(sizeof(topology_t));
+    if (topology == NULL) {
+        return false;
+    }
+    read_topology(topology);
+    if (topology->count == 0) {
+        free(topology);
+        return false;
+    }
+
+    size_t start = 0;
+    int current = sched_getcpu();
+    for (size_t i = 0; i < topology->count; i++) {
+        if (topology->cpus[i] == current) {
+            start = i;
+        }
+    }
+    for (size_t i = 0; i < pool->threads; i++) {
+        CPU_ZERO(&sets[i]);
+        if (affinity == POOL_AFFINITY_CPU) {
+            size_t slot = (start + i) % topology->count;
+            CPU_SET(topology->cpus[slot], &sets[i]);
+            pool->workers[i].node = topology->nodes[slot];
+        } else {
+            size_t node =
+                (topology->nodes[start] + i) % topology->node_count;
+            for (size_t j = 0; j < topology->count; j++) {
+                if (topology->nodes[j] == node) {
+                    CPU_SET(topology->cpus[j], &sets[i]);
+                }
+            }
+            pool->workers[i].node = node;
+        }
+    }
+    free(topology);
+    return true;
+}
+
+//
+// Orders every worker's victims: workers on the same node first, then the
+// rest, each group starting after the worker itself so thieves spread out.
+//
+static void order_victims(pool_t *pool) {
+    for (size_t i = 0; i < pool->threads; i++) {
+        pool_worker_t *worker = &pool->workers[i];
+        worker->victims = &pool->victims[i * (pool->threads - 1)];
+        size_t count = 0;
+        for (int local = 1; local >= 0; local--) {
+            for (size_t k = 1; k < pool->threads; k++) {
+                size_t victim = (i + k) % pool->threads;
+                if ((pool->workers[victim].node == worker->node) == local) {
+                    worker->victims[count++] = victim;
+                }
+            }
+        }
+    }
+}
+
+void pool_set_affinity(pool_affinity_t affinity) {
+    atomic_store(&default_affinity, (int)affinity);
+}
+
+bool pool_parse_affinity(const char *name, pool_affinity_t *affinity) {
+    if (strcmp(name, "none") == 0) {
+        *affinity = POOL_AFFINITY_NONE;
+    } else if (strcmp(name, "cpu") == 0) {
+        *affinity = POOL_AFFINITY_CPU;
+    } else if (strcmp(name, "numa") == 0) {
+        *affinity = POOL_AFFINITY_NUMA;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+pool_t *pool_create(size_t threads) {
+    pool_t *pool = calloc(1, sizeof(pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->threads = threads == 0 ? 1 : threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    atomic_init(&pool->cancelled, false);
+
+    pool->workers =
+        aligned_alloc(64, pool->threads * sizeof(pool_worker_t));
+    // One spare entry, so a single-thread pool never asks for zero bytes
+    pool->victims =
+        malloc((pool->threads * (pool->threads - 1) + 1) * sizeof(size_t));
+    cpu_set_t *sets = malloc(pool->threads * sizeof(cpu_set_t));
+    if (pool->workers == NULL || pool->victims == NULL || sets == NULL) {
+        free(pool->workers);
+        free(pool->victims);
+        free(sets);
+        free(pool);
+        return NULL;
+    }
+    memset(pool->workers, 0, pool->threads * sizeof(pool_worker_t));
+    for (size_t i = 0; i < pool->threads; i++) {
+        atomic_init(&pool->workers[i].range, range_pack(0, 0));
+    }
+    bool pinned =
+        place_workers(pool, (pool_affinity_t)atomic_load(&default_affinity),
+                      sets);
+
+    for (size_t i = 1; i < pool->threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        // Pinned from the start, so the stack is touched on its node
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (pinned) {
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &sets[i]);
+        }
+        int created = pthread_create(&pool->workers[i].thread, &attr,
+                                     worker_main, &pool->workers[i]);
+        pthread_attr_destroy(&attr);
+        if (created != 0 && pinned) {
+            // The CPU may have gone offline; run the worker unpinned
+            created = pthread_create(&pool->workers[i].thread, NULL,
+                                     worker_main, &pool->workers[i]);
+        }
+        if (created != 0) {
+            // Run with however many workers could be started
+            pool->threads = i;
+            break;
+        }
+    }
+    free(sets);
+    order_victims(pool);
+    return pool;
+}
+
+size_t pool_threads(const pool_t *pool) { return pool->threads; }
+
+void pool_run(pool_t *pool, size_t count, pool_task_fn fn, void *arg) {
+    if (pool == NULL) {
+        for (size_t i = 0; i < count; i++) {
+            fn(arg, i, 0);
+        }
+        return;
+    }
+    atomic_store(&pool->cancelled, false);
+    if (pool->threads == 1 || count <= 1) {
+        for (size_t i = 0; i < count && !atomic_load(&pool->cancelled); i++) {
+            fn(arg, i, 0);
+        }
+        return;
+    }
+
+    // Ranges index tasks in 32 bits, so huge jobs run in several goes
+    for (size_t base = 0; base < count && !atomic_load(&pool->cancelled);
+         base += UINT32_MAX) {
+        size_t part = count - base < UINT32_MAX ? count - base : UINT32_MAX;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->fn = fn;
+        pool->arg = arg;
+        pool->base = base;
+        // Contiguous shares, so neighbouring tasks stay on one thread
+        for (size_t i = 0; i < pool->threads; i++) {
+            atomic_store(&pool->workers[i].range,
+                         range_pack((uint32_t)(part * i / pool->threads),
+                                    (uint32_t)(part * (i + 1) /
+                                               pool->threads)));
+        }
+        pool->active = pool->threads - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->work_ready);
+        pthread_mutex_unlock(&pool->lock);
+
+        // The caller pulls tasks too instead of sitting idle
+        drain(pool, 0);
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->active != 0) {
+            pthread_cond_wait(&pool->work_done, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+bool pool_cancel(pool_t *pool) {
+    return pool != NULL && !atomic_exchange(&pool->cancelled, true);
+}
+
+const atomic_bool *pool_cancelled(const pool_t *pool) {
+    return pool == NULL ? NULL : &pool->cancelled;
+}
+
+void pool_destroy(pool_t *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 1; i < pool->threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool->victims);
+    free(pool);
+}
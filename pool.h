@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//
+// Fixed-size worker pool used to spread independent bignum tasks (one per
+// block, candidate, etc.) across threads. Each run starts every thread on
+// its own contiguous share of the tasks. A thread that runs out steals half
+// of what another has left, trying threads on its own NUMA node first, so
+// uneven tasks such as prime searches still keep every thread busy.
+//
+typedef struct pool pool_t;
+
+// Where pool worker threads run
+typedef enum {
+    POOL_AFFINITY_NONE,  // wherever the scheduler puts them
+    POOL_AFFINITY_CPU,   // each pinned to its own CPU, in CPU order from the caller's
+    POOL_AFFINITY_NUMA,  // spread round-robin across NUMA nodes, each free within its node
+} pool_affinity_t;
+
+//
+// Task callback: invoked once for every index in [0, count) of a pool_run.
+//
+// arg:    the shared argument passed to pool_run.
+// index:  the index of the task to run.
+// worker: the index in [0, pool_threads) of the thread running the task, so
+//         tasks can use per-thread scratch space. The caller is worker 0.
+//
+typedef void (*pool_task_fn)(void *arg, size_t index, size_t worker);
+
+//
+// Sets where the workers of pools created from now on run, for the whole
+// process. The calling thread is never moved. The default is
+// POOL_AFFINITY_NONE.
+//
+// affinity: the placement policy.
+//
+void pool_set_affinity(pool_affinity_t affinity);
+
+//
+// Parses a placement policy name for the -a option: "none", "cpu" or
+// "numa".
+//
+// name:     the name to parse.
+// affinity: the policy (output).
+//
+// Returns false if name is not a policy.
+//
+bool pool_parse_affinity(const char *name, pool_affinity_t *affinity);
+
+//
+// Creates a pool with the given number of threads. The calling thread counts
+// as one of them, so threads - 1 workers are spawned, placed as set by
+// pool_set_affinity.
+//
+// threads: the total number of threads to use (0 is treated as 1).
+//
+// Returns a pointer to the new pool, or NULL on failure.
+//
+pool_t *pool_create(size_t threads);
+
+//
+// Returns the number of threads (including the caller) used by the pool.
+//
+size_t pool_threads(const pool_t *pool);
+
+//
+// Runs fn(arg, i) for every i in [0, count) across the pool and blocks until
+// all of them have finished or the run is cancelled. Tasks may run in any
+// order. A NULL pool runs every task on the calling thread.
+//
+void pool_run(pool_t *pool, size_t count, pool_task_fn fn, void *arg);
+
+//
+// Cancels the current pool_run: tasks not yet started are skipped, and
+// running ones can stop early by polling pool_cancelled. Meant to be called
+// from a task; the next pool_run starts uncancelled.
+//
+// pool: the pool running the tasks.
+//
+// Returns true for the call that cancelled the run, false if it already was.
+//
+bool pool_cancel(pool_t *pool);
+
+//
+// Returns the flag pool_cancel sets for the current run, for long tasks to
+// poll, or NULL for a NULL pool, which cannot be cancelled.
+//
+const atomic_bool *pool_cancelled(const pool_t *pool);
+
+//
+// Stops the workers and frees the pool. Does nothing for a NULL pool.
+//
+void pool_destroy(pool_t *pool);
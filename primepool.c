@@ -0,0 +1,282 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "numtheory.h"
+#include "pool.h"
+#include "primepool.h"
+#include "randstate.h"
+
+// Primes generated between two appends by ss_prime_pool_fill, per thread
+#define FILL_BATCH_PER_THREAD 4
+
+static bool add_entry(ss_prime_pool_t *pool, uint64_t bits, off_t offset) {
+    if (pool->count == pool->capacity) {
+        size_t capacity = pool->capacity == 0 ? 64 : 2 * pool->capacity;
+        ss_prime_pool_entry_t *entries = (ss_prime_pool_entry_t *)realloc(
+            pool->entries, capacity * sizeof(ss_prime_pool_entry_t));
+        if (entries == NULL) {
+            return false;
+        }
+        pool->entries = entries;
+        pool->capacity = capacity;
+    }
+    pool->entries[pool->count].bits = bits;
+    pool->entries[pool->count].offset = offset;
+    pool->count++;
+    return true;
+}
+
+// Rewrites the record at offset as used, with every digit up to end turned
+// into a zero, so the file no longer holds the prime
+static bool erase_record(FILE *file, off_t offset, off_t end, uint64_t bits) {
+    if (fseeko(file, offset, SEEK_SET) != 0 ||
+        fprintf(file, "%c %llu ", SS_PRIME_POOL_USED,
+                (unsigned long long)bits) < 0) {
+        return false;
+    }
+    for (off_t position = ftello(file); position < end; position++) {
+        if (fputc('0', file) == EOF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ss_prime_pool_open(ss_prime_pool_t *pool, const char *path) {
+    memset(pool, 0, sizeof(*pool));
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return false;
+    }
+    pool->file = fdopen(fd, "r+");
+    if (pool->file == NULL) {
+        close(fd);
+        return false;
+    }
+
+    // Index the available records; used ones are skipped, after erasing any
+    // prime left in them by an older version. An unterminated last record is
+    // an append cut short by a crash, and is dropped.
+    char *line = NULL;
+    size_t size = 0;
+    bool ok = true;
+    bool erased = false;
+    off_t offset = ftello(pool->file);
+    ssize_t length = 0;
+    while (ok && (length = getline(&line, &size, pool->file)) > 0) {
+        if (line[length - 1] != '\n') {
+            ok = fflush(pool->file) == 0 &&
+                 ftruncate(fileno(pool->file), offset) == 0;
+            break;
+        }
+        char flag = 0;
+        unsigned long long bits = 0;
+        int digits = 0;
+        ok = sscanf(line, "%c %llu %n", &flag, &bits, &digits) == 2 &&
+             digits > 0 &&
+             (flag == SS_PRIME_POOL_AVAILABLE || flag == SS_PRIME_POOL_USED);
+        if (ok && flag == SS_PRIME_POOL_AVAILABLE) {
+            ok = add_entry(pool, bits, offset);
+        } else if (ok && strspn(&line[digits], "0") <
+                             (size_t)(length - 1 - digits)) {
+            ok = erase_record(pool->file, offset, offset + length - 1, bits) &&
+                 fseeko(pool->file, offset + length, SEEK_SET) == 0;
+            erased = true;
+        }
+        offset += length;
+    }
+    free(line);
+    ok = ok && (!erased || (fflush(pool->file) == 0 &&
+                            fdatasync(fileno(pool->file)) == 0));
+    if (!ok) {
+        ss_prime_pool_close(pool);
+    }
+    return ok;
+}
+
+void ss_prime_pool_close(ss_prime_pool_t *pool) {
+    if (pool->file != NULL) {
+        fflush(pool->file);
+        fdatasync(fileno(pool->file));
+        flock(fileno(pool->file), LOCK_UN);
+        fclose(pool->file);
+    }
+    free(pool->entries);
+    memset(pool, 0, sizeof(*pool));
+}
+
+size_t ss_prime_pool_available(const ss_prime_pool_t *pool, uint64_t bits) {
+    size_t available = 0;
+    for (size_t i = 0; i < pool->count; i++) {
+        available += pool->entries[i].bits == bits;
+    }
+    return available;
+}
+
+bool ss_prime_pool_take(ss_prime_pool_t *pool, mpz_t prime, uint64_t bits) {
+    // Newest first, so a fill in progress does not starve older records
+    size_t index = pool->count;
+    for (size_t i = pool->count; i-- > 0;) {
+        if (pool->entries[i].bits == bits) {
+            index = i;
+            break;
+        }
+    }
+    if (index == pool->count) {
+        return false;
+    }
+    off_t offset = pool->entries[index].offset;
+    pool->entries[index] = pool->entries[--pool->count];
+
+    // Read the prime, then mark it used, erase its digits and make that
+    // durable before the caller ever sees it
+    char flag = 0;
+    unsigned long long stored_bits = 0;
+    if (fseeko(pool->file, offset, SEEK_SET) != 0 ||
+        gmp_fscanf(pool->file, "%c %llu %Zx", &flag, &stored_bits, prime) !=
+            3 ||
+        flag != SS_PRIME_POOL_AVAILABLE || stored_bits != bits ||
+        mpz_sizeinbase(prime, 2) != bits) {
+        return false;
+    }
+    off_t end = ftello(pool->file);
+    if (end < 0 || !erase_record(pool->file, offset, end, bits) ||
+        fflush(pool->file) != 0 || fdatasync(fileno(pool->file)) != 0) {
+        return false;
+    }
+    return true;
+}
+
+bool ss_prime_pool_add(ss_prime_pool_t *pool, const mpz_t prime) {
+    uint64_t bits = mpz_sizeinbase(prime, 2);
+    if (fseeko(pool->file, 0, SEEK_END) != 0) {
+        return false;
+    }
+    off_t offset = ftello(pool->file);
+    if (gmp_fprintf(pool->file, "%c %llu %Zx\n", SS_PRIME_POOL_AVAILABLE,
+                    (unsigned long long)bits, prime) < 0 ||
+        fflush(pool->file) != 0) {
+        return false;
+    }
+    return add_entry(pool, bits, offset);
+}
+
+// Shared state for one batch of pool primes
+typedef struct {
+    randstate_t *rngs;    // one per worker
+    uint64_t *sizes;      // bit length per task
+    mpz_t *primes;        // prime per task (output)
+    uint64_t iterations;
+} fill_batch_t;
+
+static void fill_task(void *arg, size_t index, size_t worker) {
+    fill_batch_t *batch = arg;
+    make_prime_r(batch->primes[index], batch->sizes[index], batch->iterations,
+                 &batch->rngs[worker], NULL);
+}
+
+ptrdiff_t ss_prime_pool_fill(const char *path, uint64_t min_bits,
+                             uint64_t max_bits, size_t depth,
+                             uint64_t iterations, size_t threads,
+                             randstate_t *rng) {
+    if (max_bits < min_bits) {
+        return 0;
+    }
+
+    // Work out what is missing, then let go of the lock while generating
+    ss_prime_pool_t pool;
+    if (!ss_prime_pool_open(&pool, path)) {
+        return -1;
+    }
+    size_t wanted = 0;
+    size_t slots = (size_t)(max_bits - min_bits + 1);
+    uint64_t *missing = (uint64_t *)calloc(slots, sizeof(uint64_t));
+    if (missing == NULL) {
+        ss_prime_pool_close(&pool);
+        return -1;
+    }
+    for (size_t i = 0; i < slots; i++) {
+        size_t available = ss_prime_pool_available(&pool, min_bits + i);
+        missing[i] = available < depth ? depth - available : 0;
+        wanted += missing[i];
+    }
+    ss_prime_pool_close(&pool);
+
+    pool_t *workers = threads > 1 ? pool_create(threads) : NULL;
+    size_t worker_count = workers != NULL ? pool_threads(workers) : 1;
+    size_t batch_size = worker_count * FILL_BATCH_PER_THREAD;
+    fill_batch_t batch;
+    batch.rngs = (randstate_t *)malloc(worker_count * sizeof(randstate_t));
+    batch.sizes = (uint64_t *)malloc(batch_size * sizeof(uint64_t));
+    batch.primes = (mpz_t *)malloc(batch_size * sizeof(mpz_t));
+    if (batch.rngs == NULL || batch.sizes == NULL || batch.primes == NULL) {
+        free(batch.rngs);
+        free(batch.sizes);
+        free(batch.primes);
+        free(missing);
+        pool_destroy(workers);
+        return -1;
+    }
+    batch.iterations = iterations;
+    for (size_t i = 0; i < worker_count; i++) {
+        randstate_split_r(&batch.rngs[i], rng);
+    }
+    for (size_t i = 0; i < batch_size; i++) {
+        mpz_init(batch.primes[i]);
+    }
+
+    ptrdiff_t added = 0;
+    size_t next = 0;  // first size that may still be missing primes
+    while ((size_t)added < wanted) {
+        size_t count = 0;
+        while (count < batch_size && next < slots) {
+            if (missing[next] == 0) {
+                next++;
+                continue;
+            }
+            batch.sizes[count++] = min_bits + next;
+            missing[next]--;
+        }
+        pool_run(workers, count, fill_task, &batch);
+
+        if (!ss_prime_pool_open(&pool, path)) {
+            added = -1;
+            break;
+        }
+        bool ok = true;
+        for (size_t i = 0; i < count && ok; i++) {
+            ok = ss_prime_pool_add(&pool, batch.primes[i]);
+        }
+        ss_prime_pool_close(&pool);
+        if (!ok) {
+            added = -1;
+            break;
+        }
+        added += (ptrdiff_t)count;
+    }
+
+    for (size_t i = 0; i < batch_size; i++) {
+        mpz_clear(batch.primes[i]);
+    }
+    for (size_t i = 0; i < worker_count; i++) {
+        randstate_clear_r(&batch.rngs[i]);
+    }
+    free(batch.rngs);
+    free(batch.sizes);
+    free(batch.primes);
+    free(missing);
+    pool_destroy(workers);
+    return added;
+}
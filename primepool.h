@@ -0,0 +1,122 @@
+#ifndef SS_PRIMEPOOL_H
+#define SS_PRIMEPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <gmp.h>
+
+#include "randstate.h"
+
+// Record flags. A pool file is a text file with one "<flag> <bits> <hex>"
+// line per prime; drawing a prime overwrites its flag and turns its digits
+// into zeros in place, so a prime is handed out at most once even across
+// crashes and the file never keeps a prime that is in a key.
+#define SS_PRIME_POOL_AVAILABLE 'A'
+#define SS_PRIME_POOL_USED      'U'
+
+// One available prime in the pool file
+typedef struct {
+    uint64_t bits;  // bit length of the prime
+    off_t offset;   // start of its record
+} ss_prime_pool_entry_t;
+
+/**
+ * An open prime pool. The file is locked exclusively from
+ * ss_prime_pool_open to ss_prime_pool_close, so concurrent keygens never
+ * draw the same prime; keep it open only while generating a key.
+ */
+typedef struct {
+    FILE *file;
+    ss_prime_pool_entry_t *entries;  // available primes only
+    size_t count;
+    size_t capacity;
+} ss_prime_pool_t;
+
+/**
+ * Opens a prime pool file, creating it (owner-only) if it does not exist,
+ * locks it and indexes the available primes. Used records still holding
+ * their digits are erased, and an unterminated last record, left by a crash
+ * while adding, is truncated away.
+ *
+ * Args:
+ *   pool (ss_prime_pool_t*): The pool to open (output).
+ *   path (const char*): The pool file.
+ *
+ * Returns:
+ *   true on success, false if the file cannot be opened or is malformed.
+ */
+bool ss_prime_pool_open(ss_prime_pool_t *pool, const char *path);
+
+/**
+ * Syncs, unlocks and closes a prime pool.
+ *
+ * Args:
+ *   pool (ss_prime_pool_t*): The pool to close.
+ */
+void ss_prime_pool_close(ss_prime_pool_t *pool);
+
+/**
+ * Counts the available primes of one bit length.
+ *
+ * Args:
+ *   pool (const ss_prime_pool_t*): The open pool.
+ *   bits (uint64_t): The bit length.
+ *
+ * Returns:
+ *   The number of primes of that size that have not been drawn.
+ */
+size_t ss_prime_pool_available(const ss_prime_pool_t *pool, uint64_t bits);
+
+/**
+ * Draws a prime of the given bit length and marks it used, erasing its
+ * digits, on disk before returning it.
+ *
+ * Args:
+ *   pool (ss_prime_pool_t*): The open pool.
+ *   prime (mpz_t): The prime drawn (output, initialized).
+ *   bits (uint64_t): The bit length wanted.
+ *
+ * Returns:
+ *   true if a prime was drawn, false if none of that size is left or the
+ * record could not be marked.
+ */
+bool ss_prime_pool_take(ss_prime_pool_t *pool, mpz_t prime, uint64_t bits);
+
+/**
+ * Appends an available prime to the pool.
+ *
+ * Args:
+ *   pool (ss_prime_pool_t*): The open pool.
+ *   prime (const mpz_t): The prime to add.
+ *
+ * Returns:
+ *   true on success, false if the write failed.
+ */
+bool ss_prime_pool_add(ss_prime_pool_t *pool, const mpz_t prime);
+
+/**
+ * Tops up a pool file until every bit length in [min_bits, max_bits] has at
+ * least depth available primes. Primes are generated in batches on threads
+ * with the pool unlocked and appended under the lock after each batch, so a
+ * long fill can run in the background while keygens keep drawing.
+ *
+ * Args:
+ *   path (const char*): The pool file.
+ *   min_bits (uint64_t): The smallest bit length to stock.
+ *   max_bits (uint64_t): The largest bit length to stock.
+ *   depth (size_t): The number of primes wanted per bit length.
+ *   iterations (uint64_t): The primality test iterations, as for make_prime_r.
+ *   threads (size_t): The number of threads to generate with.
+ *   rng (randstate_t*): The random state to split worker states from.
+ *
+ * Returns:
+ *   The number of primes added, or -1 if the pool file cannot be used or
+ *   memory runs out.
+ */
+ptrdiff_t ss_prime_pool_fill(const char *path, uint64_t min_bits, uint64_t max_bits, size_t depth,
+                             uint64_t iterations, size_t threads, randstate_t *rng);
+
+#endif
@@ -1,15 +1,46 @@
-
 #include <gmp.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+
+#include "randstate.h"
+
 extern gmp_randstate_t state;
 
 void randstate_init(uint64_t seed) {
-    srandom(seed);  // Initialize the C library's random number generator
     gmp_randinit_mt(state);        // Initialize the GMP random state to use the
                                    // Mersenne Twister algorithm.
     gmp_randseed_ui(state, seed);  // Set the initial seed for the GMP random
                                    // state using an unsigned integer.
 }
 void randstate_clear(void) { gmp_randclear(state); }
+
+void randstate_init_r(randstate_t *rng, uint64_t seed) {
+    gmp_randinit_mt(rng->gmp);
+    gmp_randseed_ui(rng->gmp, seed);
+}
+
+void randstate_split_r(randstate_t *child, randstate_t *parent) {
+    // A 128-bit seed drawn from the parent keeps sibling streams apart
+    mpz_t seed;
+    mpz_init(seed);
+    mpz_urandomb(seed, randstate_gmp(parent), 128);
+    gmp_randinit_mt(child->gmp);
+    gmp_randseed(child->gmp, seed);
+    mpz_clear(seed);
+}
+
+void randstate_clear_r(randstate_t *rng) { gmp_randclear(rng->gmp); }
+
+__gmp_randstate_struct *randstate_gmp(randstate_t *rng) {
+    return rng == NULL ? state : rng->gmp;
+}
+
+uint64_t randstate_uniform(randstate_t *rng, uint64_t bound) {
+    mpz_t value;
+    mpz_init_set_ui(value, (unsigned long)bound);
+    mpz_urandomm(value, randstate_gmp(rng), value);
+    uint64_t result = mpz_get_ui(value);
+    mpz_clear(value);
+    return result;
+}
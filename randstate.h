@@ -6,6 +6,16 @@
 
 extern gmp_randstate_t state;
 
+//
+// Random state context for SS key generation. Each thread that generates
+// keys or tests primes should own one; a context must never be used by two
+// threads at once. Functions taking a randstate_t * accept NULL to mean the
+// global state, which keeps single-threaded callers of the old API working.
+//
+typedef struct {
+    gmp_randstate_t gmp;  // Mersenne Twister state
+} randstate_t;
+
 //
 // Initializes the random state needed for SS key generation operations.
 // Must be called before any key generation or number theory operations are
@@ -20,3 +30,37 @@ void randstate_init(uint64_t seed);
 // Must be called after all key generation or number theory operations are used.
 //
 void randstate_clear(void);
+
+//
+// Initializes a random state context.
+//
+// rng:  the context to initialize.
+// seed: the seed to seed the context with.
+//
+void randstate_init_r(randstate_t *rng, uint64_t seed);
+
+//
+// Initializes child as an independent random state seeded from parent, for
+// handing to another thread. Advances parent.
+//
+// child:  the context to initialize.
+// parent: the context to seed it from, or NULL for the global state.
+//
+void randstate_split_r(randstate_t *child, randstate_t *parent);
+
+//
+// Frees any memory used by a random state context.
+//
+void randstate_clear_r(randstate_t *rng);
+
+//
+// Returns the GMP random state behind rng, or the global state for NULL, for
+// passing to mpz_urandomb and friends.
+//
+__gmp_randstate_struct *randstate_gmp(randstate_t *rng);
+
+//
+// Returns a uniformly distributed integer in [0, bound). bound must be
+// non-zero.
+//
+uint64_t randstate_uniform(randstate_t *rng, uint64_t bound);
@@ -0,0 +1,66 @@
+#include "ring.h"
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+struct ring {
+    void **items;
+    size_t capacity;
+    size_t head;       // next slot to pop; only touched by the consumer
+    size_t tail;       // next slot to push; only touched by the producer
+    sem_t free_slots;  // posted by the consumer, awaited by the producer
+    sem_t used_slots;  // posted by the producer, awaited by the consumer
+};
+
+// Waits on a semaphore, retrying when a signal interrupts the wait
+static void wait_slot(sem_t *semaphore) {
+    while (sem_wait(semaphore) != 0 && errno == EINTR) {
+    }
+}
+
+ring_t *ring_create(size_t capacity) {
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    ring_t *ring = (ring_t *)calloc(1, sizeof(ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->items = (void **)calloc(capacity, sizeof(void *));
+    if (ring->items == NULL) {
+        free(ring);
+        return NULL;
+    }
+    ring->capacity = capacity;
+    sem_init(&ring->free_slots, 0, (unsigned)capacity);
+    sem_init(&ring->used_slots, 0, 0);
+    return ring;
+}
+
+void ring_push(ring_t *ring, void *item) {
+    // The semaphores order the slot write before the consumer's read
+    wait_slot(&ring->free_slots);
+    ring->items[ring->tail] = item;
+    ring->tail = (ring->tail + 1) % ring->capacity;
+    sem_post(&ring->used_slots);
+}
+
+void *ring_pop(ring_t *ring) {
+    wait_slot(&ring->used_slots);
+    void *item = ring->items[ring->head];
+    ring->head = (ring->head + 1) % ring->capacity;
+    sem_post(&ring->free_slots);
+    return item;
+}
+
+void ring_destroy(ring_t *ring) {
+    if (ring == NULL) {
+        return;
+    }
+    sem_destroy(&ring->free_slots);
+    sem_destroy(&ring->used_slots);
+    free(ring->items);
+    free(ring);
+}
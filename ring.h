@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+
+//
+// Bounded single-producer, single-consumer queue of pointers, used to hand
+// batches between the stages of a pipeline. Each end owns its own index, so
+// pushing and popping take no lock; a pair of semaphores only puts a stage
+// to sleep while the ring is full or empty. Exactly one thread may push and
+// one thread may pop.
+//
+typedef struct ring ring_t;
+
+//
+// Creates a ring holding up to capacity items.
+//
+// capacity: the maximum number of queued items (0 is treated as 1).
+//
+// Returns a pointer to the new ring, or NULL on failure.
+//
+ring_t *ring_create(size_t capacity);
+
+//
+// Appends an item, waiting while the ring is full.
+//
+void ring_push(ring_t *ring, void *item);
+
+//
+// Removes the oldest item, waiting while the ring is empty.
+//
+void *ring_pop(ring_t *ring);
+
+//
+// Frees the ring. Items still queued are not touched. Does nothing for a
+// NULL ring.
+//
+void ring_destroy(ring_t *ring);
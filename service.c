@@ -0,0 +1,212 @@
+#include "service.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Fills a sockaddr_un for path, failing if the path does not fit
+static bool socket_address(struct sockaddr_un *address, const char *path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+// Writes all of data, retrying short writes and interrupted calls
+static bool write_all(int fd, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+// Reads exactly length bytes, failing on end of stream
+static bool read_all(int fd, uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t got = read(fd, data, length);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (got == 0) {
+            return false;
+        }
+        data += got;
+        length -= (size_t)got;
+    }
+    return true;
+}
+
+int ss_service_listen(const char *path) {
+    struct sockaddr_un address;
+    if (!socket_address(&address, path)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path);  // A previous daemon may have left its socket behind
+
+    // Keys are behind this socket, so only the owner may connect
+    mode_t mask = umask(0077);
+    int bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+    umask(mask);
+    if (bound != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int ss_service_connect(const char *path) {
+    struct sockaddr_un address;
+    if (!socket_address(&address, path)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool ss_service_send(int fd, uint8_t code, const uint8_t *data,
+                     size_t length) {
+    uint8_t header[SS_SERVICE_HEADER_SIZE];
+    header[0] = code;
+    uint64_t value = length;
+    for (int i = 8; i >= 1; i--) {
+        header[i] = (uint8_t)value;
+        value >>= 8;
+    }
+    return write_all(fd, header, sizeof(header)) &&
+           write_all(fd, data, length);
+}
+
+bool ss_service_recv(int fd, uint8_t *code, uint8_t **data, size_t *length) {
+    uint8_t header[SS_SERVICE_HEADER_SIZE];
+    if (!read_all(fd, header, sizeof(header))) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (int i = 1; i <= 8; i++) {
+        value = (value << 8) | header[i];
+    }
+    if (value > SS_SERVICE_MAX_PAYLOAD) {
+        return false;
+    }
+
+    // Always allocate at least one byte so an empty payload is not NULL
+    uint8_t *payload = (uint8_t *)malloc(value == 0 ? 1 : (size_t)value);
+    if (payload == NULL || !read_all(fd, payload, (size_t)value)) {
+        free(payload);
+        return false;
+    }
+    *code = header[0];
+    *data = payload;
+    *length = (size_t)value;
+    return true;
+}
+
+bool ss_service_call(int fd, uint8_t op, const uint8_t *data, size_t length,
+                     uint8_t **reply, size_t *reply_length) {
+    uint8_t status = SS_SERVICE_ERROR;
+    *reply = NULL;
+    *reply_length = 0;
+    if (!ss_service_send(fd, op, data, length) ||
+        !ss_service_recv(fd, &status, reply, reply_length)) {
+        return false;
+    }
+    return status == SS_SERVICE_OK;
+}
+
+bool ss_service_file(const char *path, uint8_t op, FILE *infile,
+                     FILE *outfile, char *error, size_t error_size) {
+    // Slurp the input, reading one byte past SS_SERVICE_MAX_PAYLOAD so an
+    // oversized request is refused before connecting
+    size_t capacity = 1 << 16;
+    size_t length = 0;
+    uint8_t *data = (uint8_t *)malloc(capacity);
+    if (data == NULL) {
+        snprintf(error, error_size, "Out of memory reading the input");
+        return false;
+    }
+    size_t got = 0;
+    while (length <= SS_SERVICE_MAX_PAYLOAD &&
+           (got = fread(&data[length], 1, capacity - length, infile)) > 0) {
+        length += got;
+        if (length == capacity && length <= SS_SERVICE_MAX_PAYLOAD) {
+            size_t grown_capacity = capacity * 2 > SS_SERVICE_MAX_PAYLOAD
+                                        ? (size_t)SS_SERVICE_MAX_PAYLOAD + 1
+                                        : capacity * 2;
+            uint8_t *grown = (uint8_t *)realloc(data, grown_capacity);
+            if (grown == NULL) {
+                snprintf(error, error_size, "Out of memory reading the input");
+                free(data);
+                return false;
+            }
+            data = grown;
+            capacity = grown_capacity;
+        }
+    }
+    if (ferror(infile)) {
+        snprintf(error, error_size, "Cannot read the input");
+        free(data);
+        return false;
+    }
+    if (length > SS_SERVICE_MAX_PAYLOAD) {
+        snprintf(error, error_size,
+                 "Input is larger than the service limit of %llu bytes",
+                 (unsigned long long)SS_SERVICE_MAX_PAYLOAD);
+        free(data);
+        return false;
+    }
+
+    int fd = ss_service_connect(path);
+    if (fd < 0) {
+        snprintf(error, error_size, "Cannot connect to service at %s", path);
+        free(data);
+        return false;
+    }
+    uint8_t *reply = NULL;
+    size_t reply_length = 0;
+    bool ok = ss_service_call(fd, op, data, length, &reply, &reply_length);
+    close(fd);
+    free(data);
+
+    if (ok) {
+        fwrite(reply, 1, reply_length, outfile);
+    } else if (reply != NULL) {
+        snprintf(error, error_size, "%.*s", (int)reply_length,
+                 (const char *)reply);
+    } else {
+        snprintf(error, error_size, "Connection to service at %s lost", path);
+    }
+    free(reply);
+    return ok;
+}
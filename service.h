@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//
+// Wire protocol of the ssd key service. Every message, in either direction,
+// is one code byte, a 64-bit big-endian payload length, then the payload.
+// A client sends one request per operation and may send several over one
+// connection; the service answers each with SS_SERVICE_OK and the output, or
+// SS_SERVICE_ERROR and a message.
+//
+#define SS_SERVICE_ENCRYPT_HEX    'E'  // plaintext in, hex ciphertext out
+#define SS_SERVICE_ENCRYPT_BINARY 'B'  // plaintext in, binary container out
+#define SS_SERVICE_ENCRYPT_HYBRID 'H'  // plaintext in, hybrid container out
+#define SS_SERVICE_DECRYPT        'D'  // hex, binary or hybrid ciphertext in, plaintext out
+
+#define SS_SERVICE_OK    0
+#define SS_SERVICE_ERROR 1
+
+#define SS_SERVICE_HEADER_SIZE 9
+
+// Largest payload accepted from the other end
+#define SS_SERVICE_MAX_PAYLOAD ((uint64_t)1 << 30)
+
+//
+// Creates a Unix socket listening at path, replacing any stale socket file.
+// The socket is only accessible to its owner.
+//
+// path: the filesystem path of the socket.
+//
+// Returns the listening descriptor, or -1 on failure.
+//
+int ss_service_listen(const char *path);
+
+//
+// Connects to a service listening at path.
+//
+// path: the filesystem path of the socket.
+//
+// Returns the connected descriptor, or -1 on failure.
+//
+int ss_service_connect(const char *path);
+
+//
+// Sends one message.
+//
+// fd:     the connected socket.
+// code:   the operation or status byte.
+// data:   the payload.
+// length: the payload size in bytes.
+//
+// Returns true if the whole message was written.
+//
+bool ss_service_send(int fd, uint8_t code, const uint8_t *data, size_t length);
+
+//
+// Receives one message. The payload is allocated with malloc and owned by
+// the caller.
+//
+// fd:     the connected socket.
+// code:   the operation or status byte (output).
+// data:   the payload (output).
+// length: the payload size in bytes (output).
+//
+// Returns true if a whole message was read, false on end of stream, a read
+// error or an oversized payload.
+//
+bool ss_service_recv(int fd, uint8_t *code, uint8_t **data, size_t *length);
+
+//
+// Sends a request and waits for its reply.
+//
+// fd:           the connected socket.
+// op:           the SS_SERVICE_* operation.
+// data:         the request payload.
+// length:       the request payload size in bytes.
+// reply:        the reply payload, allocated with malloc (output).
+// reply_length: the reply payload size in bytes (output).
+//
+// Returns true if the service answered SS_SERVICE_OK, false on an error
+// reply (reply then holds the message) or a broken connection.
+//
+bool ss_service_call(int fd, uint8_t op, const uint8_t *data, size_t length,
+                     uint8_t **reply, size_t *reply_length);
+
+//
+// Runs one service operation over whole files: reads infile to the end,
+// sends it to the service at path and writes the reply to outfile. Input
+// over SS_SERVICE_MAX_PAYLOAD is refused before connecting.
+//
+// path:       the filesystem path of the socket.
+// op:         the SS_SERVICE_* operation.
+// infile:     the input to send.
+// outfile:    where the output is written.
+// error:      a buffer for a NUL-terminated error message (output).
+// error_size: the size of the error buffer.
+//
+// Returns true on success, false with error filled in otherwise.
+//
+bool ss_service_file(const char *path, uint8_t op, FILE *infile,
+                     FILE *outfile, char *error, size_t error_size);
@@ -1,25 +1,112 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <gmp.h>
 
+#include "codec.h"
+#include "container.h"
+#include "hybrid.h"
+#include "keyfile.h"
 #include "numtheory.h"
+#include "pool.h"
+#include "primepool.h"
+#include "randstate.h"
+#include "ring.h"
+#include "ss.h"
+#include "stats.h"
+
+// Blocks handed to each thread per batch in the parallel file modes
+#define SS_BLOCKS_PER_THREAD 16
+
+// Blocks of the first recipient per thread in each batch of a multi-recipient
+// encryption. A recipient with another block size ends every batch mid-block
+// and mid-group, costing it one single-block encryption and one short group;
+// large batches keep that to a fraction of a percent.
+#define SS_MULTI_BLOCKS_PER_THREAD 1024
+
+// Shared state for a parallel race to find one prime
+typedef struct {
+    randstate_t *rngs;     // independently seeded random state per task
+    mpz_t *candidates;     // result slot per task
+    uint64_t bit_size;
+    uint64_t iterations;
+    pool_t *pool;          // running the race
+    atomic_size_t winner;  // index of the first task to find a prime
+} prime_search_t;
+
+static void prime_search_task(void *arg, size_t index, size_t worker) {
+    (void)worker;
+    prime_search_t *search = arg;
+    // The winner cancels the run, which stops the other searches
+    if (make_prime_r(search->candidates[index], search->bit_size,
+                     search->iterations, &search->rngs[index],
+                     pool_cancelled(search->pool)) &&
+        pool_cancel(search->pool)) {
+        atomic_store(&search->winner, index);
+    }
+}
 
 /**
- * Generates a public key (n) for the S-S cryptosystem.
+ * Finds one prime: from the prime pool when one is given and has a prime of
+ * that size, otherwise directly with rng or, when a pool is given, by racing
+ * an independent search per pool thread; the first thread to succeed
+ * cancels the rest.
  *
  * Args:
- *   prime_p (mpz_t): The first prime factor (output).
- *   prime_q (mpz_t): The second prime factor (output).
- *   modulus_n (mpz_t): The public key modulus (output).
- *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   prime (mpz_t): The prime found (output).
+ *   bit_size (uint64_t): The number of bits for the prime number.
  *   iterations (uint64_t): Number of iterations for primality testing.
+ *   rng (randstate_t*): The random state for the single-threaded search.
+ *   pool (pool_t*): The worker pool, or NULL to search on this thread.
+ *   search (prime_search_t*): The race state when pool is set.
+ *   primes (ss_prime_pool_t*): The prime pool to draw from first, or NULL.
  */
-void ss_make_pub(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n,
-                 uint64_t total_bits, uint64_t iterations) {
-    mpz_inits(prime_p, prime_q, modulus_n, NULL);
+static void find_prime(mpz_t prime, uint64_t bit_size, uint64_t iterations,
+                       randstate_t *rng, pool_t *pool, prime_search_t *search,
+                       ss_prime_pool_t *primes) {
+    if (primes != NULL) {
+        if (ss_prime_pool_take(primes, prime, bit_size)) {
+            stats_add(STATS_PRIME_POOL_HITS, 1);
+            return;
+        }
+        stats_add(STATS_PRIME_POOL_MISSES, 1);
+    }
+    if (pool == NULL) {
+        make_prime_r(prime, bit_size, iterations, rng, NULL);
+        return;
+    }
+    search->bit_size = bit_size;
+    pool_run(pool, pool_threads(pool), prime_search_task, search);
+    mpz_set(prime, search->candidates[atomic_load(&search->winner)]);
+}
 
+/**
+ * Runs the p, q retry loop of public key generation.
+ *
+ * Args:
+ *   prime_p (mpz_t): The first prime factor (output, initialized).
+ *   prime_q (mpz_t): The second prime factor (output, initialized).
+ *   modulus_n (mpz_t): The public key modulus (output, initialized).
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   iterations (uint64_t): Number of iterations for primality testing.
+ *   rng (randstate_t*): The random state for bit sizes and serial searches.
+ *   pool (pool_t*): The worker pool for parallel searches, or NULL.
+ *   search (prime_search_t*): The race state when pool is set.
+ *   primes (ss_prime_pool_t*): The prime pool to draw from first, or NULL.
+ */
+static void make_pub(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n,
+                     uint64_t total_bits, uint64_t iterations,
+                     randstate_t *rng, pool_t *pool, prime_search_t *search,
+                     ss_prime_pool_t *primes) {
     // Determine the range for p's bit size
     uint64_t min_p_bits = total_bits / 5;
     uint64_t max_p_bits = (2 * total_bits) / 5;
@@ -29,11 +116,15 @@ void ss_make_pub(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n,
     mpz_inits(squared_p, p_minus1, q_minus1, mod_check1, mod_check2, NULL);
 
     while (true) {
+        stats_add(STATS_MAKE_PUB_ATTEMPTS, 1);
+
         // Randomly determine bit size for p within range
-        prime_p_bits = rand() % (max_p_bits - min_p_bits + 1) + min_p_bits;
+        prime_p_bits =
+            randstate_uniform(rng, max_p_bits - min_p_bits + 1) + min_p_bits;
 
         // Generate prime p
-        make_prime(prime_p, prime_p_bits, iterations);
+        find_prime(prime_p, prime_p_bits, iterations, rng, pool, search,
+                   primes);
         mpz_mul(squared_p, prime_p, prime_p);
 
         // Calculate the bit size of squared_p
@@ -41,7 +132,8 @@ void ss_make_pub(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n,
         uint64_t prime_q_bits = total_bits - squared_p_bits;
 
         // Generate prime q
-        make_prime(prime_q, prime_q_bits, iterations);
+        find_prime(prime_q, prime_q_bits, iterations, rng, pool, search,
+                   primes);
 
         // Check if p and q satisfy the conditions
         mpz_sub_ui(p_minus1, prime_p, 1);
@@ -57,8 +149,138 @@ void ss_make_pub(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n,
     mpz_mul(modulus_n, modulus_n, prime_q);
 
     mpz_clears(squared_p, p_minus1, q_minus1, mod_check1, mod_check2, NULL);
+}
 
-    return;
+/**
+ * Generates a public key (n) for the S-S cryptosystem.
+ *
+ * Args:
+ *   prime_p (mpz_t): The first prime factor (output).
+ *   prime_q (mpz_t): The second prime factor (output).
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   iterations (uint64_t): Number of iterations for primality testing.
+ */
+void ss_make_pub(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n,
+                 uint64_t total_bits, uint64_t iterations) {
+    ss_make_pub_r(prime_p, prime_q, modulus_n, total_bits, iterations, NULL);
+}
+
+/**
+ * Generates a public key (n) for the S-S cryptosystem, drawing all
+ * randomness from the given random state context.
+ *
+ * Args:
+ *   prime_p (mpz_t): The first prime factor (output).
+ *   prime_q (mpz_t): The second prime factor (output).
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   iterations (uint64_t): Number of iterations for primality testing.
+ *   rng (randstate_t*): The random state, or NULL for the global state.
+ */
+void ss_make_pub_r(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n,
+                   uint64_t total_bits, uint64_t iterations,
+                   randstate_t *rng) {
+    mpz_inits(prime_p, prime_q, modulus_n, NULL);
+    make_pub(prime_p, prime_q, modulus_n, total_bits, iterations, rng, NULL,
+             NULL, NULL);
+}
+
+/**
+ * Generates a public key (n) like ss_make_pub_r, searching for each prime on
+ * several threads at once. Every thread walks its own candidates with its
+ * own random state, split from rng, and the first prime found wins. Which
+ * thread wins depends on scheduling, so the key is not reproducible from the
+ * seed when threads > 1.
+ *
+ * Args:
+ *   prime_p (mpz_t): The first prime factor (output).
+ *   prime_q (mpz_t): The second prime factor (output).
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   iterations (uint64_t): Number of iterations for primality testing.
+ *   threads (size_t): The number of threads to search with.
+ *   rng (randstate_t*): The random state, or NULL for the global state.
+ */
+void ss_make_pub_parallel(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n,
+                          uint64_t total_bits, uint64_t iterations,
+                          size_t threads, randstate_t *rng) {
+    ss_make_pub_pooled(prime_p, prime_q, modulus_n, total_bits, iterations,
+                       threads, rng, NULL);
+}
+
+/**
+ * Generates a public key (n) like ss_make_pub_parallel, drawing p and q from
+ * a prime pool when it holds primes of the sizes wanted and searching only
+ * for the ones it does not. Drawn primes are marked used even if the pair is
+ * rejected, so no prime ever ends up in two keys.
+ *
+ * Args:
+ *   prime_p (mpz_t): The first prime factor (output).
+ *   prime_q (mpz_t): The second prime factor (output).
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   iterations (uint64_t): Number of iterations for primality testing.
+ *   threads (size_t): The number of threads to search with.
+ *   rng (randstate_t*): The random state, or NULL for the global state.
+ *   primes (ss_prime_pool_t*): The open prime pool, or NULL to always search.
+ */
+void ss_make_pub_pooled(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n,
+                        uint64_t total_bits, uint64_t iterations,
+                        size_t threads, randstate_t *rng,
+                        ss_prime_pool_t *primes) {
+    mpz_inits(prime_p, prime_q, modulus_n, NULL);
+    pool_t *pool = threads > 1 ? pool_create(threads) : NULL;
+    if (pool == NULL) {
+        make_pub(prime_p, prime_q, modulus_n, total_bits, iterations, rng,
+                 NULL, NULL, primes);
+        return;
+    }
+
+    // Independent per-thread random states, split from the caller's
+    size_t tasks = pool_threads(pool);
+    prime_search_t search;
+    search.rngs = (randstate_t *)malloc(tasks * sizeof(randstate_t));
+    search.candidates = (mpz_t *)malloc(tasks * sizeof(mpz_t));
+    search.iterations = iterations;
+    search.pool = pool;
+    atomic_init(&search.winner, 0);
+    for (size_t i = 0; i < tasks; i++) {
+        randstate_split_r(&search.rngs[i], rng);
+        mpz_init(search.candidates[i]);
+    }
+
+    make_pub(prime_p, prime_q, modulus_n, total_bits, iterations, rng, pool,
+             &search, primes);
+
+    for (size_t i = 0; i < tasks; i++) {
+        randstate_clear_r(&search.rngs[i]);
+        mpz_clear(search.candidates[i]);
+    }
+    free(search.rngs);
+    free(search.candidates);
+    pool_destroy(pool);
+}
+
+/**
+ * Computes the range of prime sizes ss_make_pub can ask for: p takes
+ * total_bits / 5 to 2 * total_bits / 5 bits and q whatever p^2 leaves.
+ *
+ * Args:
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   min_bits (uint64_t*): The smallest prime size (output).
+ *   max_bits (uint64_t*): The largest prime size (output).
+ */
+void ss_make_pub_prime_range(uint64_t total_bits, uint64_t *min_bits,
+                             uint64_t *max_bits) {
+    uint64_t min_p_bits = total_bits / 5;
+    uint64_t max_p_bits = (2 * total_bits) / 5;
+
+    // p^2 has 2b - 1 or 2b bits, so q has total - 2b or total - 2b + 1
+    uint64_t min_q_bits = total_bits - 2 * max_p_bits;
+    uint64_t max_q_bits = total_bits - 2 * min_p_bits + 1;
+    *min_bits = min_p_bits < min_q_bits ? min_p_bits : min_q_bits;
+    *max_bits = max_p_bits > max_q_bits ? max_p_bits : max_q_bits;
 }
 
 /**
@@ -74,26 +296,21 @@ void ss_make_priv(mpz_t private_key_d, mpz_t modulus_pq, const mpz_t prime_p,
                   const mpz_t prime_q) {
     mpz_inits(private_key_d, modulus_pq, NULL);
 
-    mpz_t n, lambda, gcd_value;
-    mpz_inits(lambda, gcd_value, n, NULL);
+    mpz_t n, lambda;
+    mpz_inits(lambda, n, NULL);
 
     // Compute modulus_pq = p * q
     mpz_mul(modulus_pq, prime_p, prime_q);
     mpz_mul(n, modulus_pq, prime_p);
 
-    // Compute λ(n) = lcm(p-1, q-1)
+    // Compute λ(n) = lcm(p-1, q-1) and d = n^(-1) mod λ(n) together
     mpz_t p_minus1, q_minus1;
     mpz_inits(p_minus1, q_minus1, NULL);
     mpz_sub_ui(p_minus1, prime_p, 1);
     mpz_sub_ui(q_minus1, prime_q, 1);
-    mpz_mul(lambda, p_minus1, q_minus1);
-    gcd(gcd_value, p_minus1, q_minus1);
-    mpz_divexact(lambda, lambda, gcd_value);
+    lcm_mod_inverse(private_key_d, lambda, n, p_minus1, q_minus1);
 
-    // Compute d = n^(-1) mod λ(n)
-    mod_inverse(private_key_d, n, lambda);
-
-    mpz_clears(n, lambda, gcd_value, p_minus1, q_minus1, NULL);
+    mpz_clears(n, lambda, p_minus1, q_minus1, NULL);
 
     return;
 }
@@ -124,15 +341,58 @@ void ss_write_priv(const mpz_t modulus_pq, const mpz_t private_key_d,
 }
 
 /**
- * Reads the public key from a file.
+ * Reads the public key from a file, hex or binary. The username never overruns
+ * its SS_USERNAME_SIZE bytes.
  *
  * Args:
  *   modulus_n (mpz_t): The public key modulus (output).
- *   username (char[]): The associated username (output).
+ *   username (char[]): The associated username, of SS_USERNAME_SIZE bytes (output).
  *   pbfile (FILE*): The file to read the public key from.
  */
 void ss_read_pub(mpz_t modulus_n, char username[], FILE *pbfile) {
-    gmp_fscanf(pbfile, "%Zx\n%s\n", modulus_n, username);
+    ss_read_pub_key(modulus_n, username, SS_USERNAME_SIZE, pbfile);
+}
+
+/**
+ * Reads a public key written by ss_write_pub or ss_keyfile_write_pub, telling
+ * the two apart by the leading magic. At most username_size - 1 bytes of the
+ * username are stored.
+ *
+ * Args:
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   username (char*): The associated username, NUL-terminated (output).
+ *   username_size (size_t): The size of the username buffer, at least 1.
+ *   pbfile (FILE*): The file to read the public key from.
+ *
+ * Returns:
+ *   true if the key was read, false if the file is malformed or the username
+ *   does not fit.
+ */
+bool ss_read_pub_key(mpz_t modulus_n, char *username, size_t username_size,
+                     FILE *pbfile) {
+    if (ss_keyfile_detect(pbfile)) {
+        return ss_keyfile_read_pub(modulus_n, username, username_size, pbfile);
+    }
+    username[0] = '\0';
+    if (gmp_fscanf(pbfile, "%Zx", modulus_n) != 1) {
+        return false;
+    }
+    // Same token as the old "%s", but never past the buffer
+    int c;
+    do {
+        c = getc(pbfile);
+    } while (c != EOF && isspace(c));
+    size_t length = 0;
+    while (c != EOF && !isspace(c)) {
+        if (length + 1 == username_size) {
+            username[length] = '\0';
+            return false;
+        }
+        username[length++] = (char)c;
+        c = getc(pbfile);
+    }
+    username[length] = '\0';
+    return true;
 }
 
 /**
@@ -148,68 +408,137 @@ void ss_read_priv(mpz_t modulus_pq, mpz_t private_key_d, FILE *pvfile) {
 }
 
 /**
- * Encrypts a message using the public key.
+ * Initializes every field of a private key and marks it as non-CRT.
  *
  * Args:
- *   ciphertext (mpz_t): The encrypted message (output).
- *   plaintext (const mpz_t): The plaintext message.
- *   modulus_n (const mpz_t): The public key modulus.
+ *   key (ss_priv_key_t*): The key to initialize.
  */
-void ss_encrypt(mpz_t ciphertext, const mpz_t plaintext,
-                const mpz_t modulus_n) {
-    mpz_powm(ciphertext, plaintext, modulus_n, modulus_n);
+void ss_priv_key_init(ss_priv_key_t *key) {
+    mpz_inits(key->modulus_pq, key->private_key_d, key->prime_p, key->prime_q,
+              key->d_mod_p1, key->d_mod_q1, key->q_inv_p, NULL);
+    key->has_crt = false;
+    key->meta = (ss_key_meta_t){ 0 };
 }
 
 /**
- * Encrypts the contents of an input file and writes them to an output file
- * using the public key.
+ * Frees the memory used by a private key.
  *
  * Args:
- *   infile (FILE*): The file containing the plaintext messages.
- *   outfile (FILE*): The file to write the encrypted messages to.
- *   modulus_n (const mpz_t): The public key modulus.
+ *   key (ss_priv_key_t*): The key to clear.
  */
-void ss_encrypt_file(FILE *infile, FILE *outfile, const mpz_t modulus_n) {
-    // Determine block size based on the square root of modulus_n
-    mpz_t sqrt_modulus;
-    mpz_init(sqrt_modulus);
-    mpz_sqrt(sqrt_modulus, modulus_n);
-
-    uint16_t block_size = 0;
-    while (mpz_cmp_ui(sqrt_modulus, 0) != 0) {
-        mpz_div_ui(sqrt_modulus, sqrt_modulus, 2);
-        block_size++;
-    }
-    block_size--;
-    block_size /= 8;
+void ss_priv_key_clear(ss_priv_key_t *key) {
+    mpz_clears(key->modulus_pq, key->private_key_d, key->prime_p, key->prime_q,
+               key->d_mod_p1, key->d_mod_q1, key->q_inv_p, NULL);
+    key->has_crt = false;
+    key->meta = (ss_key_meta_t){ 0 };
+}
 
-    while (true) {
-        uint8_t *plaintext_block =
-            (uint8_t *)calloc(block_size, sizeof(uint8_t));
-        plaintext_block[0] = 0xFF;  // Padding byte
+/**
+ * Fills in a private key and precomputes its CRT values from p and q.
+ *
+ * Args:
+ *   key (ss_priv_key_t*): The initialized key to fill in (output).
+ *   modulus_pq (const mpz_t): The product of the primes p and q.
+ *   private_key_d (const mpz_t): The private key.
+ *   prime_p (const mpz_t): The first prime factor.
+ *   prime_q (const mpz_t): The second prime factor.
+ */
+void ss_priv_key_set_crt(ss_priv_key_t *key, const mpz_t modulus_pq,
+                         const mpz_t private_key_d, const mpz_t prime_p,
+                         const mpz_t prime_q) {
+    mpz_set(key->modulus_pq, modulus_pq);
+    mpz_set(key->private_key_d, private_key_d);
+    mpz_set(key->prime_p, prime_p);
+    mpz_set(key->prime_q, prime_q);
 
-        // Read a block of data from the input file
-        uint16_t bytes_read = fread(&(plaintext_block[1]), sizeof(uint8_t),
-                                    block_size - 1, infile);
-        if (bytes_read == 0) {
-            free(plaintext_block);
-            break;  // End of file
-        }
+    // d mod (p - 1) and d mod (q - 1), by Fermat's little theorem
+    mpz_sub_ui(key->d_mod_p1, prime_p, 1);
+    mpz_mod(key->d_mod_p1, private_key_d, key->d_mod_p1);
+    mpz_sub_ui(key->d_mod_q1, prime_q, 1);
+    mpz_mod(key->d_mod_q1, private_key_d, key->d_mod_q1);
 
-        // Encrypt the block
-        mpz_t plaintext, ciphertext;
-        mpz_inits(plaintext, ciphertext, NULL);
-        mpz_import(plaintext, block_size, 1, 1, 1, 0, plaintext_block);
+    // q^-1 mod p for Garner's recombination
+    mod_inverse(key->q_inv_p, prime_q, prime_p);
+    key->has_crt = true;
+    ss_key_meta_init(&key->meta, modulus_pq);
+}
 
-        ss_encrypt(ciphertext, plaintext, modulus_n);
-        gmp_fprintf(outfile, "%Zx\n", ciphertext);
+/**
+ * Writes a private key to a file. The first two lines are pq and d as written
+ * by ss_write_priv, followed by p, q, d mod (p-1), d mod (q-1) and q^-1 mod p
+ * when the key has CRT values.
+ *
+ * Args:
+ *   key (const ss_priv_key_t*): The private key.
+ *   pvfile (FILE*): The file to write the private key to.
+ */
+void ss_write_priv_key(const ss_priv_key_t *key, FILE *pvfile) {
+    ss_write_priv(key->modulus_pq, key->private_key_d, pvfile);
+    if (key->has_crt) {
+        gmp_fprintf(pvfile, "%Zx\n%Zx\n%Zx\n%Zx\n%Zx\n", key->prime_p,
+                    key->prime_q, key->d_mod_p1, key->d_mod_q1, key->q_inv_p);
+    }
+}
 
-        // Clean up and free memory
-        mpz_clears(plaintext, ciphertext, NULL);
-        free(plaintext_block);
+/**
+ * Reads a private key written by ss_write_priv, ss_write_priv_key or
+ * ss_keyfile_write_priv. Two-field key files load with has_crt set to false.
+ *
+ * Args:
+ *   key (ss_priv_key_t*): The initialized key to read into (output).
+ *   pvfile (FILE*): The file to read the private key from.
+ *
+ * Returns:
+ *   true if at least pq and d were read, false otherwise.
+ */
+bool ss_read_priv_key(ss_priv_key_t *key, FILE *pvfile) {
+    if (ss_keyfile_detect(pvfile)) {
+        return ss_keyfile_read_priv(key, pvfile);
+    }
+    key->has_crt = false;
+    if (gmp_fscanf(pvfile, "%Zx\n%Zx\n", key->modulus_pq,
+                   key->private_key_d) != 2) {
+        return false;
+    }
+    ss_key_meta_init(&key->meta, key->modulus_pq);
+    // Older key files stop here; anything short of all five CRT fields is
+    // ignored and decryption falls back to the single exponentiation.
+    if (gmp_fscanf(pvfile, "%Zx\n%Zx\n%Zx\n%Zx\n%Zx\n", key->prime_p,
+                   key->prime_q, key->d_mod_p1, key->d_mod_q1,
+                   key->q_inv_p) == 5) {
+        key->has_crt = true;
     }
+    return true;
+}
+
+/**
+ * Encrypts a message using the public key.
+ *
+ * Args:
+ *   ciphertext (mpz_t): The encrypted message (output).
+ *   plaintext (const mpz_t): The plaintext message.
+ *   modulus_n (const mpz_t): The public key modulus.
+ */
+void ss_encrypt(mpz_t ciphertext, const mpz_t plaintext,
+                const mpz_t modulus_n) {
+    mpz_powm(ciphertext, plaintext, modulus_n, modulus_n);
+}
 
-    mpz_clear(sqrt_modulus);
+/**
+ * Computes the metadata of a modulus in constant time. The encryption block
+ * size is floor((log2(sqrt(n)) - 1) / 8) as before, using the fact that
+ * floor(sqrt(n)) has exactly ceil(bits(n) / 2) bits.
+ *
+ * Args:
+ *   meta (ss_key_meta_t*): The metadata (output).
+ *   modulus (const mpz_t): The modulus, n for a public key or pq for a
+ * private key.
+ */
+void ss_key_meta_init(ss_key_meta_t *meta, const mpz_t modulus) {
+    size_t bits = mpz_sgn(modulus) == 0 ? 0 : mpz_sizeinbase(modulus, 2);
+    meta->modulus_bits = bits;
+    meta->block_size = ss_container_block_size(bits);
+    meta->byte_width = ss_container_block_width(bits);
 }
 
 /**
@@ -227,54 +556,2042 @@ void ss_decrypt(mpz_t plaintext, const mpz_t ciphertext,
 }
 
 /**
- * Decrypts the contents of an input file and writes the plaintext to an output
- * file using the private key.
+ * Recombines the CRT halves of a plaintext with Garner's formula,
+ * m = m_q + q * ((m_p - m_q) * q^-1 mod p).
  *
  * Args:
- *   infile (FILE*): The file containing the encrypted messages.
- *   outfile (FILE*): The file to write the decrypted messages to.
- *   private_key_d (const mpz_t): The private key.
- *   modulus_pq (const mpz_t): The product of the primes p and q.
+ *   plaintext (mpz_t): The plaintext; may be plain_p (output).
+ *   key (const ss_priv_key_t*): The private key; has_crt must be set.
+ *   plain_p (mpz_t): m_p = m mod p, overwritten.
+ *   plain_q (const mpz_t): m_q = m mod q.
  */
-void ss_decrypt_file(FILE *infile, FILE *outfile, const mpz_t private_key_d,
-                     const mpz_t modulus_pq) {
-    // Determine block size based on modulus_pq
-    mpz_t modulus_copy;
-    mpz_init(modulus_copy);
-    mpz_set(modulus_copy, modulus_pq);
+static void crt_combine(mpz_t plaintext, const ss_priv_key_t *key,
+                        mpz_t plain_p, const mpz_t plain_q) {
+    mpz_sub(plain_p, plain_p, plain_q);
+    mpz_mul(plain_p, plain_p, key->q_inv_p);
+    mpz_mod(plain_p, plain_p, key->prime_p);
+    mpz_mul(plain_p, plain_p, key->prime_q);
+    mpz_add(plaintext, plain_p, plain_q);
+}
+
+/**
+ * Decrypts a message with the CRT values of a private key, using plain_p and
+ * plain_q as scratch space.
+ *
+ * Args:
+ *   plaintext (mpz_t): The decrypted message (output).
+ *   ciphertext (const mpz_t): The encrypted message.
+ *   key (const ss_priv_key_t*): The private key; has_crt must be set.
+ *   plain_p (mpz_t): Scratch value.
+ *   plain_q (mpz_t): Scratch value.
+ */
+static void decrypt_crt(mpz_t plaintext, const mpz_t ciphertext,
+                        const ss_priv_key_t *key, mpz_t plain_p,
+                        mpz_t plain_q) {
+    // Two half-size exponentiations: m_p = c^dp mod p, m_q = c^dq mod q
+    mpz_powm(plain_p, ciphertext, key->d_mod_p1, key->prime_p);
+    mpz_powm(plain_q, ciphertext, key->d_mod_q1, key->prime_q);
+    crt_combine(plaintext, key, plain_p, plain_q);
+}
+
+/**
+ * Decrypts a message using a private key, taking the CRT path when available.
+ *
+ * Args:
+ *   plaintext (mpz_t): The decrypted message (output).
+ *   ciphertext (const mpz_t): The encrypted message.
+ *   key (const ss_priv_key_t*): The private key.
+ */
+void ss_decrypt_key(mpz_t plaintext, const mpz_t ciphertext,
+                    const ss_priv_key_t *key) {
+    if (!key->has_crt) {
+        ss_decrypt(plaintext, ciphertext, key->private_key_d, key->modulus_pq);
+        return;
+    }
+    mpz_t plain_p, plain_q;
+    mpz_inits(plain_p, plain_q, NULL);
+    decrypt_crt(plaintext, ciphertext, key, plain_p, plain_q);
+    mpz_clears(plain_p, plain_q, NULL);
+}
 
-    uint16_t block_size = 0;
-    while (mpz_cmp_ui(modulus_copy, 0) != 0) {
-        mpz_div_ui(modulus_copy, modulus_copy, 2);
-        block_size++;
+/**
+ * Initializes an encryption context for a public key. All buffers and
+ * bignums are sized from the modulus up front so that encrypting blocks
+ * through the context does not allocate.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The context to initialize (output).
+ *   modulus_n (const mpz_t): The public key modulus.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to hold a block.
+ */
+bool ss_encrypt_ctx_init(ss_encrypt_ctx_t *ctx, const mpz_t modulus_n) {
+    ss_key_meta_t meta;
+    ss_key_meta_init(&meta, modulus_n);
+    return ss_encrypt_ctx_init_meta(ctx, modulus_n, &meta);
+}
+
+/**
+ * Initializes an encryption context from metadata already computed for the
+ * modulus, so many contexts for one key share a single computation.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The context to initialize (output).
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   meta (const ss_key_meta_t*): The metadata of modulus_n.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to hold a block.
+ */
+bool ss_encrypt_ctx_init_meta(ss_encrypt_ctx_t *ctx, const mpz_t modulus_n,
+                              const ss_key_meta_t *meta) {
+    ctx->block_size = meta->block_size;
+    if (ctx->block_size < 2) {
+        return false;  // No room for the padding byte and any data
     }
-    block_size--;
-    block_size /= 8;
+    size_t modulus_bits = meta->modulus_bits;
+    ctx->cipher_width = meta->byte_width;
+    mpz_init_set(ctx->modulus_n, modulus_n);
+    mpz_init2(ctx->plaintext, 8 * ctx->block_size);
+    mpz_init2(ctx->ciphertext, modulus_bits);
+    pow_mod_lanes_init(&ctx->lanes, modulus_n, modulus_n);
+    for (size_t i = 0; i < POW_MOD_LANES; i++) {
+        mpz_init2(ctx->group[i], modulus_bits);
+    }
+    return true;
+}
 
-    mpz_t ciphertext, plaintext;
-    mpz_inits(ciphertext, plaintext, NULL);
+/**
+ * Frees the memory used by an encryption context.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The context to clear.
+ */
+void ss_encrypt_ctx_clear(ss_encrypt_ctx_t *ctx) {
+    mpz_clears(ctx->modulus_n, ctx->plaintext, ctx->ciphertext, NULL);
+    pow_mod_lanes_clear(&ctx->lanes);
+    for (size_t i = 0; i < POW_MOD_LANES; i++) {
+        mpz_clear(ctx->group[i]);
+    }
+}
 
-    while (true) {
-        // Read an encrypted message from the input file
-        if (gmp_fscanf(infile, "%Zx\n", ciphertext) == -1) {
-            break;  // End of file
-        }
+/**
+ * Zeroes the plaintexts an encryption context keeps from its last blocks.
+ * The group bignums hold the last padded plaintexts until their ciphertexts
+ * overwrite them, and the lane scratch the last reduced bases.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The context to wipe.
+ */
+void ss_encrypt_ctx_wipe(ss_encrypt_ctx_t *ctx) {
+    size_t modulus_bits = mpz_sizeinbase(ctx->modulus_n, 2);
+    wipe_bignum(ctx->plaintext, 8 * ctx->block_size);
+    for (size_t i = 0; i < POW_MOD_LANES; i++) {
+        wipe_bignum(ctx->group[i], modulus_bits);
+    }
+    pow_mod_lanes_wipe(&ctx->lanes);
+}
 
-        // Decrypt the message
-        ss_decrypt(plaintext, ciphertext, private_key_d, modulus_pq);
+/**
+ * Encrypts one block of at most block_size - 1 bytes into ctx->ciphertext.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The encryption context.
+ *   data (const uint8_t*): The plaintext bytes.
+ *   length (size_t): The number of bytes, at most ctx->block_size - 1.
+ */
+void ss_encrypt_ctx_block(ss_encrypt_ctx_t *ctx, const uint8_t *data,
+                          size_t length) {
+    // Only the bytes actually present are imported, so a short final block
+    // decrypts to exactly its own length.
+    ss_codec_import_plain(ctx->plaintext, data, length);
+    uint64_t start = stats_now();
+    ss_encrypt(ctx->ciphertext, ctx->plaintext, ctx->modulus_n);
+    stats_add_since(STATS_POWM_NS, start);
+    stats_add(STATS_BLOCKS_ENCRYPTED, 1);
+}
 
-        // Export the decrypted message to a byte array
-        uint8_t *plaintext_block =
-            (uint8_t *)calloc(block_size, sizeof(uint8_t));
-        size_t *decrypted_size = (size_t *)calloc(1, sizeof(size_t));
-        mpz_export(plaintext_block, decrypted_size, 1, 1, 1, 0, plaintext);
+/**
+ * Encrypts a byte string as consecutive blocks, writing each ciphertext into
+ * a fixed-width big-endian slot of ctx->cipher_width bytes. Blocks are
+ * exponentiated in groups of pow_mod_lanes_width, so with the vector kernel
+ * up to POW_MOD_LANES of them share one pass over the exponent.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The encryption context.
+ *   data (const uint8_t*): The plaintext bytes.
+ *   length (size_t): The number of plaintext bytes.
+ *   out (uint8_t*): Room for one slot per block (output).
+ *
+ * Returns:
+ *   The number of blocks written.
+ */
+size_t ss_encrypt_ctx_blocks(ss_encrypt_ctx_t *ctx, const uint8_t *data,
+                             size_t length, uint8_t *out) {
+    size_t chunk = ctx->block_size - 1;
+    size_t lanes = pow_mod_lanes_width(&ctx->lanes);
+    mpz_ptr group[POW_MOD_LANES];
+    mpz_srcptr bases[POW_MOD_LANES];
+    size_t blocks = 0;
+    size_t offset = 0;
+    while (offset < length) {
+        size_t count = 0;
+        while (count < lanes && offset < length) {
+            size_t bytes = length - offset < chunk ? length - offset : chunk;
+            ss_codec_import_plain(ctx->group[count], &data[offset], bytes);
+            group[count] = ctx->group[count];
+            bases[count] = ctx->group[count];
+            offset += bytes;
+            count++;
+        }
+        uint64_t start = stats_now();
+        pow_mod_lanes(&ctx->lanes, group, bases, count);
+        stats_add_since(STATS_POWM_NS, start);
+        stats_add(STATS_BLOCKS_ENCRYPTED, count);
+        for (size_t i = 0; i < count; i++) {
+            ss_codec_export_slot(&out[(blocks + i) * ctx->cipher_width],
+                                 ctx->cipher_width, ctx->group[i]);
+        }
+        blocks += count;
+    }
+    return blocks;
+}
 
-        // Write the decrypted message to the output file
-        fwrite(&(plaintext_block[1]), 1, *decrypted_size - 1, outfile);
+/**
+ * Initializes a decryption context for a private key. The key is borrowed
+ * and must outlive the context.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The context to initialize (output).
+ *   key (const ss_priv_key_t*): The private key.
+ *
+ * Returns:
+ *   true; the context allocates nothing beyond its own bignums and
+ * exponentiation tables.
+ */
+bool ss_decrypt_ctx_init(ss_decrypt_ctx_t *ctx, const ss_priv_key_t *key) {
+    // Every plaintext is below pq, so this always holds one export. Keys
+    // filled in by hand may not have their metadata yet.
+    ss_key_meta_t meta = key->meta;
+    if (meta.modulus_bits == 0) {
+        ss_key_meta_init(&meta, key->modulus_pq);
+    }
+    size_t modulus_bits = meta.modulus_bits;
+    ctx->key = key;
+    ctx->plain_width = meta.byte_width;
+    mpz_init2(ctx->ciphertext, 2 * modulus_bits);
+    mpz_init2(ctx->plaintext, modulus_bits);
+    mpz_init2(ctx->plain_p, 2 * modulus_bits);
+    mpz_init2(ctx->plain_q, modulus_bits);
+    if (key->has_crt) {
+        pow_mod_lanes_init(&ctx->lanes_p, key->prime_p, key->d_mod_p1);
+        pow_mod_lanes_init(&ctx->lanes_q, key->prime_q, key->d_mod_q1);
+    } else {
+        pow_mod_lanes_init(&ctx->lanes_p, key->modulus_pq,
+                           key->private_key_d);
+    }
+    for (size_t i = 0; i < POW_MOD_LANES; i++) {
+        mpz_init2(ctx->group[i], 2 * modulus_bits);
+        mpz_init2(ctx->group_q[i], modulus_bits);
+    }
+    return true;
+}
 
-        // Clean up and free memory
-        free(plaintext_block);
-        free(decrypted_size);
+/**
+ * Frees the memory used by a decryption context (but not its key).
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The context to clear.
+ */
+void ss_decrypt_ctx_clear(ss_decrypt_ctx_t *ctx) {
+    mpz_clears(ctx->ciphertext, ctx->plaintext, ctx->plain_p, ctx->plain_q,
+               NULL);
+    pow_mod_lanes_clear(&ctx->lanes_p);
+    if (ctx->key->has_crt) {
+        pow_mod_lanes_clear(&ctx->lanes_q);
     }
-    mpz_clears(ciphertext, plaintext, modulus_copy, NULL);
+    for (size_t i = 0; i < POW_MOD_LANES; i++) {
+        mpz_clears(ctx->group[i], ctx->group_q[i], NULL);
+    }
+}
+
+/**
+ * Zeroes the plaintexts and CRT halves a decryption context keeps from its
+ * last blocks, in its own bignums and in the lane scratch.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The context to wipe.
+ */
+void ss_decrypt_ctx_wipe(ss_decrypt_ctx_t *ctx) {
+    size_t modulus_bits = mpz_sizeinbase(ctx->key->modulus_pq, 2);
+    wipe_bignum(ctx->plaintext, modulus_bits);
+    wipe_bignum(ctx->plain_p, 2 * modulus_bits);
+    wipe_bignum(ctx->plain_q, modulus_bits);
+    for (size_t i = 0; i < POW_MOD_LANES; i++) {
+        wipe_bignum(ctx->group[i], 2 * modulus_bits);
+        wipe_bignum(ctx->group_q[i], modulus_bits);
+    }
+    pow_mod_lanes_wipe(&ctx->lanes_p);
+    if (ctx->key->has_crt) {
+        pow_mod_lanes_wipe(&ctx->lanes_q);
+    }
+}
+
+/**
+ * Decrypts one block and exports its plaintext, without the padding byte,
+ * directly into out.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The decryption context.
+ *   ciphertext (const mpz_t): The encrypted block (may be ctx->ciphertext).
+ *   out (uint8_t*): Room for ctx->plain_width - 1 bytes (output).
+ *
+ * Returns:
+ *   The number of plaintext bytes written, or SS_CODEC_INVALID if the block
+ * did not decrypt to a padded plaintext (wrong key or corrupt ciphertext).
+ */
+size_t ss_decrypt_ctx_block(ss_decrypt_ctx_t *ctx, const mpz_t ciphertext,
+                            uint8_t *out) {
+    uint64_t start = stats_now();
+    if (ctx->key->has_crt) {
+        decrypt_crt(ctx->plaintext, ciphertext, ctx->key, ctx->plain_p,
+                    ctx->plain_q);
+    } else {
+        ss_decrypt(ctx->plaintext, ciphertext, ctx->key->private_key_d,
+                   ctx->key->modulus_pq);
+    }
+    stats_add_since(STATS_POWM_NS, start);
+    stats_add(STATS_BLOCKS_DECRYPTED, 1);
+
+    return ss_codec_export_plain(out, ctx->plain_width - 1, ctx->plaintext);
+}
+
+/**
+ * Decrypts the ciphertexts in ctx->group[0 .. count) in place, exponentiating
+ * them together under each modulus of the key.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The decryption context.
+ *   count (size_t): The number of blocks, at most POW_MOD_LANES.
+ */
+static void decrypt_group(ss_decrypt_ctx_t *ctx, size_t count) {
+    mpz_ptr group[POW_MOD_LANES];
+    mpz_ptr halves[POW_MOD_LANES];
+    mpz_srcptr ciphertexts[POW_MOD_LANES];
+    for (size_t i = 0; i < count; i++) {
+        group[i] = ctx->group[i];
+        halves[i] = ctx->group_q[i];
+        ciphertexts[i] = ctx->group[i];
+    }
+
+    uint64_t start = stats_now();
+    if (ctx->key->has_crt) {
+        // m_q first, while the group still holds the ciphertexts
+        pow_mod_lanes(&ctx->lanes_q, halves, ciphertexts, count);
+        pow_mod_lanes(&ctx->lanes_p, group, ciphertexts, count);
+        for (size_t i = 0; i < count; i++) {
+            crt_combine(ctx->group[i], ctx->key, ctx->group[i],
+                        ctx->group_q[i]);
+        }
+    } else {
+        pow_mod_lanes(&ctx->lanes_p, group, ciphertexts, count);
+    }
+    stats_add_since(STATS_POWM_NS, start);
+    stats_add(STATS_BLOCKS_DECRYPTED, count);
+}
+
+/**
+ * Decrypts consecutive fixed-width big-endian ciphertext slots and writes the
+ * plaintext of each block back to back into out. Blocks are exponentiated in
+ * groups of pow_mod_lanes_width.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The decryption context.
+ *   slots (const uint8_t*): The ciphertext slots.
+ *   count (size_t): The number of slots.
+ *   slot_width (size_t): The width of each slot in bytes.
+ *   out (uint8_t*): Room for count * (ctx->plain_width - 1) bytes (output).
+ *
+ * Returns:
+ *   The number of plaintext bytes written, or SS_CODEC_INVALID if a block
+ * did not decode (the blocks before it have been written).
+ */
+size_t ss_decrypt_ctx_blocks(ss_decrypt_ctx_t *ctx, const uint8_t *slots,
+                             size_t count, size_t slot_width, uint8_t *out) {
+    size_t lanes = pow_mod_lanes_width(&ctx->lanes_p);
+    size_t written = 0;
+    for (size_t first = 0; first < count; first += lanes) {
+        size_t group = count - first < lanes ? count - first : lanes;
+        for (size_t i = 0; i < group; i++) {
+            ss_codec_import_slot(ctx->group[i],
+                                 &slots[(first + i) * slot_width], slot_width);
+        }
+        decrypt_group(ctx, group);
+        for (size_t i = 0; i < group; i++) {
+            size_t length = ss_codec_export_plain(
+                &out[written], ctx->plain_width - 1, ctx->group[i]);
+            if (length == SS_CODEC_INVALID) {
+                return SS_CODEC_INVALID;
+            }
+            written += length;
+        }
+    }
+    return written;
+}
+
+// Shared state for one batch of block encryption
+typedef struct {
+    ss_encrypt_ctx_t *contexts; // one per worker
+    const uint8_t *data;        // plaintext of whole blocks
+    uint8_t *slots;             // ciphertext slot per block (output)
+    size_t count;               // blocks in the batch
+    size_t lanes;               // blocks per task
+} encrypt_batch_t;
+
+static void encrypt_batch_task(void *arg, size_t index, size_t worker) {
+    encrypt_batch_t *batch = arg;
+    ss_encrypt_ctx_t *ctx = &batch->contexts[worker];
+    size_t chunk = ctx->block_size - 1;
+    size_t first = index * batch->lanes;
+    size_t count = batch->count - first < batch->lanes ? batch->count - first
+                                                       : batch->lanes;
+
+    ss_encrypt_ctx_blocks(ctx, &batch->data[first * chunk], count * chunk,
+                          &batch->slots[first * ctx->cipher_width]);
+}
+
+/**
+ * Initializes a streaming encryption state for a public key. With more than
+ * one thread, the whole blocks of every update are encrypted on a worker
+ * pool owned by the stream.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to initialize (output).
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   threads (size_t): The number of threads to use.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to encrypt with or
+ * memory runs out.
+ */
+bool ss_encrypt_stream_init(ss_encrypt_stream_t *stream,
+                            const mpz_t modulus_n, size_t threads) {
+    pool_t *pool = threads > 1 ? pool_create(threads) : NULL;
+    if (!ss_encrypt_stream_init_pool(stream, modulus_n, pool)) {
+        pool_destroy(pool);
+        return false;
+    }
+    stream->owns_pool = true;
+    return true;
+}
+
+/**
+ * Initializes a streaming encryption state that encrypts on a borrowed
+ * worker pool. The pool must outlive the stream and is not destroyed by
+ * ss_encrypt_stream_clear.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to initialize (output).
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   pool (pool_t*): The worker pool, or NULL to run on the calling thread.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to encrypt with or
+ * memory runs out.
+ */
+bool ss_encrypt_stream_init_pool(ss_encrypt_stream_t *stream,
+                                 const mpz_t modulus_n, pool_t *pool) {
+    stream->pool = pool;
+    stream->owns_pool = false;
+    stream->workers = pool == NULL ? 1 : pool_threads(pool);
+    ss_key_meta_init(&stream->meta, modulus_n);
+    stream->contexts = (ss_encrypt_ctx_t *)calloc(stream->workers,
+                                                  sizeof(ss_encrypt_ctx_t));
+    if (stream->contexts == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < stream->workers; i++) {
+        if (!ss_encrypt_ctx_init_meta(&stream->contexts[i], modulus_n,
+                                      &stream->meta)) {
+            for (size_t j = 0; j < i; j++) {
+                ss_encrypt_ctx_clear(&stream->contexts[j]);
+            }
+            free(stream->contexts);
+            return false;
+        }
+    }
+    stream->pending = (uint8_t *)malloc(stream->meta.block_size - 1);
+    if (stream->pending == NULL) {
+        for (size_t i = 0; i < stream->workers; i++) {
+            ss_encrypt_ctx_clear(&stream->contexts[i]);
+        }
+        free(stream->contexts);
+        return false;
+    }
+    stream->pending_length = 0;
+    return true;
+}
+
+/**
+ * Frees the memory used by a streaming encryption state. Any pending partial
+ * block is discarded; call ss_encrypt_stream_final first to keep it.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to clear.
+ */
+void ss_encrypt_stream_clear(ss_encrypt_stream_t *stream) {
+    for (size_t i = 0; i < stream->workers; i++) {
+        ss_encrypt_ctx_clear(&stream->contexts[i]);
+    }
+    free(stream->contexts);
+    free(stream->pending);
+    if (stream->owns_pool) {
+        pool_destroy(stream->pool);
+    }
+    stream->contexts = NULL;
+    stream->pending = NULL;
+    stream->pool = NULL;
+}
+
+/**
+ * Returns the number of ciphertext slots an update of length bytes can
+ * produce, for sizing the output buffer.
+ *
+ * Args:
+ *   stream (const ss_encrypt_stream_t*): The stream.
+ *   length (size_t): The number of bytes about to be fed.
+ *
+ * Returns:
+ *   The maximum number of slots ss_encrypt_stream_update will write.
+ */
+size_t ss_encrypt_stream_slots(const ss_encrypt_stream_t *stream,
+                               size_t length) {
+    return (stream->pending_length + length) / (stream->meta.block_size - 1);
+}
+
+/**
+ * Feeds plaintext into a stream and encrypts every block it completes.
+ * Bytes that do not fill a block are kept (at most one partial block) until
+ * the next update or ss_encrypt_stream_final. Whole blocks are encrypted
+ * straight from data without being copied.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream.
+ *   data (const uint8_t*): The plaintext bytes.
+ *   length (size_t): The number of plaintext bytes.
+ *   out (uint8_t*): Room for ss_encrypt_stream_slots(stream, length) slots
+ * of stream->meta.byte_width bytes (output).
+ *
+ * Returns:
+ *   The number of ciphertext slots written to out.
+ */
+size_t ss_encrypt_stream_update(ss_encrypt_stream_t *stream,
+                                const uint8_t *data, size_t length,
+                                uint8_t *out) {
+    size_t chunk = stream->meta.block_size - 1;
+    size_t written = 0;
+
+    // Top up a pending partial block first
+    if (stream->pending_length > 0) {
+        size_t needed = chunk - stream->pending_length;
+        size_t taken = length < needed ? length : needed;
+        memcpy(&stream->pending[stream->pending_length], data, taken);
+        stream->pending_length += taken;
+        data += taken;
+        length -= taken;
+        if (stream->pending_length < chunk) {
+            return 0;
+        }
+        ss_encrypt_ctx_t *ctx = &stream->contexts[0];
+        ss_encrypt_ctx_block(ctx, stream->pending, chunk);
+        ss_codec_export_slot(out, stream->meta.byte_width, ctx->ciphertext);
+        stream->pending_length = 0;
+        written++;
+    }
+
+    // Encrypt the whole blocks in place, spread across the pool one group
+    // of lanes at a time
+    size_t count = length / chunk;
+    size_t lanes = pow_mod_lanes_width(&stream->contexts[0].lanes);
+    encrypt_batch_t batch = { stream->contexts, data,
+                              &out[written * stream->meta.byte_width], count,
+                              lanes };
+    pool_run(stream->pool, (count + lanes - 1) / lanes, encrypt_batch_task,
+             &batch);
+    written += count;
+
+    // Keep the tail for later
+    stream->pending_length = length - count * chunk;
+    memcpy(stream->pending, &data[count * chunk], stream->pending_length);
+    return written;
+}
+
+/**
+ * Encrypts the pending partial block of a stream, if there is one.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream.
+ *   out (uint8_t*): Room for one slot of stream->meta.byte_width bytes (output).
+ *
+ * Returns:
+ *   The number of ciphertext slots written to out (0 or 1).
+ */
+size_t ss_encrypt_stream_final(ss_encrypt_stream_t *stream, uint8_t *out) {
+    if (stream->pending_length == 0) {
+        return 0;
+    }
+    ss_encrypt_ctx_t *ctx = &stream->contexts[0];
+    ss_encrypt_ctx_block(ctx, stream->pending, stream->pending_length);
+    ss_codec_export_slot(out, stream->meta.byte_width, ctx->ciphertext);
+    stream->pending_length = 0;
+    return 1;
+}
+
+/**
+ * Initializes per-worker decryption state for a private key, running on a
+ * pool owned by the context when threads > 1. The key is borrowed and must
+ * outlive the context.
+ *
+ * Args:
+ *   ctx (ss_decrypt_batch_ctx_t*): The context to initialize (output).
+ *   key (const ss_priv_key_t*): The private key.
+ *   threads (size_t): The number of threads to use.
+ *
+ * Returns:
+ *   true on success, false if the buffers could not be allocated.
+ */
+bool ss_decrypt_batch_ctx_init(ss_decrypt_batch_ctx_t *ctx,
+                               const ss_priv_key_t *key, size_t threads) {
+    pool_t *pool = threads > 1 ? pool_create(threads) : NULL;
+    if (!ss_decrypt_batch_ctx_init_pool(ctx, key, pool)) {
+        pool_destroy(pool);
+        return false;
+    }
+    ctx->owns_pool = true;
+    return true;
+}
+
+/**
+ * Initializes per-worker decryption state that runs on a borrowed pool,
+ * which must outlive the context.
+ *
+ * Args:
+ *   ctx (ss_decrypt_batch_ctx_t*): The context to initialize (output).
+ *   key (const ss_priv_key_t*): The private key.
+ *   pool (pool_t*): The worker pool, or NULL to run on the calling thread.
+ *
+ * Returns:
+ *   true on success, false if the buffers could not be allocated.
+ */
+bool ss_decrypt_batch_ctx_init_pool(ss_decrypt_batch_ctx_t *ctx,
+                                    const ss_priv_key_t *key, pool_t *pool) {
+    ctx->pool = pool;
+    ctx->owns_pool = false;
+    ctx->workers = pool == NULL ? 1 : pool_threads(pool);
+    ctx->contexts =
+        (ss_decrypt_ctx_t *)calloc(ctx->workers, sizeof(ss_decrypt_ctx_t));
+    if (ctx->contexts == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < ctx->workers; i++) {
+        if (!ss_decrypt_ctx_init(&ctx->contexts[i], key)) {
+            for (size_t j = 0; j < i; j++) {
+                ss_decrypt_ctx_clear(&ctx->contexts[j]);
+            }
+            free(ctx->contexts);
+            return false;
+        }
+    }
+    ctx->plain_width = ctx->contexts[0].plain_width;
+    return true;
+}
+
+/**
+ * Frees the per-worker decryption state, and the pool if the context owns
+ * it.
+ *
+ * Args:
+ *   ctx (ss_decrypt_batch_ctx_t*): The context to clear.
+ */
+void ss_decrypt_batch_ctx_clear(ss_decrypt_batch_ctx_t *ctx) {
+    for (size_t i = 0; i < ctx->workers; i++) {
+        ss_decrypt_ctx_clear(&ctx->contexts[i]);
+    }
+    free(ctx->contexts);
+    if (ctx->owns_pool) {
+        pool_destroy(ctx->pool);
+    }
+    ctx->contexts = NULL;
+    ctx->pool = NULL;
+}
+
+// Shared state for one ss_encrypt_batch or ss_decrypt_batch call
+typedef struct {
+    ss_encrypt_ctx_t *encrypt; // one per worker, when encrypting
+    ss_decrypt_ctx_t *decrypt; // one per worker, when decrypting
+    const ss_buffer_t *in;
+    ss_buffer_t *out;          // data already points into the caller's storage
+    size_t slot_width;         // decryption only
+} message_batch_t;
+
+static void encrypt_message_task(void *arg, size_t index, size_t worker) {
+    message_batch_t *batch = arg;
+    ss_encrypt_ctx_t *ctx = &batch->encrypt[worker];
+    size_t blocks = ss_encrypt_ctx_blocks(ctx, batch->in[index].data,
+                                          batch->in[index].length,
+                                          batch->out[index].data);
+    batch->out[index].length = blocks * ctx->cipher_width;
+}
+
+static void decrypt_message_task(void *arg, size_t index, size_t worker) {
+    message_batch_t *batch = arg;
+    batch->out[index].length = ss_decrypt_ctx_blocks(
+        &batch->decrypt[worker], batch->in[index].data,
+        batch->in[index].length / batch->slot_width, batch->slot_width,
+        batch->out[index].data);
+}
+
+/**
+ * Returns the number of ciphertext bytes ss_encrypt_batch produces for a set
+ * of messages, for sizing its storage.
+ *
+ * Args:
+ *   stream (const ss_encrypt_stream_t*): The stream to encrypt with.
+ *   messages (const ss_buffer_t*): The plaintext messages.
+ *   count (size_t): The number of messages.
+ *
+ * Returns:
+ *   The total ciphertext size in bytes.
+ */
+size_t ss_encrypt_batch_size(const ss_encrypt_stream_t *stream,
+                             const ss_buffer_t *messages, size_t count) {
+    size_t chunk = stream->meta.block_size - 1;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += (messages[i].length + chunk - 1) / chunk *
+                 stream->meta.byte_width;
+    }
+    return total;
+}
+
+/**
+ * Encrypts many independent messages under one public key. Each message is
+ * split into blocks on its own and becomes a run of fixed-width ciphertext
+ * slots; the runs are laid out back to back in storage. Messages are spread
+ * across the stream's pool, every worker reusing its own context, so the
+ * batch allocates nothing. The stream's pending data is not touched.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to encrypt with.
+ *   messages (const ss_buffer_t*): The plaintext messages.
+ *   count (size_t): The number of messages.
+ *   storage (uint8_t*): ss_encrypt_batch_size bytes of room (output).
+ *   ciphertexts (ss_buffer_t*): One entry per message, pointing into
+ * storage (output).
+ */
+void ss_encrypt_batch(ss_encrypt_stream_t *stream, const ss_buffer_t *messages,
+                      size_t count, uint8_t *storage,
+                      ss_buffer_t *ciphertexts) {
+    // Lay the outputs out first so workers never share a write position
+    size_t chunk = stream->meta.block_size - 1;
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        ciphertexts[i].data = &storage[offset];
+        offset += (messages[i].length + chunk - 1) / chunk *
+                  stream->meta.byte_width;
+    }
+    message_batch_t batch = { stream->contexts, NULL, messages, ciphertexts,
+                              0 };
+    pool_run(stream->pool, count, encrypt_message_task, &batch);
+}
+
+/**
+ * Returns the number of plaintext bytes ss_decrypt_batch may produce for a
+ * set of ciphertexts, for sizing its storage.
+ *
+ * Args:
+ *   ctx (const ss_decrypt_batch_ctx_t*): The decryption context.
+ *   ciphertexts (const ss_buffer_t*): The ciphertexts.
+ *   count (size_t): The number of ciphertexts.
+ *   slot_width (size_t): The width of each ciphertext slot in bytes.
+ *
+ * Returns:
+ *   An upper bound on the total plaintext size in bytes.
+ */
+size_t ss_decrypt_batch_size(const ss_decrypt_batch_ctx_t *ctx,
+                             const ss_buffer_t *ciphertexts, size_t count,
+                             size_t slot_width) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += ciphertexts[i].length / slot_width * (ctx->plain_width - 1);
+    }
+    return total;
+}
+
+/**
+ * Decrypts many independent ciphertexts produced by ss_encrypt_batch. The
+ * plaintexts are laid out in storage at the offsets their upper bounds
+ * allow, and spread across the context's pool.
+ *
+ * Args:
+ *   ctx (ss_decrypt_batch_ctx_t*): The decryption context.
+ *   ciphertexts (const ss_buffer_t*): The ciphertexts.
+ *   count (size_t): The number of ciphertexts.
+ *   slot_width (size_t): The width of each ciphertext slot in bytes, the
+ * byte width of the public modulus n.
+ *   storage (uint8_t*): ss_decrypt_batch_size bytes of room (output).
+ *   plaintexts (ss_buffer_t*): One entry per ciphertext, pointing into
+ * storage (output).
+ *
+ * Returns:
+ *   true on success, false if a ciphertext is not a whole number of slots
+ * (nothing is decrypted then) or did not decode (its plaintext is left
+ * empty).
+ */
+bool ss_decrypt_batch(ss_decrypt_batch_ctx_t *ctx,
+                      const ss_buffer_t *ciphertexts, size_t count,
+                      size_t slot_width, uint8_t *storage,
+                      ss_buffer_t *plaintexts) {
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ciphertexts[i].length % slot_width != 0) {
+            return false;
+        }
+        plaintexts[i].data = &storage[offset];
+        offset += ciphertexts[i].length / slot_width * (ctx->plain_width - 1);
+    }
+    message_batch_t batch = { NULL, ctx->contexts, ciphertexts, plaintexts,
+                              slot_width };
+    pool_run(ctx->pool, count, decrypt_message_task, &batch);
+    bool intact = true;
+    for (size_t i = 0; i < count; i++) {
+        if (plaintexts[i].length == SS_CODEC_INVALID) {
+            plaintexts[i].length = 0;
+            intact = false;
+        }
+    }
+    return intact;
+}
+
+/**
+ * Writes fixed-width ciphertext slots as hex lines, matching the "%Zx\n"
+ * output of gmp_fprintf: lowercase and without leading zeros.
+ *
+ * Args:
+ *   outfile (FILE*): The file to write to.
+ *   slots (const uint8_t*): The ciphertext slots.
+ *   count (size_t): The number of slots.
+ *   width (size_t): The width of each slot in bytes.
+ *   total (size_t*): The number of characters written (output).
+ *
+ * Returns:
+ *   true on success, false if a write failed or memory ran out.
+ */
+static bool write_hex_slots(FILE *outfile, const uint8_t *slots,
+                            size_t count, size_t width, size_t *total) {
+    static const char digits[] = "0123456789abcdef";
+    *total = 0;
+    if (count == 0) {
+        return true;
+    }
+    char *line = (char *)malloc(2 * width + 2);
+    if (line == NULL) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < count && ok; i++) {
+        const uint8_t *slot = &slots[i * width];
+        size_t length = 0;
+        for (size_t j = 0; j < width; j++) {
+            line[length++] = digits[slot[j] >> 4];
+            line[length++] = digits[slot[j] & 0x0F];
+        }
+        // Drop leading zero digits, keeping at least one
+        size_t start = 0;
+        while (start + 1 < length && line[start] == '0') {
+            start++;
+        }
+        line[length++] = '\n';
+        ok = fwrite(&line[start], 1, length - start, outfile) ==
+             length - start;
+        *total += ok ? length - start : 0;
+    }
+    free(line);
+    return ok;
+}
+
+/**
+ * Writes a batch of ciphertext slots in the requested format. Binary writes
+ * count as I/O time, hex output (formatting and its buffered writes) as parse
+ * time.
+ *
+ * Returns:
+ *   true on success, false on a short write.
+ */
+static bool write_slots(FILE *outfile, ss_format_t format,
+                        const uint8_t *slots, size_t count, size_t width) {
+    uint64_t start = stats_now();
+    if (format == SS_FORMAT_BINARY) {
+        bool ok = fwrite(slots, width, count, outfile) == count;
+        stats_add_since(STATS_IO_NS, start);
+        stats_add(STATS_BYTES_OUT, ok ? count * width : 0);
+        return ok;
+    }
+    size_t written = 0;
+    bool ok = write_hex_slots(outfile, slots, count, width, &written);
+    stats_add_since(STATS_PARSE_NS, start);
+    stats_add(STATS_BYTES_OUT, written);
+    return ok;
+}
+
+/**
+ * Encrypts the contents of an input file and writes them to an output file
+ * using the public key.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfile (FILE*): The file to write the encrypted messages to.
+ *   modulus_n (const mpz_t): The public key modulus.
+ */
+void ss_encrypt_file(FILE *infile, FILE *outfile, const mpz_t modulus_n) {
+    ss_encrypt_file_format(infile, outfile, modulus_n, SS_FORMAT_HEX, 1);
+}
+
+/**
+ * Encrypts the contents of an input file like ss_encrypt_file, spreading the
+ * blocks across a pool of worker threads. Blocks are read in batches and
+ * written back in their original order, so the output is identical to
+ * ss_encrypt_file.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfile (FILE*): The file to write the encrypted messages to.
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   threads (size_t): The number of threads to use.
+ */
+void ss_encrypt_file_parallel(FILE *infile, FILE *outfile,
+                              const mpz_t modulus_n, size_t threads) {
+    ss_encrypt_file_format(infile, outfile, modulus_n, SS_FORMAT_HEX,
+                           threads);
+}
+
+// A whole regular file mapped into memory
+typedef struct {
+    uint8_t *data;
+    size_t length;
+} file_map_t;
+
+/**
+ * Maps a regular input file that has not been read from yet. Pipes, sockets,
+ * terminals, empty files and streams that were already advanced are left to
+ * the stdio path.
+ *
+ * Args:
+ *   file (FILE*): The input file.
+ *   map (file_map_t*): The mapping (output).
+ *
+ * Returns:
+ *   true if the file was mapped, false if the caller should use stdio.
+ */
+static bool map_input(FILE *file, file_map_t *map) {
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size <= 0 || ftello(file) != 0) {
+        return false;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                      fileno(file), 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    map->data = (uint8_t *)data;
+    map->length = (size_t)st.st_size;
+    return true;
+}
+
+// What map_output did with an output file
+typedef enum {
+    OUTPUT_MAPPED, // reserved and mapped
+    OUTPUT_STDIO,  // still empty; write it through stdio instead
+    OUTPUT_FAILED, // left sized but unmapped, so it cannot be written at all
+} output_map_t;
+
+/**
+ * Reserves length bytes of disk for an empty regular output file and maps it
+ * for writing. The file must be open for both reading and writing ("w+").
+ * The blocks are allocated up front, so a full disk or quota shows up here
+ * rather than as SIGBUS while the mapping is written.
+ *
+ * Args:
+ *   file (FILE*): The output file.
+ *   length (size_t): The final size of the output.
+ *   map (file_map_t*): The mapping (output).
+ *
+ * Returns:
+ *   OUTPUT_MAPPED if the file was mapped, OUTPUT_STDIO if the caller should
+ * use stdio, or OUTPUT_FAILED if the file could not be emptied again after a
+ * failed reservation.
+ */
+static output_map_t map_output(FILE *file, size_t length, file_map_t *map) {
+    struct stat st;
+    int fd = fileno(file);
+    if (fflush(file) != 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size != 0 || ftello(file) != 0 ||
+        (fcntl(fd, F_GETFL) & O_ACCMODE) != O_RDWR) {
+        return OUTPUT_STDIO;
+    }
+    void *data = MAP_FAILED;
+    if (posix_fallocate(fd, 0, (off_t)length) == 0) {
+        data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (data == MAP_FAILED) {
+        // A failed reservation may still have extended the file
+        return ftruncate(fd, 0) == 0 ? OUTPUT_STDIO : OUTPUT_FAILED;
+    }
+    map->data = (uint8_t *)data;
+    map->length = length;
+    return OUTPUT_MAPPED;
+}
+
+static void unmap_file(file_map_t *map) {
+    munmap(map->data, map->length);
+    map->data = NULL;
+    map->length = 0;
+}
+
+/**
+ * Encrypts a mapped input straight into a mapped binary container. Every
+ * whole block goes through a single ss_encrypt_stream_update, so the pool
+ * workers each take blocks directly from one mapping and export into the
+ * other, with no intermediate buffers.
+ *
+ * Returns:
+ *   OUTPUT_MAPPED if the output was mapped and written, otherwise what
+ * map_output returned.
+ */
+static output_map_t encrypt_mapped(ss_encrypt_stream_t *stream,
+                           const file_map_t *input, FILE *outfile,
+                           ss_container_header_t *header) {
+    size_t chunk = stream->meta.block_size - 1;
+    size_t count = (input->length + chunk - 1) / chunk;
+
+    file_map_t output;
+    output_map_t result = map_output(
+        outfile, SS_CONTAINER_HEADER_SIZE + count * stream->meta.byte_width,
+        &output);
+    if (result != OUTPUT_MAPPED) {
+        return result;
+    }
+    header->block_count = count;
+    ss_container_encode_header(output.data, header);
+
+    uint8_t *slots = &output.data[SS_CONTAINER_HEADER_SIZE];
+    size_t written =
+        ss_encrypt_stream_update(stream, input->data, input->length, slots);
+    ss_encrypt_stream_final(stream, &slots[written * stream->meta.byte_width]);
+    stats_add(STATS_BYTES_IN, input->length);
+    stats_add(STATS_BYTES_OUT, output.length);
+    unmap_file(&output);
+    return OUTPUT_MAPPED;
+}
+
+/**
+ * Encrypts the contents of an input file into the given ciphertext format
+ * through an existing stream, which must have no pending data. Reads the
+ * input in batches and feeds them through the stream, so a long-lived stream
+ * can serve any number of files without being rebuilt.
+ *
+ * Regular input files are memory-mapped and blocks are encrypted straight
+ * from the mapping. A binary container written to an empty regular file
+ * opened with "w+" is pre-sized and mapped as well.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to encrypt with.
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfile (FILE*): The file to write the encrypted messages to.
+ *   format (ss_format_t): The ciphertext format to write.
+ *
+ * Returns:
+ *   true on success, false if the input could not be read, the ciphertext
+ * could not be written or memory ran out.
+ */
+bool ss_encrypt_stream_file(ss_encrypt_stream_t *stream, FILE *infile,
+                            FILE *outfile, ss_format_t format) {
+    // Hybrid containers only run SS over the session key
+    if (format == SS_FORMAT_HYBRID) {
+        return ss_hybrid_encrypt_file(&stream->contexts[0], infile, outfile);
+    }
+
+    size_t chunk = stream->meta.block_size - 1;
+    size_t slot_width = stream->meta.byte_width;
+    size_t batch_size = stream->workers * SS_BLOCKS_PER_THREAD;
+
+    ss_container_header_t header = {
+        SS_CONTAINER_VERSION,
+        (uint32_t)stream->meta.modulus_bits,
+        (uint32_t)stream->meta.block_size, SS_CONTAINER_COUNT_UNKNOWN
+    };
+
+    file_map_t input = { NULL, 0 };
+    bool mapped = map_input(infile, &input);
+    output_map_t direct = mapped && format == SS_FORMAT_BINARY
+                              ? encrypt_mapped(stream, &input, outfile, &header)
+                              : OUTPUT_STDIO;
+    if (direct != OUTPUT_STDIO) {
+        unmap_file(&input);
+        return direct == OUTPUT_MAPPED;
+    }
+
+    // Every buffer the loop touches is allocated once, here
+    uint8_t *data = mapped ? NULL : (uint8_t *)malloc(batch_size * chunk);
+    uint8_t *slots = (uint8_t *)malloc(batch_size * slot_width);
+    bool ok = (mapped || data != NULL) && slots != NULL;
+
+    // Binary containers start with a header; the block count is patched in
+    // at the end when the output is seekable.
+    long header_offset = -1;
+    uint64_t block_count = 0;
+    if (ok && format == SS_FORMAT_BINARY) {
+        header_offset = ftell(outfile);
+        ok = ss_container_write_header(&header, outfile);
+        stats_add(STATS_BYTES_OUT, SS_CONTAINER_HEADER_SIZE);
+    }
+
+    size_t offset = 0;
+    while (ok) {
+        // Take up to one batch of blocks from the mapping or the file
+        const uint8_t *batch = data;
+        size_t bytes_read = 0;
+        if (mapped) {
+            batch = &input.data[offset];
+            bytes_read = input.length - offset;
+            if (bytes_read > batch_size * chunk) {
+                bytes_read = batch_size * chunk;
+            }
+            offset += bytes_read;
+        } else {
+            uint64_t start = stats_now();
+            bytes_read = fread(data, sizeof(uint8_t), batch_size * chunk,
+                               infile);
+            stats_add_since(STATS_IO_NS, start);
+        }
+        if (bytes_read == 0) {
+            break;  // End of file
+        }
+        stats_add(STATS_BYTES_IN, bytes_read);
+        size_t count = ss_encrypt_stream_update(stream, batch, bytes_read,
+                                                slots);
+        ok = write_slots(outfile, format, slots, count, slot_width);
+        block_count += count;
+    }
+    if (ok) {
+        size_t count = ss_encrypt_stream_final(stream, slots);
+        ok = write_slots(outfile, format, slots, count, slot_width);
+        block_count += count;
+    }
+
+    // An output that cannot seek keeps the unknown count
+    ok = ok && (mapped || !ferror(infile));
+    if (ok && format == SS_FORMAT_BINARY && header_offset >= 0) {
+        ok = ss_container_patch_count(outfile, header_offset, block_count);
+    }
+    ok = ok && fflush(outfile) == 0;
+    if (mapped) {
+        unmap_file(&input);
+    }
+    free(data);
+    free(slots);
+    return ok;
+}
+
+/**
+ * Encrypts the contents of an input file into the given ciphertext format,
+ * optionally spreading the blocks across a pool of worker threads.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfile (FILE*): The file to write the encrypted messages to.
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   format (ss_format_t): The ciphertext format to write.
+ *   threads (size_t): The number of threads to use.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to encrypt with, the
+ * input could not be read or the ciphertext could not be written.
+ */
+bool ss_encrypt_file_format(FILE *infile, FILE *outfile, const mpz_t modulus_n,
+                            ss_format_t format, size_t threads) {
+    ss_encrypt_stream_t stream;
+    if (!ss_encrypt_stream_init(&stream, modulus_n, threads)) {
+        return false;
+    }
+    bool ok = ss_encrypt_stream_file(&stream, infile, outfile, format);
+    ss_encrypt_stream_clear(&stream);
+    return ok;
+}
+
+// Where one recipient's ciphertext goes during ss_encrypt_streams_file
+typedef struct {
+    FILE *outfile;
+    file_map_t output;     // binary container mapped up front, if it could be
+    size_t written;        // slots exported into output so far
+    long header_offset;    // binary container written through stdio, or -1
+    uint64_t block_count;  // slots written through stdio
+} recipient_t;
+
+/**
+ * Feeds one batch of plaintext to a recipient's stream, or flushes its
+ * pending block when data is NULL, and delivers the slots. A mapped output
+ * receives them in place; otherwise they go through the shared slots buffer.
+ *
+ * Returns:
+ *   true on success, false on a short write.
+ */
+static bool encrypt_recipient(ss_encrypt_stream_t *stream,
+                              recipient_t *recipient, ss_format_t format,
+                              const uint8_t *data, size_t length,
+                              uint8_t *slots) {
+    size_t width = stream->meta.byte_width;
+    uint8_t *out = slots;
+    if (recipient->output.data != NULL) {
+        out = &recipient->output.data[SS_CONTAINER_HEADER_SIZE +
+                                      recipient->written * width];
+    }
+    size_t count = data == NULL
+                       ? ss_encrypt_stream_final(stream, out)
+                       : ss_encrypt_stream_update(stream, data, length, out);
+    if (recipient->output.data != NULL) {
+        recipient->written += count;
+        return true;
+    }
+    recipient->block_count += count;
+    return write_slots(recipient->outfile, format, slots, count, width);
+}
+
+/**
+ * Encrypts the contents of an input file for several recipients at once,
+ * reading the input a single time. Each batch of plaintext is encrypted
+ * through every recipient's stream before the next batch is read, so the
+ * outputs advance together and no recipient re-reads the source. Streams
+ * sharing a worker pool keep every thread busy on each batch.
+ *
+ * Batches hold a whole number of the first recipient's blocks, so every
+ * recipient with the same block size consumes each batch exactly, and one
+ * slot buffer serves all recipients written through stdio. Binary
+ * containers for a mapped input are pre-sized and mapped like
+ * ss_encrypt_stream_file does.
+ *
+ * Args:
+ *   streams (ss_encrypt_stream_t*): A stream per recipient, with no pending data.
+ *   count (size_t): The number of recipients, at least 1.
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfiles (FILE* const*): The file to write each recipient's ciphertext to.
+ *   format (ss_format_t): The ciphertext format to write.
+ *
+ * Returns:
+ *   true on success, false if the input could not be read, a ciphertext could
+ * not be written or memory ran out.
+ */
+bool ss_encrypt_streams_file(ss_encrypt_stream_t *streams, size_t count,
+                             FILE *infile, FILE *const *outfiles,
+                             ss_format_t format) {
+    if (count == 1) {
+        return ss_encrypt_stream_file(streams, infile, outfiles[0], format);
+    }
+    if (format == SS_FORMAT_HYBRID) {
+        ss_encrypt_ctx_t **contexts =
+            (ss_encrypt_ctx_t **)malloc(count * sizeof(ss_encrypt_ctx_t *));
+        if (contexts == NULL) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            contexts[i] = &streams[i].contexts[0];
+        }
+        bool ok = ss_hybrid_encrypt_files(contexts, count, infile, outfiles);
+        free(contexts);
+        return ok;
+    }
+
+    size_t batch_size = streams[0].workers * SS_MULTI_BLOCKS_PER_THREAD *
+                        (streams[0].meta.block_size - 1);
+    size_t slot_room = 0;
+    for (size_t i = 0; i < count; i++) {
+        // One more slot than fits, for a partial block carried in
+        size_t room = (batch_size / (streams[i].meta.block_size - 1) + 1) *
+                      streams[i].meta.byte_width;
+        slot_room = room > slot_room ? room : slot_room;
+    }
+
+    file_map_t input = { NULL, 0 };
+    bool mapped = map_input(infile, &input);
+    uint8_t *data = mapped ? NULL : (uint8_t *)malloc(batch_size);
+    uint8_t *slots = (uint8_t *)malloc(slot_room);
+    recipient_t *recipients = (recipient_t *)calloc(count, sizeof(recipient_t));
+    if ((!mapped && data == NULL) || slots == NULL || recipients == NULL) {
+        if (mapped) {
+            unmap_file(&input);
+        }
+        free(data);
+        free(slots);
+        free(recipients);
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        recipient_t *recipient = &recipients[i];
+        recipient->outfile = outfiles[i];
+        recipient->header_offset = -1;
+        if (format != SS_FORMAT_BINARY) {
+            continue;
+        }
+        const ss_key_meta_t *meta = &streams[i].meta;
+        ss_container_header_t header = { SS_CONTAINER_VERSION,
+                                         (uint32_t)meta->modulus_bits,
+                                         (uint32_t)meta->block_size,
+                                         SS_CONTAINER_COUNT_UNKNOWN };
+        size_t chunk = meta->block_size - 1;
+        size_t blocks = (input.length + chunk - 1) / chunk;
+        output_map_t result =
+            mapped ? map_output(outfiles[i],
+                                SS_CONTAINER_HEADER_SIZE +
+                                    blocks * meta->byte_width,
+                                &recipient->output)
+                   : OUTPUT_STDIO;
+        if (result == OUTPUT_MAPPED) {
+            header.block_count = blocks;
+            ss_container_encode_header(recipient->output.data, &header);
+            stats_add(STATS_BYTES_OUT, recipient->output.length);
+        } else if (result == OUTPUT_FAILED) {
+            ok = false;
+        } else {
+            recipient->header_offset = ftell(outfiles[i]);
+            ok = ss_container_write_header(&header, outfiles[i]) && ok;
+            stats_add(STATS_BYTES_OUT, SS_CONTAINER_HEADER_SIZE);
+        }
+    }
+
+    size_t offset = 0;
+    while (ok) {
+        const uint8_t *batch = data;
+        size_t bytes_read = 0;
+        if (mapped) {
+            batch = &input.data[offset];
+            bytes_read = input.length - offset;
+            if (bytes_read > batch_size) {
+                bytes_read = batch_size;
+            }
+            offset += bytes_read;
+        } else {
+            uint64_t start = stats_now();
+            bytes_read = fread(data, sizeof(uint8_t), batch_size, infile);
+            stats_add_since(STATS_IO_NS, start);
+        }
+        if (bytes_read == 0) {
+            break;  // End of file
+        }
+        stats_add(STATS_BYTES_IN, bytes_read);
+        for (size_t i = 0; i < count && ok; i++) {
+            ok = encrypt_recipient(&streams[i], &recipients[i], format, batch,
+                                   bytes_read, slots);
+        }
+    }
+    ok = ok && (mapped || !ferror(infile));
+
+    // Mapped outputs are unmapped whatever happened
+    for (size_t i = 0; i < count; i++) {
+        recipient_t *recipient = &recipients[i];
+        ok = ok && encrypt_recipient(&streams[i], recipient, format, NULL, 0,
+                                     slots);
+        if (recipient->output.data != NULL) {
+            unmap_file(&recipient->output);
+        } else if (ok && format == SS_FORMAT_BINARY &&
+                   recipient->header_offset >= 0) {
+            ok = ss_container_patch_count(recipient->outfile,
+                                          recipient->header_offset,
+                                          recipient->block_count);
+        }
+        ok = ok && fflush(recipient->outfile) == 0;
+    }
+    if (mapped) {
+        unmap_file(&input);
+    }
+    free(data);
+    free(slots);
+    free(recipients);
+    return ok;
+}
+
+/**
+ * Encrypts the contents of an input file for several public keys, reading
+ * the input once. All recipients share one pool of worker threads.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfiles (FILE* const*): The file to write each recipient's ciphertext to.
+ *   moduli (mpz_t*): The public key modulus of each recipient.
+ *   count (size_t): The number of recipients, at least 1.
+ *   format (ss_format_t): The ciphertext format to write.
+ *   threads (size_t): The number of threads to use.
+ *
+ * Returns:
+ *   true on success, false if a modulus is too small to encrypt with or the
+ * encryption failed.
+ */
+bool ss_encrypt_file_multi(FILE *infile, FILE *const *outfiles, mpz_t *moduli,
+                           size_t count, ss_format_t format, size_t threads) {
+    ss_encrypt_stream_t *streams =
+        (ss_encrypt_stream_t *)calloc(count, sizeof(ss_encrypt_stream_t));
+    pool_t *pool = threads > 1 ? pool_create(threads) : NULL;
+    size_t ready = 0;
+    while (streams != NULL && ready < count &&
+           ss_encrypt_stream_init_pool(&streams[ready], moduli[ready], pool)) {
+        ready++;
+    }
+    bool ok = streams != NULL && ready == count &&
+              ss_encrypt_streams_file(streams, count, infile, outfiles,
+                                      format);
+    for (size_t i = 0; i < ready; i++) {
+        ss_encrypt_stream_clear(&streams[i]);
+    }
+    free(streams);
+    pool_destroy(pool);
+    return ok;
+}
+
+// Batches in flight in the decryption pipeline: one being read, one being
+// decrypted and one being written
+#define SS_PIPELINE_DEPTH 3
+
+// One batch of block decryption, passed from stage to stage
+typedef struct {
+    ss_decrypt_ctx_t *contexts; // one per worker
+    mpz_t *blocks;              // hex: ciphertext per block
+    const uint8_t *slots;       // binary: ciphertext slot per block
+    size_t slot_width;
+    uint8_t *plaintext;         // plaintext per block (output)
+    size_t *lengths;            // plaintext bytes per block (output)
+    size_t count;               // blocks in this batch
+    bool last;                  // no batch follows this one
+} decrypt_batch_t;
+
+// Input side of a decryption, advanced only by the reader stage
+typedef struct {
+    FILE *infile;
+    bool mapped;                   // slots come straight from input
+    bool binary;                   // container rather than hex lines
+    file_map_t input;
+    ss_container_header_t header;
+    size_t offset;                 // next slot in the mapping
+    uint64_t remaining;            // slots left, or SS_CONTAINER_COUNT_UNKNOWN
+    size_t batch_size;
+    bool ok;                       // cleared on a malformed container
+} decrypt_source_t;
+
+// Output side of a decryption, advanced only by the writer stage
+typedef struct {
+    FILE *outfile;
+    uint64_t skip;    // plaintext bytes still to drop before the range
+    uint64_t limit;   // plaintext bytes still to write
+    size_t chunk;     // bytes in every block but the last, or 0 if unchecked
+    bool short_block; // the last block written was short of chunk
+    bool intact;      // cleared on a block that does not decode or misplaces the range
+    bool written;     // cleared on a short write; nothing is written after it
+} decrypt_sink_t;
+
+// The rings and endpoints shared by the pipeline threads
+typedef struct {
+    decrypt_source_t *source;
+    decrypt_sink_t *sink;
+    ring_t *empty;    // writer -> reader
+    ring_t *filled;   // reader -> decryption
+    ring_t *decrypted; // decryption -> writer
+    atomic_bool stop;  // set by the writer stage after a short write
+} decrypt_pipeline_t;
+
+// Blocks each decrypt_batch_task takes, one group of lanes
+static size_t decrypt_batch_lanes(const decrypt_batch_t *batch) {
+    return pow_mod_lanes_width(&batch->contexts[0].lanes_p);
+}
+
+static void decrypt_batch_task(void *arg, size_t index, size_t worker) {
+    decrypt_batch_t *batch = arg;
+    ss_decrypt_ctx_t *ctx = &batch->contexts[worker];
+    size_t lanes = decrypt_batch_lanes(batch);
+    size_t first = index * lanes;
+    size_t count = batch->count - first < lanes ? batch->count - first : lanes;
+
+    for (size_t i = 0; i < count; i++) {
+        if (batch->slots != NULL) {
+            ss_codec_import_slot(ctx->group[i],
+                                 &batch->slots[(first + i) * batch->slot_width],
+                                 batch->slot_width);
+        } else {
+            mpz_set(ctx->group[i], batch->blocks[first + i]);
+        }
+    }
+    decrypt_group(ctx, count);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *out = &batch->plaintext[(first + i) * (ctx->plain_width - 1)];
+        batch->lengths[first + i] =
+            ss_codec_export_plain(out, ctx->plain_width - 1, ctx->group[i]);
+    }
+}
+
+// Decrypts every block of a batch on the pool, one group of lanes per task
+static void decrypt_batch_run(pool_t *pool, decrypt_batch_t *batch) {
+    size_t lanes = decrypt_batch_lanes(batch);
+    pool_run(pool, (batch->count + lanes - 1) / lanes, decrypt_batch_task,
+             batch);
+}
+
+/**
+ * Faults in the pages of a mapped range by touching one byte per page, so
+ * the reader stage rather than the decryption workers waits for the storage.
+ */
+static void prefault(const uint8_t *data, size_t length) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    volatile uint8_t sink = 0;
+    for (size_t i = 0; i < length; i += page) {
+        sink ^= data[i];
+    }
+    if (length > 0) {
+        sink ^= data[length - 1];
+    }
+    (void)sink;
+}
+
+/**
+ * Reads up to one batch of encrypted blocks from the source into batch,
+ * setting batch->count and batch->last.
+ */
+static void read_batch(decrypt_source_t *source, decrypt_batch_t *batch) {
+    size_t count = 0;
+    bool at_eof = false;
+    uint64_t start = stats_now();
+    if (source->mapped) {
+        count = source->remaining < source->batch_size
+                    ? (size_t)source->remaining
+                    : source->batch_size;
+        batch->slots = &source->input.data[source->offset];
+        prefault(batch->slots, count * batch->slot_width);
+        source->offset += count * batch->slot_width;
+        source->remaining -= count;
+        at_eof = source->remaining == 0;
+        stats_add_since(STATS_IO_NS, start);
+        stats_add(STATS_BYTES_IN, count * batch->slot_width);
+    } else if (source->binary) {
+        size_t wanted = source->batch_size;
+        if (source->remaining < wanted) {
+            wanted = (size_t)source->remaining;
+        }
+        uint8_t *slots = (uint8_t *)batch->slots;
+        size_t bytes_read =
+            fread(slots, 1, wanted * batch->slot_width, source->infile);
+        stats_add_since(STATS_IO_NS, start);
+        stats_add(STATS_BYTES_IN, bytes_read);
+        count = bytes_read / batch->slot_width;
+        if (count < wanted) {
+            // A clean end is only valid for streamed containers
+            source->ok = bytes_read % batch->slot_width == 0 &&
+                         source->header.block_count ==
+                             SS_CONTAINER_COUNT_UNKNOWN;
+            at_eof = true;
+        }
+        if (source->remaining != SS_CONTAINER_COUNT_UNKNOWN) {
+            source->remaining -= count;
+            at_eof = at_eof || source->remaining == 0;
+        }
+    } else {
+        while (count < source->batch_size) {
+            int matched =
+                gmp_fscanf(source->infile, "%Zx\n", batch->blocks[count]);
+            if (matched != 1) {
+                // End of file, or a line that is not hex and would never
+                // be consumed
+                source->ok = matched == EOF;
+                at_eof = true;
+                break;
+            }
+            // Lines are canonical %Zx, so this is the bytes consumed
+            stats_add(STATS_BYTES_IN,
+                      mpz_sizeinbase(batch->blocks[count], 16) + 1);
+            count++;
+        }
+        stats_add_since(STATS_PARSE_NS, start);
+    }
+    batch->count = count;
+    batch->last = at_eof;
+}
+
+/**
+ * Writes the plaintext of a decrypted batch in block order, keeping only the
+ * part inside the sink's range and skipping blocks that did not decode.
+ * After a short write the sink's written flag is cleared and nothing more is
+ * written.
+ */
+static void write_batch(decrypt_sink_t *sink, const decrypt_batch_t *batch) {
+    size_t width = batch->contexts[0].plain_width - 1;
+    uint64_t start = stats_now();
+    for (size_t i = 0; i < batch->count; i++) {
+        size_t length = batch->lengths[i];
+        if (length == SS_CODEC_INVALID) {
+            sink->intact = false;
+            continue;
+        }
+        // A short block anywhere but at the end shifts every later offset
+        if (sink->short_block) {
+            sink->intact = false;
+        }
+        sink->short_block = sink->chunk != 0 && length != sink->chunk;
+
+        const uint8_t *data = &batch->plaintext[i * width];
+        size_t drop = sink->skip < length ? (size_t)sink->skip : length;
+        sink->skip -= drop;
+        data += drop;
+        length -= drop;
+        if (length > sink->limit) {
+            length = (size_t)sink->limit;
+        }
+        sink->limit -= length;
+        sink->written = sink->written &&
+                        fwrite(data, 1, length, sink->outfile) == length;
+        stats_add(STATS_BYTES_OUT, sink->written ? length : 0);
+    }
+    stats_add_since(STATS_IO_NS, start);
+}
+
+// Reader stage: fills empty batches until the input runs out, or sends an
+// empty last batch once the writer stage has stopped
+static void *decrypt_reader(void *arg) {
+    decrypt_pipeline_t *pipeline = arg;
+    bool last = false;
+    while (!last) {
+        decrypt_batch_t *batch = ring_pop(pipeline->empty);
+        if (atomic_load(&pipeline->stop)) {
+            batch->count = 0;
+            batch->last = true;
+        } else {
+            read_batch(pipeline->source, batch);
+        }
+        last = batch->last;
+        ring_push(pipeline->filled, batch);
+    }
+    return NULL;
+}
+
+// Writer stage: writes decrypted batches in the order they were read
+static void *decrypt_writer(void *arg) {
+    decrypt_pipeline_t *pipeline = arg;
+    bool last = false;
+    while (!last) {
+        decrypt_batch_t *batch = ring_pop(pipeline->decrypted);
+        write_batch(pipeline->sink, batch);
+        if (!pipeline->sink->written) {
+            atomic_store(&pipeline->stop, true);
+        }
+        last = batch->last;
+        ring_push(pipeline->empty, batch);
+    }
+    return NULL;
+}
+
+/**
+ * Runs the batches through three stages connected by rings: a reader thread
+ * parses or reads the next batch and a writer thread writes the previous one
+ * while the calling thread decrypts the current one on the pool, so I/O
+ * overlaps with exponentiation. Batches travel through the rings in read
+ * order, which keeps the output in order. Without a writer thread the
+ * calling thread writes each batch itself. A short write stops the reader,
+ * which ends the pipeline with an empty last batch.
+ *
+ * Returns:
+ *   false if the reader could not be started; nothing has been read then.
+ */
+static bool run_pipeline(decrypt_source_t *source, decrypt_sink_t *sink,
+                         decrypt_batch_t *batches, pool_t *pool) {
+    decrypt_pipeline_t pipeline = {
+        source, sink, ring_create(SS_PIPELINE_DEPTH),
+        ring_create(SS_PIPELINE_DEPTH), ring_create(SS_PIPELINE_DEPTH), false
+    };
+    bool started = pipeline.empty != NULL && pipeline.filled != NULL &&
+                   pipeline.decrypted != NULL;
+    pthread_t reader, writer;
+    if (started) {
+        for (size_t i = 0; i < SS_PIPELINE_DEPTH; i++) {
+            ring_push(pipeline.empty, &batches[i]);
+        }
+        started = pthread_create(&reader, NULL, decrypt_reader, &pipeline) == 0;
+    }
+    if (started) {
+        bool threaded_writer =
+            pthread_create(&writer, NULL, decrypt_writer, &pipeline) == 0;
+        bool last = false;
+        while (!last) {
+            decrypt_batch_t *batch = ring_pop(pipeline.filled);
+            decrypt_batch_run(pool, batch);
+            last = batch->last;
+            if (threaded_writer) {
+                ring_push(pipeline.decrypted, batch);
+            } else {
+                write_batch(sink, batch);
+                if (!sink->written) {
+                    atomic_store(&pipeline.stop, true);
+                }
+                ring_push(pipeline.empty, batch);
+            }
+        }
+        pthread_join(reader, NULL);
+        if (threaded_writer) {
+            pthread_join(writer, NULL);
+        }
+    }
+    ring_destroy(pipeline.empty);
+    ring_destroy(pipeline.filled);
+    ring_destroy(pipeline.decrypted);
+    return started;
+}
+
+/**
+ * Checks that a container header could have been written for a key. The
+ * public modulus n = p * pq is longer than pq and at most twice as long, so
+ * a header claiming any other size is damaged or for another key, and its
+ * slot width must not be trusted.
+ */
+static bool header_fits_key(const ss_container_header_t *header,
+                            const ss_priv_key_t *key) {
+    uint64_t pq_bits = mpz_sizeinbase(key->modulus_pq, 2);
+    return header->modulus_bits > pq_bits &&
+           header->modulus_bits <= 2 * pq_bits;
+}
+
+/**
+ * Frees whatever was allocated for the pipeline's batches. Unallocated
+ * fields must be NULL.
+ *
+ * Args:
+ *   batches (decrypt_batch_t*): The SS_PIPELINE_DEPTH batches.
+ *   stdio_slots (bool): Whether the slot buffers were malloced rather than
+ * pointing into a mapped input.
+ *   batch_size (size_t): The number of blocks initialized in each batch.
+ */
+static void free_batches(decrypt_batch_t *batches, bool stdio_slots,
+                         size_t batch_size) {
+    for (size_t b = 0; b < SS_PIPELINE_DEPTH; b++) {
+        decrypt_batch_t *batch = &batches[b];
+        if (stdio_slots) {
+            free((uint8_t *)batch->slots);
+        }
+        if (batch->blocks != NULL) {
+            for (size_t i = 0; i < batch_size; i++) {
+                mpz_clear(batch->blocks[i]);
+            }
+            free(batch->blocks);
+        }
+        free(batch->plaintext);
+        free(batch->lengths);
+    }
+}
+
+/**
+ * Decrypts a hex or binary ciphertext stream in batches of blocks, running
+ * each batch on the pool (or inline when pool is NULL) and writing the
+ * plaintext in input order. Reading, decryption and writing run as a
+ * pipeline, so the next batch is read and the previous one written while the
+ * current one is decrypted. Containers in regular files are mapped and the
+ * workers read their slots directly from the mapping.
+ *
+ * Only the plaintext bytes [offset, offset + length) are written. Binary and
+ * hybrid containers seek straight to the first block or record covering the
+ * range and stop after the last; hex has to be read from the start.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted messages to.
+ *   key (const ss_priv_key_t*): The private key.
+ *   pool (pool_t*): The worker pool, or NULL to run on the calling thread.
+ *   offset (uint64_t): The first plaintext byte to write.
+ *   length (uint64_t): The number of bytes to write, or SS_DECRYPT_TO_END.
+ *
+ * Returns:
+ *   true on success, false if a binary container is malformed or truncated,
+ * a block does not decode, or the input could not be read or the plaintext
+ * written.
+ */
+static bool decrypt_stream(FILE *infile, FILE *outfile,
+                           const ss_priv_key_t *key, pool_t *pool,
+                           uint64_t offset, uint64_t length) {
+    // Binary containers are recognised by their magic; anything else is hex.
+    // A container in a regular file is decrypted straight from a mapping.
+    decrypt_source_t source = { 0 };
+    source.infile = infile;
+    source.ok = true;
+    source.mapped = map_input(infile, &source.input);
+    if (source.mapped &&
+        (source.input.length < SS_CONTAINER_HEADER_SIZE ||
+         !ss_container_decode_header(&source.header, source.input.data))) {
+        unmap_file(&source.input);
+        source.mapped = false;
+    }
+    source.binary = source.mapped || ss_container_detect(infile);
+    if (source.binary && !source.mapped &&
+        !ss_container_read_header(&source.header, infile)) {
+        return false;
+    }
+    if (source.binary && !header_fits_key(&source.header, key)) {
+        if (source.mapped) {
+            unmap_file(&source.input);
+        }
+        return false;
+    }
+    if (source.binary && source.header.version == SS_CONTAINER_VERSION_HYBRID) {
+        // Hybrid containers are read sequentially through stdio
+        if (source.mapped) {
+            unmap_file(&source.input);
+            if (fseeko(infile, SS_CONTAINER_HEADER_SIZE, SEEK_SET) != 0) {
+                return false;
+            }
+        }
+        stats_add(STATS_BYTES_IN, SS_CONTAINER_HEADER_SIZE);
+        ss_decrypt_ctx_t ctx;
+        if (!ss_decrypt_ctx_init(&ctx, key)) {
+            return false;
+        }
+        bool ok = ss_hybrid_decrypt_file(&ctx, &source.header, infile, outfile,
+                                         offset, length) &&
+                  fflush(outfile) == 0;
+        ss_decrypt_ctx_clear(&ctx);
+        return ok;
+    }
+    if (source.binary) {
+        stats_add(STATS_BYTES_IN, SS_CONTAINER_HEADER_SIZE);
+    }
+    size_t slot_width = ss_container_block_width(source.header.modulus_bits);
+    source.remaining = source.header.block_count;
+    source.offset = SS_CONTAINER_HEADER_SIZE;
+    if (source.mapped) {
+        // Only whole slots present in the mapping are decrypted
+        size_t length = source.input.length - source.offset;
+        uint64_t available = length / slot_width;
+        if (source.remaining == SS_CONTAINER_COUNT_UNKNOWN) {
+            source.ok = length % slot_width == 0;
+            source.remaining = available;
+        } else if (source.remaining > available) {
+            source.ok = false;
+            source.remaining = available;
+        }
+    }
+
+    // Every container block but the last holds chunk bytes, so the range
+    // starts in block offset / chunk and nothing before that is read
+    decrypt_sink_t sink = { outfile, offset, length, 0, false, true, true };
+    if (source.binary && (offset != 0 || length != SS_DECRYPT_TO_END)) {
+        if (source.header.block_size < 2) {
+            if (source.mapped) {
+                unmap_file(&source.input);
+            }
+            return false;
+        }
+        size_t chunk = source.header.block_size - 1;
+        uint64_t first = offset / chunk;
+        uint64_t end = length > UINT64_MAX - offset ? UINT64_MAX
+                                                    : offset + length;
+        uint64_t wanted = end == offset ? 0 : (end - 1) / chunk + 1 - first;
+        sink.skip = offset - first * chunk;
+        sink.chunk = chunk;
+
+        uint64_t skipped = first < source.remaining ? first : source.remaining;
+        if (source.remaining != SS_CONTAINER_COUNT_UNKNOWN) {
+            source.remaining -= skipped;
+        }
+        if (source.mapped) {
+            source.offset += (size_t)skipped * slot_width;
+        } else if (!ss_container_skip(infile, skipped * slot_width)) {
+            // Only a streamed container may end before the range
+            source.ok = source.header.block_count == SS_CONTAINER_COUNT_UNKNOWN;
+            source.remaining = 0;
+        }
+        if (source.remaining > wanted) {
+            source.remaining = wanted;
+        }
+    }
+
+    ss_decrypt_batch_ctx_t workers;
+    if (!ss_decrypt_batch_ctx_init_pool(&workers, key, pool)) {
+        if (source.mapped) {
+            unmap_file(&source.input);
+        }
+        return false;
+    }
+    size_t plain_width = workers.plain_width;
+    size_t batch_size = workers.workers * SS_BLOCKS_PER_THREAD;
+    source.batch_size = batch_size;
+
+    // Every buffer the stages touch is allocated once, here
+    bool stdio_slots = source.binary && !source.mapped;
+    bool allocated = true;
+    decrypt_batch_t batches[SS_PIPELINE_DEPTH];
+    memset(batches, 0, sizeof(batches));
+    for (size_t b = 0; b < SS_PIPELINE_DEPTH; b++) {
+        decrypt_batch_t *batch = &batches[b];
+        batch->contexts = workers.contexts;
+        batch->slot_width = slot_width;
+        if (stdio_slots) {
+            batch->slots = (uint8_t *)malloc(batch_size * slot_width);
+            allocated = allocated && batch->slots != NULL;
+        } else if (!source.binary) {
+            batch->blocks = (mpz_t *)malloc(batch_size * sizeof(mpz_t));
+            allocated = allocated && batch->blocks != NULL;
+            for (size_t i = 0; batch->blocks != NULL && i < batch_size; i++) {
+                mpz_init2(batch->blocks[i], 16 * plain_width);
+            }
+        }
+        batch->plaintext = (uint8_t *)malloc(batch_size * (plain_width - 1));
+        batch->lengths = (size_t *)calloc(batch_size, sizeof(size_t));
+        allocated = allocated && batch->plaintext != NULL &&
+                    batch->lengths != NULL;
+    }
+    if (!allocated) {
+        free_batches(batches, stdio_slots, batch_size);
+        if (source.mapped) {
+            unmap_file(&source.input);
+        }
+        ss_decrypt_batch_ctx_clear(&workers);
+        return false;
+    }
+
+    if (!run_pipeline(&source, &sink, batches, pool)) {
+        // No threads to spare; run the stages in turn on one batch
+        bool last = false;
+        while (!last) {
+            read_batch(&source, &batches[0]);
+            decrypt_batch_run(pool, &batches[0]);
+            write_batch(&sink, &batches[0]);
+            last = batches[0].last || !sink.written;
+        }
+    }
+
+    free_batches(batches, stdio_slots, batch_size);
+    if (source.mapped) {
+        unmap_file(&source.input);
+    }
+    ss_decrypt_batch_ctx_clear(&workers);
+    return source.ok && sink.intact && sink.written && !ferror(infile) &&
+           fflush(outfile) == 0;
+}
+
+/**
+ * Decrypts the contents of an input file and writes the plaintext to an output
+ * file using the private key.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted messages to.
+ *   private_key_d (const mpz_t): The private key.
+ *   modulus_pq (const mpz_t): The product of the primes p and q.
+ */
+void ss_decrypt_file(FILE *infile, FILE *outfile, const mpz_t private_key_d,
+                     const mpz_t modulus_pq) {
+    ss_priv_key_t key;
+    ss_priv_key_init(&key);
+    mpz_set(key.modulus_pq, modulus_pq);
+    mpz_set(key.private_key_d, private_key_d);
+    ss_key_meta_init(&key.meta, modulus_pq);
+
+    ss_decrypt_file_key(infile, outfile, &key);
+
+    ss_priv_key_clear(&key);
+}
+
+/**
+ * Decrypts the contents of an input file and writes the plaintext to an output
+ * file using a private key. Hex and binary ciphertext are both accepted.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted messages to.
+ *   key (const ss_priv_key_t*): The private key.
+ *
+ * Returns:
+ *   true on success, false if a binary container is malformed or truncated,
+ * a block does not decode, or the plaintext could not be written.
+ */
+bool ss_decrypt_file_key(FILE *infile, FILE *outfile,
+                         const ss_priv_key_t *key) {
+    return decrypt_stream(infile, outfile, key, NULL, 0, SS_DECRYPT_TO_END);
+}
+
+/**
+ * Decrypts the contents of an input file like ss_decrypt_file_key, spreading
+ * the blocks across a pool of worker threads. Blocks are read in batches and
+ * written back in their original order.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted messages to.
+ *   key (const ss_priv_key_t*): The private key.
+ *   threads (size_t): The number of threads to use.
+ *
+ * Returns:
+ *   true on success, false if a binary container is malformed or truncated,
+ * a block does not decode, or the plaintext could not be written.
+ */
+bool ss_decrypt_file_parallel(FILE *infile, FILE *outfile,
+                              const ss_priv_key_t *key, size_t threads) {
+    pool_t *pool = threads > 1 ? pool_create(threads) : NULL;
+    bool ok = decrypt_stream(infile, outfile, key, pool, 0, SS_DECRYPT_TO_END);
+    pool_destroy(pool);
+    return ok;
+}
+
+/**
+ * Decrypts the contents of an input file like ss_decrypt_file_key on a
+ * borrowed worker pool, for callers that keep one pool across many files.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted messages to.
+ *   key (const ss_priv_key_t*): The private key.
+ *   pool (pool_t*): The worker pool, or NULL to run on the calling thread.
+ *
+ * Returns:
+ *   true on success, false if a binary container is malformed or truncated,
+ * a block does not decode, or the plaintext could not be written.
+ */
+bool ss_decrypt_file_pool(FILE *infile, FILE *outfile,
+                          const ss_priv_key_t *key, pool_t *pool) {
+    return decrypt_stream(infile, outfile, key, pool, 0, SS_DECRYPT_TO_END);
+}
+
+/**
+ * Decrypts only the plaintext bytes [offset, offset + length) of a file.
+ * Binary and hybrid containers are seekable: only the blocks or records
+ * covering the range are read and decrypted, so a small slice of a large
+ * archive costs a few blocks. Hex ciphertext is decrypted from the start.
+ * In every format, a range that starts at or past the end of the plaintext
+ * writes nothing and succeeds, and a range that runs past the end stops
+ * there.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted range to.
+ *   key (const ss_priv_key_t*): The private key.
+ *   threads (size_t): The number of threads to use.
+ *   offset (uint64_t): The first plaintext byte to write.
+ *   length (uint64_t): The number of bytes to write, or SS_DECRYPT_TO_END.
+ *
+ * Returns:
+ *   true on success, false if the container is malformed or truncated, a
+ * block does not decode, its blocks are not laid out for seeking, or the
+ * plaintext could not be written.
+ */
+bool ss_decrypt_file_range(FILE *infile, FILE *outfile,
+                           const ss_priv_key_t *key, size_t threads,
+                           uint64_t offset, uint64_t length) {
+    pool_t *pool = threads > 1 ? pool_create(threads) : NULL;
+    bool ok = decrypt_stream(infile, outfile, key, pool, offset, length);
+    pool_destroy(pool);
+    return ok;
 }
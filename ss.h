@@ -7,6 +7,12 @@
 #include <stdlib.h>
 #include <gmp.h>
 
+#include "codec.h"
+#include "numtheory.h"
+#include "pool.h"
+#include "primepool.h"
+#include "randstate.h"
+
 /**
  * Generates a public key (n) for the S-S cryptosystem.
  *
@@ -19,6 +25,61 @@
  */
 void ss_make_pub(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n, uint64_t total_bits, uint64_t iterations);
 
+/**
+ * Generates a public key (n) for the S-S cryptosystem, drawing all randomness from the given random state context.
+ * Thread-safe as long as each thread passes its own context.
+ *
+ * Args:
+ *   prime_p (mpz_t): The first prime factor (output).
+ *   prime_q (mpz_t): The second prime factor (output).
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   iterations (uint64_t): Number of iterations for primality testing.
+ *   rng (randstate_t*): The random state, or NULL for the global state.
+ */
+void ss_make_pub_r(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n, uint64_t total_bits, uint64_t iterations, randstate_t *rng);
+
+/**
+ * Generates a public key (n) like ss_make_pub_r, searching for each prime on several threads at once.
+ * Every thread uses its own random state split from rng; the first prime found wins, so keys are not reproducible from
+ * the seed when threads > 1.
+ *
+ * Args:
+ *   prime_p (mpz_t): The first prime factor (output).
+ *   prime_q (mpz_t): The second prime factor (output).
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   iterations (uint64_t): Number of iterations for primality testing.
+ *   threads (size_t): The number of threads to search with (1 runs ss_make_pub_r).
+ *   rng (randstate_t*): The random state, or NULL for the global state.
+ */
+void ss_make_pub_parallel(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n, uint64_t total_bits, uint64_t iterations, size_t threads, randstate_t *rng);
+
+/**
+ * Generates a public key (n) like ss_make_pub_parallel, drawing p and q from a prime pool when it holds primes of the sizes wanted and searching only for the ones it does not. Drawn primes are never reused.
+ *
+ * Args:
+ *   prime_p (mpz_t): The first prime factor (output).
+ *   prime_q (mpz_t): The second prime factor (output).
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   iterations (uint64_t): Number of iterations for primality testing.
+ *   threads (size_t): The number of threads to search with.
+ *   rng (randstate_t*): The random state, or NULL for the global state.
+ *   primes (ss_prime_pool_t*): The open prime pool, or NULL to always search.
+ */
+void ss_make_pub_pooled(mpz_t prime_p, mpz_t prime_q, mpz_t modulus_n, uint64_t total_bits, uint64_t iterations, size_t threads, randstate_t *rng, ss_prime_pool_t *primes);
+
+/**
+ * Computes the range of prime sizes ss_make_pub can ask for, i.e. the sizes a prime pool for total_bits keys must stock.
+ *
+ * Args:
+ *   total_bits (uint64_t): The total number of bits for modulus_n.
+ *   min_bits (uint64_t*): The smallest prime size (output).
+ *   max_bits (uint64_t*): The largest prime size (output).
+ */
+void ss_make_pub_prime_range(uint64_t total_bits, uint64_t *min_bits, uint64_t *max_bits);
+
 /**
  * Generates a private key (d) for the S-S cryptosystem.
  *
@@ -50,16 +111,33 @@ void ss_write_pub(const mpz_t modulus_n, const char username[], FILE *pbfile);
  */
 void ss_write_priv(const mpz_t modulus_pq, const mpz_t private_key_d, FILE *pvfile);
 
+// Size of the username buffer ss_read_pub fills, terminator included
+#define SS_USERNAME_SIZE 100
+
 /**
- * Reads the public key from a file.
+ * Reads the public key from a file, hex or binary. The username never overruns its SS_USERNAME_SIZE bytes.
  *
  * Args:
  *   modulus_n (mpz_t): The public key modulus (output).
- *   username (char[]): The associated username (output).
+ *   username (char[]): The associated username, of SS_USERNAME_SIZE bytes (output).
  *   pbfile (FILE*): The file to read the public key from.
  */
 void ss_read_pub(mpz_t modulus_n, char username[], FILE *pbfile);
 
+/**
+ * Reads a public key written by ss_write_pub or ss_keyfile_write_pub, telling the two apart by the leading magic. At most username_size - 1 bytes of the username are stored.
+ *
+ * Args:
+ *   modulus_n (mpz_t): The public key modulus (output).
+ *   username (char*): The associated username, NUL-terminated (output).
+ *   username_size (size_t): The size of the username buffer, at least 1.
+ *   pbfile (FILE*): The file to read the public key from.
+ *
+ * Returns:
+ *   true if the key was read, false if the file is malformed or the username does not fit.
+ */
+bool ss_read_pub_key(mpz_t modulus_n, char *username, size_t username_size, FILE *pbfile);
+
 /**
  * Reads the private key from a file.
  *
@@ -70,6 +148,141 @@ void ss_read_pub(mpz_t modulus_n, char username[], FILE *pbfile);
  */
 void ss_read_priv(mpz_t modulus_pq, mpz_t private_key_d, FILE *pvfile);
 
+/**
+ * Ciphertext formats written by the file encryption functions.
+ *
+ * SS_FORMAT_HEX writes one hex-encoded block per line. SS_FORMAT_BINARY
+ * writes a versioned container (see container.h) of fixed-width big-endian
+ * blocks. SS_FORMAT_HYBRID writes a container holding an SS-wrapped session
+ * key and the payload under AES-256-GCM (see hybrid.h), which is much faster
+ * for bulk data. The file decryption functions detect the format
+ * automatically.
+ */
+typedef enum { SS_FORMAT_HEX, SS_FORMAT_BINARY, SS_FORMAT_HYBRID } ss_format_t;
+
+/**
+ * Sizes derived from a key modulus. Computed once when the key is loaded so
+ * that file and block APIs never recount bits per call.
+ */
+typedef struct {
+    size_t modulus_bits; // bit length of the modulus
+    size_t block_size;   // plaintext block size in bytes for encryption, including the 0xFF pad
+    size_t byte_width;   // bytes needed to hold any value below the modulus
+} ss_key_meta_t;
+
+/**
+ * Computes the metadata of a modulus in constant time.
+ *
+ * Args:
+ *   meta (ss_key_meta_t*): The metadata (output).
+ *   modulus (const mpz_t): The modulus, n for a public key or pq for a private key.
+ */
+void ss_key_meta_init(ss_key_meta_t *meta, const mpz_t modulus);
+
+/**
+ * Private key for the S-S cryptosystem.
+ *
+ * Holds the classic (pq, d) pair and, when has_crt is set, the prime factors
+ * and precomputed Chinese Remainder Theorem values used to split decryption
+ * into two half-size exponentiations.
+ */
+typedef struct {
+    mpz_t modulus_pq;    // p * q
+    mpz_t private_key_d; // d
+    mpz_t prime_p;       // p
+    mpz_t prime_q;       // q
+    mpz_t d_mod_p1;      // d mod (p - 1)
+    mpz_t d_mod_q1;      // d mod (q - 1)
+    mpz_t q_inv_p;       // q^-1 mod p
+    bool has_crt;
+    ss_key_meta_t meta;  // sizes derived from pq; zero until the key is loaded
+} ss_priv_key_t;
+
+/**
+ * Initializes every field of a private key and marks it as non-CRT.
+ *
+ * Args:
+ *   key (ss_priv_key_t*): The key to initialize.
+ */
+void ss_priv_key_init(ss_priv_key_t *key);
+
+/**
+ * Frees the memory used by a private key.
+ *
+ * Args:
+ *   key (ss_priv_key_t*): The key to clear.
+ */
+void ss_priv_key_clear(ss_priv_key_t *key);
+
+/**
+ * Fills in a private key and precomputes its CRT values from p and q.
+ *
+ * Args:
+ *   key (ss_priv_key_t*): The initialized key to fill in (output).
+ *   modulus_pq (const mpz_t): The product of the primes p and q.
+ *   private_key_d (const mpz_t): The private key.
+ *   prime_p (const mpz_t): The first prime factor.
+ *   prime_q (const mpz_t): The second prime factor.
+ */
+void ss_priv_key_set_crt(ss_priv_key_t *key, const mpz_t modulus_pq, const mpz_t private_key_d, const mpz_t prime_p, const mpz_t prime_q);
+
+/**
+ * Writes a private key to a file. The first two lines are pq and d as written
+ * by ss_write_priv, followed by p, q, d mod (p-1), d mod (q-1) and q^-1 mod p
+ * when the key has CRT values.
+ *
+ * Args:
+ *   key (const ss_priv_key_t*): The private key.
+ *   pvfile (FILE*): The file to write the private key to.
+ */
+void ss_write_priv_key(const ss_priv_key_t *key, FILE *pvfile);
+
+/**
+ * Reads a private key written by ss_write_priv, ss_write_priv_key or
+ * ss_keyfile_write_priv. Two-field key files load with has_crt set to false.
+ *
+ * Args:
+ *   key (ss_priv_key_t*): The initialized key to read into (output).
+ *   pvfile (FILE*): The file to read the private key from.
+ *
+ * Returns:
+ *   true if at least pq and d were read, false otherwise.
+ */
+bool ss_read_priv_key(ss_priv_key_t *key, FILE *pvfile);
+
+/**
+ * Reusable encryption state for one public key. Buffers and bignums are sized
+ * from the modulus once, so encrypting any number of blocks through the
+ * context does not touch the heap. A context must not be shared between
+ * threads; give each thread its own.
+ */
+typedef struct {
+    mpz_t modulus_n;     // the public key modulus
+    size_t block_size;   // plaintext block size in bytes, including the 0xFF pad
+    size_t cipher_width; // width in bytes of a fixed-width ciphertext slot
+    mpz_t plaintext;     // padded plaintext of the last block
+    mpz_t ciphertext;    // ciphertext of the last block
+    pow_mod_lanes_t lanes;       // raises groups of blocks to n mod n
+    mpz_t group[POW_MOD_LANES];  // padded plaintexts, then ciphertexts, of one group
+} ss_encrypt_ctx_t;
+
+/**
+ * Reusable decryption state for one private key. The key is borrowed and must
+ * outlive the context. A context must not be shared between threads.
+ */
+typedef struct {
+    const ss_priv_key_t *key; // the private key
+    size_t plain_width;       // largest decrypted block in bytes, including the pad
+    mpz_t ciphertext;         // ciphertext input slot
+    mpz_t plaintext;          // plaintext of the last block
+    mpz_t plain_p;            // CRT scratch
+    mpz_t plain_q;            // CRT scratch
+    pow_mod_lanes_t lanes_p;  // groups of blocks to dp mod p, or to d mod pq without CRT
+    pow_mod_lanes_t lanes_q;  // groups of blocks to dq mod q; CRT only
+    mpz_t group[POW_MOD_LANES];   // ciphertexts, then plaintexts, of one group
+    mpz_t group_q[POW_MOD_LANES]; // CRT halves mod q of one group
+} ss_decrypt_ctx_t;
+
 /**
  * Encrypts a message using the public key.
  *
@@ -80,6 +293,283 @@ void ss_read_priv(mpz_t modulus_pq, mpz_t private_key_d, FILE *pvfile);
  */
 void ss_encrypt(mpz_t ciphertext, const mpz_t plaintext, const mpz_t modulus_n);
 
+/**
+ * Initializes an encryption context for a public key.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The context to initialize (output).
+ *   modulus_n (const mpz_t): The public key modulus.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to hold a block.
+ */
+bool ss_encrypt_ctx_init(ss_encrypt_ctx_t *ctx, const mpz_t modulus_n);
+
+/**
+ * Initializes an encryption context from metadata already computed for the modulus.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The context to initialize (output).
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   meta (const ss_key_meta_t*): The metadata of modulus_n.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to hold a block.
+ */
+bool ss_encrypt_ctx_init_meta(ss_encrypt_ctx_t *ctx, const mpz_t modulus_n, const ss_key_meta_t *meta);
+
+/**
+ * Frees the memory used by an encryption context.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The context to clear.
+ */
+void ss_encrypt_ctx_clear(ss_encrypt_ctx_t *ctx);
+
+/**
+ * Zeroes the plaintexts an encryption context keeps from its last blocks, for callers that encrypt secrets such as a
+ * session key through a long-lived context. The context stays usable.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The context to wipe.
+ */
+void ss_encrypt_ctx_wipe(ss_encrypt_ctx_t *ctx);
+
+/**
+ * Encrypts one block of at most block_size - 1 bytes into ctx->ciphertext.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The encryption context.
+ *   data (const uint8_t*): The plaintext bytes.
+ *   length (size_t): The number of bytes, at most ctx->block_size - 1.
+ */
+void ss_encrypt_ctx_block(ss_encrypt_ctx_t *ctx, const uint8_t *data, size_t length);
+
+/**
+ * Encrypts a byte string as consecutive blocks, writing each ciphertext into a fixed-width big-endian slot of
+ * ctx->cipher_width bytes.
+ *
+ * Args:
+ *   ctx (ss_encrypt_ctx_t*): The encryption context.
+ *   data (const uint8_t*): The plaintext bytes.
+ *   length (size_t): The number of plaintext bytes.
+ *   out (uint8_t*): Room for one slot per block (output).
+ *
+ * Returns:
+ *   The number of blocks written.
+ */
+size_t ss_encrypt_ctx_blocks(ss_encrypt_ctx_t *ctx, const uint8_t *data, size_t length, uint8_t *out);
+
+/**
+ * Incremental encryption state for feeding plaintext in arbitrary chunks, e.g. from a pipe or socket.
+ * Holds at most one partial block between updates; every completed block comes back as a fixed-width ciphertext slot.
+ */
+typedef struct {
+    ss_encrypt_ctx_t *contexts; // one per worker
+    size_t workers;             // number of contexts
+    pool_t *pool;               // worker pool, or NULL when single-threaded
+    bool owns_pool;             // whether ss_encrypt_stream_clear destroys pool
+    ss_key_meta_t meta;         // sizes derived from the modulus
+    uint8_t *pending;           // partial block, meta.block_size - 1 bytes of room
+    size_t pending_length;      // bytes held in pending
+} ss_encrypt_stream_t;
+
+/**
+ * Initializes a streaming encryption state for a public key.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to initialize (output).
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   threads (size_t): The number of threads used to encrypt the whole blocks of each update.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to encrypt with or memory runs out.
+ */
+bool ss_encrypt_stream_init(ss_encrypt_stream_t *stream, const mpz_t modulus_n, size_t threads);
+
+/**
+ * Initializes a streaming encryption state that encrypts on a borrowed worker pool, which must outlive the stream.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to initialize (output).
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   pool (pool_t*): The worker pool, or NULL to run on the calling thread.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to encrypt with or memory runs out.
+ */
+bool ss_encrypt_stream_init_pool(ss_encrypt_stream_t *stream, const mpz_t modulus_n, pool_t *pool);
+
+/**
+ * Frees the memory used by a streaming encryption state, discarding any pending partial block.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to clear.
+ */
+void ss_encrypt_stream_clear(ss_encrypt_stream_t *stream);
+
+/**
+ * Returns the number of ciphertext slots an update of length bytes can produce.
+ *
+ * Args:
+ *   stream (const ss_encrypt_stream_t*): The stream.
+ *   length (size_t): The number of bytes about to be fed.
+ *
+ * Returns:
+ *   The maximum number of slots ss_encrypt_stream_update will write.
+ */
+size_t ss_encrypt_stream_slots(const ss_encrypt_stream_t *stream, size_t length);
+
+/**
+ * Feeds plaintext into a stream and encrypts every block it completes.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream.
+ *   data (const uint8_t*): The plaintext bytes.
+ *   length (size_t): The number of plaintext bytes.
+ *   out (uint8_t*): Room for ss_encrypt_stream_slots(stream, length) slots of stream->meta.byte_width bytes (output).
+ *
+ * Returns:
+ *   The number of ciphertext slots written to out.
+ */
+size_t ss_encrypt_stream_update(ss_encrypt_stream_t *stream, const uint8_t *data, size_t length, uint8_t *out);
+
+/**
+ * Encrypts the pending partial block of a stream, if there is one.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream.
+ *   out (uint8_t*): Room for one slot of stream->meta.byte_width bytes (output).
+ *
+ * Returns:
+ *   The number of ciphertext slots written to out (0 or 1).
+ */
+size_t ss_encrypt_stream_final(ss_encrypt_stream_t *stream, uint8_t *out);
+
+/**
+ * A caller-owned byte buffer, used for the messages of the batch APIs.
+ */
+typedef struct {
+    uint8_t *data;
+    size_t length;
+} ss_buffer_t;
+
+/**
+ * Per-worker decryption state for one private key, with an optional worker pool. The decryption counterpart of the
+ * contexts inside ss_encrypt_stream_t.
+ */
+typedef struct {
+    ss_decrypt_ctx_t *contexts; // one per worker
+    size_t workers;             // number of contexts
+    pool_t *pool;               // worker pool, or NULL when single-threaded
+    bool owns_pool;             // whether ss_decrypt_batch_ctx_clear destroys pool
+    size_t plain_width;         // largest decrypted block in bytes, including the pad
+} ss_decrypt_batch_ctx_t;
+
+/**
+ * Initializes per-worker decryption state for a private key, which must outlive the context.
+ *
+ * Args:
+ *   ctx (ss_decrypt_batch_ctx_t*): The context to initialize (output).
+ *   key (const ss_priv_key_t*): The private key.
+ *   threads (size_t): The number of threads to use.
+ *
+ * Returns:
+ *   true on success, false if the buffers could not be allocated.
+ */
+bool ss_decrypt_batch_ctx_init(ss_decrypt_batch_ctx_t *ctx, const ss_priv_key_t *key, size_t threads);
+
+/**
+ * Initializes per-worker decryption state that runs on a borrowed pool, which must outlive the context.
+ *
+ * Args:
+ *   ctx (ss_decrypt_batch_ctx_t*): The context to initialize (output).
+ *   key (const ss_priv_key_t*): The private key.
+ *   pool (pool_t*): The worker pool, or NULL to run on the calling thread.
+ *
+ * Returns:
+ *   true on success, false if the buffers could not be allocated.
+ */
+bool ss_decrypt_batch_ctx_init_pool(ss_decrypt_batch_ctx_t *ctx, const ss_priv_key_t *key, pool_t *pool);
+
+/**
+ * Frees the per-worker decryption state, and the pool if the context owns it.
+ *
+ * Args:
+ *   ctx (ss_decrypt_batch_ctx_t*): The context to clear.
+ */
+void ss_decrypt_batch_ctx_clear(ss_decrypt_batch_ctx_t *ctx);
+
+/**
+ * Returns the number of ciphertext bytes ss_encrypt_batch produces for a set of messages.
+ *
+ * Args:
+ *   stream (const ss_encrypt_stream_t*): The stream to encrypt with.
+ *   messages (const ss_buffer_t*): The plaintext messages.
+ *   count (size_t): The number of messages.
+ *
+ * Returns:
+ *   The total ciphertext size in bytes.
+ */
+size_t ss_encrypt_batch_size(const ss_encrypt_stream_t *stream, const ss_buffer_t *messages, size_t count);
+
+/**
+ * Encrypts many independent messages under one public key, each into its own run of fixed-width ciphertext slots.
+ * Messages are spread across the stream's pool and nothing is allocated.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to encrypt with; its pending data is not touched.
+ *   messages (const ss_buffer_t*): The plaintext messages.
+ *   count (size_t): The number of messages.
+ *   storage (uint8_t*): ss_encrypt_batch_size bytes of room (output).
+ *   ciphertexts (ss_buffer_t*): One entry per message, pointing into storage (output).
+ */
+void ss_encrypt_batch(ss_encrypt_stream_t *stream, const ss_buffer_t *messages, size_t count, uint8_t *storage, ss_buffer_t *ciphertexts);
+
+/**
+ * Returns an upper bound on the number of plaintext bytes ss_decrypt_batch produces for a set of ciphertexts.
+ *
+ * Args:
+ *   ctx (const ss_decrypt_batch_ctx_t*): The decryption context.
+ *   ciphertexts (const ss_buffer_t*): The ciphertexts.
+ *   count (size_t): The number of ciphertexts.
+ *   slot_width (size_t): The width of each ciphertext slot in bytes.
+ *
+ * Returns:
+ *   The storage size needed in bytes.
+ */
+size_t ss_decrypt_batch_size(const ss_decrypt_batch_ctx_t *ctx, const ss_buffer_t *ciphertexts, size_t count, size_t slot_width);
+
+/**
+ * Decrypts many independent ciphertexts produced by ss_encrypt_batch, spread across the context's pool.
+ *
+ * Args:
+ *   ctx (ss_decrypt_batch_ctx_t*): The decryption context.
+ *   ciphertexts (const ss_buffer_t*): The ciphertexts.
+ *   count (size_t): The number of ciphertexts.
+ *   slot_width (size_t): The width of each ciphertext slot in bytes, the byte width of the public modulus n.
+ *   storage (uint8_t*): ss_decrypt_batch_size bytes of room (output).
+ *   plaintexts (ss_buffer_t*): One entry per ciphertext, pointing into storage (output).
+ *
+ * Returns:
+ *   true on success, false if a ciphertext is not a whole number of slots (nothing is decrypted then) or did not decode (its plaintext is left empty).
+ */
+bool ss_decrypt_batch(ss_decrypt_batch_ctx_t *ctx, const ss_buffer_t *ciphertexts, size_t count, size_t slot_width, uint8_t *storage, ss_buffer_t *plaintexts);
+
+/**
+ * Encrypts the contents of an input file through an existing stream, which must have no pending data.
+ *
+ * Args:
+ *   stream (ss_encrypt_stream_t*): The stream to encrypt with.
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfile (FILE*): The file to write the encrypted messages to.
+ *   format (ss_format_t): The ciphertext format to write.
+ *
+ * Returns:
+ *   true on success, false if the input could not be read, the ciphertext could not be written or memory ran out.
+ */
+bool ss_encrypt_stream_file(ss_encrypt_stream_t *stream, FILE *infile, FILE *outfile, ss_format_t format);
+
 /**
  * Encrypts the contents of an input file and writes them to an output file using the public key.
  *
@@ -90,6 +580,67 @@ void ss_encrypt(mpz_t ciphertext, const mpz_t plaintext, const mpz_t modulus_n);
  */
 void ss_encrypt_file(FILE *infile, FILE *outfile, const mpz_t modulus_n);
 
+/**
+ * Encrypts the contents of an input file like ss_encrypt_file, spreading the blocks across a pool of worker threads.
+ * The output is written in the original block order and is identical to ss_encrypt_file.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfile (FILE*): The file to write the encrypted messages to.
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   threads (size_t): The number of threads to use (1 runs ss_encrypt_file).
+ */
+void ss_encrypt_file_parallel(FILE *infile, FILE *outfile, const mpz_t modulus_n, size_t threads);
+
+/**
+ * Encrypts the contents of an input file into the given ciphertext format, optionally spreading the blocks across a pool of worker threads.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfile (FILE*): The file to write the encrypted messages to.
+ *   modulus_n (const mpz_t): The public key modulus.
+ *   format (ss_format_t): The ciphertext format to write.
+ *   threads (size_t): The number of threads to use.
+ *
+ * Returns:
+ *   true on success, false if the modulus is too small to encrypt with, the input could not be read or the ciphertext could not be written.
+ */
+bool ss_encrypt_file_format(FILE *infile, FILE *outfile, const mpz_t modulus_n, ss_format_t format, size_t threads);
+
+/**
+ * Encrypts the contents of an input file for several recipients through existing streams, reading the input once.
+ * Each batch of plaintext goes through every recipient's stream before the next is read, and recipients with the same
+ * block size share one slot buffer.
+ *
+ * Args:
+ *   streams (ss_encrypt_stream_t*): A stream per recipient, with no pending data.
+ *   count (size_t): The number of recipients, at least 1.
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfiles (FILE* const*): The file to write each recipient's ciphertext to.
+ *   format (ss_format_t): The ciphertext format to write.
+ *
+ * Returns:
+ *   true on success, false if the input could not be read, a ciphertext could not be written or memory ran out.
+ */
+bool ss_encrypt_streams_file(ss_encrypt_stream_t *streams, size_t count, FILE *infile, FILE *const *outfiles, ss_format_t format);
+
+/**
+ * Encrypts the contents of an input file for several public keys, reading the input once. All recipients share one
+ * pool of worker threads.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the plaintext messages.
+ *   outfiles (FILE* const*): The file to write each recipient's ciphertext to.
+ *   moduli (mpz_t*): The public key modulus of each recipient.
+ *   count (size_t): The number of recipients, at least 1.
+ *   format (ss_format_t): The ciphertext format to write.
+ *   threads (size_t): The number of threads to use.
+ *
+ * Returns:
+ *   true on success, false if a modulus is too small to encrypt with or the encryption failed.
+ */
+bool ss_encrypt_file_multi(FILE *infile, FILE *const *outfiles, mpz_t *moduli, size_t count, ss_format_t format, size_t threads);
+
 /**
  * Decrypts a message using the private key.
  *
@@ -101,6 +652,74 @@ void ss_encrypt_file(FILE *infile, FILE *outfile, const mpz_t modulus_n);
  */
 void ss_decrypt(mpz_t plaintext, const mpz_t ciphertext, const mpz_t private_key_d, const mpz_t modulus_pq);
 
+/**
+ * Decrypts a message using a private key, taking the CRT path when available.
+ *
+ * Args:
+ *   plaintext (mpz_t): The decrypted message (output).
+ *   ciphertext (const mpz_t): The encrypted message.
+ *   key (const ss_priv_key_t*): The private key.
+ */
+void ss_decrypt_key(mpz_t plaintext, const mpz_t ciphertext, const ss_priv_key_t *key);
+
+/**
+ * Initializes a decryption context for a private key.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The context to initialize (output).
+ *   key (const ss_priv_key_t*): The private key.
+ *
+ * Returns:
+ *   true; the context allocates nothing beyond its own bignums.
+ */
+bool ss_decrypt_ctx_init(ss_decrypt_ctx_t *ctx, const ss_priv_key_t *key);
+
+/**
+ * Frees the memory used by a decryption context (but not its key).
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The context to clear.
+ */
+void ss_decrypt_ctx_clear(ss_decrypt_ctx_t *ctx);
+
+/**
+ * Zeroes the plaintexts and CRT halves a decryption context keeps from its last blocks, for callers that decrypt
+ * secrets such as a session key through a long-lived context. The context stays usable.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The context to wipe.
+ */
+void ss_decrypt_ctx_wipe(ss_decrypt_ctx_t *ctx);
+
+/**
+ * Decrypts one block and exports its plaintext, without the padding byte, directly into out.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The decryption context.
+ *   ciphertext (const mpz_t): The encrypted block (may be ctx->ciphertext).
+ *   out (uint8_t*): Room for ctx->plain_width - 1 bytes (output).
+ *
+ * Returns:
+ *   The number of plaintext bytes written, or SS_CODEC_INVALID if the block did not decrypt to a padded plaintext (wrong key or corrupt ciphertext).
+ */
+size_t ss_decrypt_ctx_block(ss_decrypt_ctx_t *ctx, const mpz_t ciphertext, uint8_t *out);
+
+/**
+ * Decrypts consecutive fixed-width big-endian ciphertext slots and writes the plaintext of each block back to back
+ * into out.
+ *
+ * Args:
+ *   ctx (ss_decrypt_ctx_t*): The decryption context.
+ *   slots (const uint8_t*): The ciphertext slots.
+ *   count (size_t): The number of slots.
+ *   slot_width (size_t): The width of each slot in bytes.
+ *   out (uint8_t*): Room for count * (ctx->plain_width - 1) bytes (output).
+ *
+ * Returns:
+ *   The number of plaintext bytes written, or SS_CODEC_INVALID if a block did not decode (the blocks before it have been written).
+ */
+size_t ss_decrypt_ctx_blocks(ss_decrypt_ctx_t *ctx, const uint8_t *slots, size_t count, size_t slot_width, uint8_t *out);
+
 /**
  * Decrypts the contents of an input file and writes the plaintext to an output file using the private key.
  *
@@ -112,4 +731,69 @@ void ss_decrypt(mpz_t plaintext, const mpz_t ciphertext, const mpz_t private_key
  */
 void ss_decrypt_file(FILE *infile, FILE *outfile, const mpz_t private_key_d, const mpz_t modulus_pq);
 
+/**
+ * Decrypts the contents of an input file and writes the plaintext to an output file using a private key.
+ * Hex and binary ciphertext are both accepted.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted messages to.
+ *   key (const ss_priv_key_t*): The private key.
+ *
+ * Returns:
+ *   true on success, false if a binary container is malformed or truncated, a block does not decode, or the plaintext could not be written.
+ */
+bool ss_decrypt_file_key(FILE *infile, FILE *outfile, const ss_priv_key_t *key);
+
+/**
+ * Decrypts the contents of an input file like ss_decrypt_file_key, spreading the blocks across a pool of worker threads.
+ * The output is written in the original block order.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted messages to.
+ *   key (const ss_priv_key_t*): The private key.
+ *   threads (size_t): The number of threads to use (1 runs ss_decrypt_file_key).
+ *
+ * Returns:
+ *   true on success, false if a binary container is malformed or truncated, a block does not decode, or the plaintext could not be written.
+ */
+bool ss_decrypt_file_parallel(FILE *infile, FILE *outfile, const ss_priv_key_t *key, size_t threads);
+
+/**
+ * Decrypts the contents of an input file like ss_decrypt_file_key on a borrowed worker pool.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted messages to.
+ *   key (const ss_priv_key_t*): The private key.
+ *   pool (pool_t*): The worker pool, or NULL to run on the calling thread.
+ *
+ * Returns:
+ *   true on success, false if a binary container is malformed or truncated, a block does not decode, or the plaintext could not be written.
+ */
+bool ss_decrypt_file_pool(FILE *infile, FILE *outfile, const ss_priv_key_t *key, pool_t *pool);
+
+// Length passed to ss_decrypt_file_range to decrypt through the end of the file
+#define SS_DECRYPT_TO_END UINT64_MAX
+
+/**
+ * Decrypts only the plaintext bytes [offset, offset + length) of a file. Binary and hybrid containers are seekable:
+ * only the blocks or records covering the range are read and decrypted, so a small slice of a large archive costs a few
+ * blocks. Hex ciphertext is decrypted from the start. In every format, a range that starts at or past the end of the
+ * plaintext writes nothing and succeeds, and a range that runs past the end stops there.
+ *
+ * Args:
+ *   infile (FILE*): The file containing the encrypted messages.
+ *   outfile (FILE*): The file to write the decrypted range to.
+ *   key (const ss_priv_key_t*): The private key.
+ *   threads (size_t): The number of threads to use.
+ *   offset (uint64_t): The first plaintext byte to write.
+ *   length (uint64_t): The number of bytes to write, or SS_DECRYPT_TO_END.
+ *
+ * Returns:
+ *   true on success, false if the container is malformed or truncated, a block does not decode, its blocks are not laid out for seeking, or the plaintext could not be written.
+ */
+bool ss_decrypt_file_range(FILE *infile, FILE *outfile, const ss_priv_key_t *key, size_t threads, uint64_t offset, uint64_t length);
+
 #endif // SS_CRYPTOSYSTEM_H
\ No newline at end of file
@@ -0,0 +1,405 @@
+#include <errno.h>
+#include <gmp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "service.h"
+#include "ss.h"
+
+#define OPTIONS "n:d:S:t:a:vh"
+
+// How long a client may stall a read or write before it is dropped
+#define CLIENT_TIMEOUT_SECONDS 30
+
+// Keys and everything derived from them, built once at startup
+typedef struct {
+    pool_t *pool;                  // shared by every connection
+    pthread_mutex_t pool_lock;     // held by the request running on pool
+    bool has_pub;
+    mpz_t modulus_n;
+    bool has_priv;
+    ss_priv_key_t key;             // includes the CRT split when available
+    bool verbose;
+    pthread_mutex_t clients_lock;  // guards clients
+    pthread_cond_t clients_done;   // signalled when clients drops to zero
+    size_t clients;                // connections still being served
+} service_t;
+
+// One accepted connection, owned by the thread serving it
+typedef struct {
+    service_t *service;
+    int fd;
+    ss_encrypt_stream_t stream;  // this connection's contexts, if has_pub
+} client_t;
+
+// Set by SIGINT/SIGTERM; checked between connections
+static volatile sig_atomic_t stopping = 0;
+
+static void handle_stop(int signal_number) {
+    (void)signal_number;
+    stopping = 1;
+}
+
+/**
+ * Loads the public key and builds its encryption stream. A missing file just
+ * leaves encryption unavailable.
+ */
+static bool load_pub(service_t *service, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    char username[SS_USERNAME_SIZE];
+    mpz_init(service->modulus_n);
+    bool valid = ss_read_pub_key(service->modulus_n, username,
+                                 sizeof(username), file);
+    fclose(file);
+    if (!valid) {
+        fprintf(stderr, "Error: Invalid public key file %s\n", path);
+        exit(1);
+    }
+    ss_encrypt_stream_t stream;
+    if (!ss_encrypt_stream_init_pool(&stream, service->modulus_n,
+                                     service->pool)) {
+        fprintf(stderr, "Error: Public modulus in %s is too small\n", path);
+        exit(1);
+    }
+    ss_encrypt_stream_clear(&stream);
+    service->has_pub = true;
+    return true;
+}
+
+/**
+ * Loads the private key. A missing file just leaves decryption unavailable.
+ */
+static bool load_priv(service_t *service, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    ss_priv_key_init(&service->key);
+    bool valid = ss_read_priv_key(&service->key, file);
+    fclose(file);
+    if (!valid) {
+        fprintf(stderr, "Error: Invalid private key file %s\n", path);
+        exit(1);
+    }
+    service->has_priv = true;
+    return true;
+}
+
+/**
+ * Runs one request against the cached keys. Requests from different
+ * connections only take turns while they run on the shared pool.
+ *
+ * Args:
+ *   client (client_t*): The connection, with its encryption stream.
+ *   op (uint8_t): The SS_SERVICE_* operation.
+ *   data (uint8_t*): The request payload.
+ *   length (size_t): The request payload size in bytes.
+ *   reply (char**): The reply payload, allocated with malloc (output).
+ *   reply_length (size_t*): The reply payload size in bytes (output).
+ *
+ * Returns:
+ *   SS_SERVICE_OK, or SS_SERVICE_ERROR with a message in reply.
+ */
+static uint8_t handle_request(client_t *client, uint8_t op, uint8_t *data,
+                              size_t length, char **reply,
+                              size_t *reply_length) {
+    service_t *service = client->service;
+    const char *error = NULL;
+    bool encrypt = op == SS_SERVICE_ENCRYPT_HEX ||
+                   op == SS_SERVICE_ENCRYPT_BINARY ||
+                   op == SS_SERVICE_ENCRYPT_HYBRID;
+    if (!encrypt && op != SS_SERVICE_DECRYPT) {
+        error = "Unknown operation";
+    } else if (encrypt && !service->has_pub) {
+        error = "No public key loaded";
+    } else if (!encrypt && !service->has_priv) {
+        error = "No private key loaded";
+    }
+
+    // The file paths do the work; fmemopen rejects empty buffers on some
+    // libcs, so empty payloads read from /dev/null instead.
+    FILE *infile = NULL;
+    FILE *outfile = NULL;
+    if (error == NULL) {
+        infile = length > 0 ? fmemopen(data, length, "r")
+                            : fopen("/dev/null", "r");
+        outfile = open_memstream(reply, reply_length);
+        if (infile == NULL || outfile == NULL) {
+            error = "Out of memory";
+        }
+    }
+    if (error == NULL) {
+        if (service->pool != NULL) {
+            pthread_mutex_lock(&service->pool_lock);
+        }
+        if (encrypt) {
+            ss_format_t format = op == SS_SERVICE_ENCRYPT_BINARY ? SS_FORMAT_BINARY
+                                 : op == SS_SERVICE_ENCRYPT_HYBRID
+                                     ? SS_FORMAT_HYBRID
+                                     : SS_FORMAT_HEX;
+            if (!ss_encrypt_stream_file(&client->stream, infile, outfile,
+                                        format)) {
+                error = format == SS_FORMAT_HYBRID
+                            ? "Cannot write hybrid ciphertext"
+                        : format == SS_FORMAT_BINARY
+                            ? "Cannot write binary ciphertext"
+                            : "Cannot write hex ciphertext";
+            }
+        } else if (!ss_decrypt_file_pool(infile, outfile, &service->key,
+                                         service->pool)) {
+            error = ferror(outfile)
+                        ? "Cannot write the plaintext"
+                        : "Malformed or truncated ciphertext, or wrong key";
+        }
+        if (service->pool != NULL) {
+            pthread_mutex_unlock(&service->pool_lock);
+        }
+    }
+    if (infile != NULL) {
+        fclose(infile);
+    }
+    if (outfile != NULL) {
+        fclose(outfile);
+    }
+
+    if (error != NULL) {
+        if (outfile != NULL) {
+            free(*reply);
+        }
+        *reply = strdup(error);
+        *reply_length = strlen(error);
+        return SS_SERVICE_ERROR;
+    }
+    return SS_SERVICE_OK;
+}
+
+/**
+ * Serves requests on one connection until the client hangs up or stalls
+ * past CLIENT_TIMEOUT_SECONDS, then closes it and frees the client.
+ */
+static void *serve_client(void *arg) {
+    client_t *client = (client_t *)arg;
+    service_t *service = client->service;
+    uint8_t op = 0;
+    uint8_t *data = NULL;
+    size_t length = 0;
+    while (ss_service_recv(client->fd, &op, &data, &length)) {
+        char *reply = NULL;
+        size_t reply_length = 0;
+        uint8_t status =
+            handle_request(client, op, data, length, &reply, &reply_length);
+        if (service->verbose) {
+            fprintf(stderr, "%c: %zu bytes in, %zu bytes out, %s\n", op,
+                    length, reply_length,
+                    status == SS_SERVICE_OK ? "ok" : reply);
+        }
+        bool sent = ss_service_send(client->fd, status, (const uint8_t *)reply,
+                                    reply_length);
+        free(reply);
+        free(data);
+        if (!sent) {
+            break;
+        }
+    }
+
+    close(client->fd);
+    if (service->has_pub) {
+        ss_encrypt_stream_clear(&client->stream);
+    }
+    free(client);
+    pthread_mutex_lock(&service->clients_lock);
+    if (--service->clients == 0) {
+        pthread_cond_signal(&service->clients_done);
+    }
+    pthread_mutex_unlock(&service->clients_lock);
+    return NULL;
+}
+
+/**
+ * Hands an accepted connection to a thread of its own, with its own
+ * encryption contexts and read and write timeouts, so a slow or stalled
+ * client cannot hold up the others.
+ *
+ * Args:
+ *   service (service_t*): The loaded keys.
+ *   fd (int): The accepted socket, closed here if it cannot be served.
+ */
+static void start_client(service_t *service, int fd) {
+    struct timeval timeout = { CLIENT_TIMEOUT_SECONDS, 0 };
+    client_t *client = (client_t *)malloc(sizeof(client_t));
+    if (client == NULL ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        (service->has_pub &&
+         !ss_encrypt_stream_init_pool(&client->stream, service->modulus_n,
+                                      service->pool))) {
+        free(client);
+        close(fd);
+        return;
+    }
+    client->service = service;
+    client->fd = fd;
+
+    pthread_mutex_lock(&service->clients_lock);
+    service->clients++;
+    pthread_mutex_unlock(&service->clients_lock);
+
+    // Stop signals must reach the main thread so they interrupt accept
+    sigset_t stop_signals, previous;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+    pthread_t thread;
+    bool started = pthread_create(&thread, NULL, serve_client, client) == 0;
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (started) {
+        pthread_detach(thread);
+        return;
+    }
+    pthread_mutex_lock(&service->clients_lock);
+    service->clients--;
+    pthread_mutex_unlock(&service->clients_lock);
+    if (service->has_pub) {
+        ss_encrypt_stream_clear(&client->stream);
+    }
+    free(client);
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    int option;
+    size_t threads = 1;
+    pool_affinity_t affinity = POOL_AFFINITY_NONE;
+    const char *public_key_file = "ss.pub";
+    const char *private_key_file = "ss.priv";
+    const char *socket_path = "ss.sock";
+    service_t service = { 0 };
+
+    while ((option = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (option) {
+            case 'n':
+                public_key_file = optarg;
+                break;
+            case 'd':
+                private_key_file = optarg;
+                break;
+            case 'S':
+                socket_path = optarg;
+                break;
+            case 't':
+                threads = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'a':
+                if (!pool_parse_affinity(optarg, &affinity)) {
+                    fprintf(stderr, "Invalid placement: %s\n", optarg);
+                    exit(1);
+                }
+                pool_set_affinity(affinity);
+                break;
+            case 'v':
+                service.verbose = true;
+                break;
+            case 'h':
+                // clang-format off
+                printf(
+                    "SYNOPSIS\n"
+                    "   Serves encryption and decryption requests over a Unix socket, keeping\n"
+                    "   the keys and everything derived from them loaded between requests.\n"
+                    "\n"
+                    "USAGE\n"
+                    "   %s [-n:d:S:t:a:vh] [-n public_key_file] [-d private_key_file] [-S socket] [-t threads] [-a placement]\n"
+                    "\n"
+                    "OPTIONS\n"
+                    "   -n              Specifies the public key file (default: ss.pub).\n"
+                    "   -d              Specifies the private key file (default: ss.priv).\n"
+                    "   -S socket       Path of the socket to listen on (default: ss.sock).\n"
+                    "   -t threads      Number of threads to process blocks with (default: 1).\n"
+                    "   -a placement    Pins worker threads: none, cpu or numa (default: none).\n"
+                    "   -v              Logs every request to stderr.\n"
+                    "   -h              Prints this help message.\n",
+                    argv[0]);
+                // clang-format on
+                exit(0);
+            default:
+                fprintf(stderr, "Invalid option: -%c\n", optopt);
+                exit(1);
+        }
+    }
+
+    pthread_mutex_init(&service.pool_lock, NULL);
+    pthread_mutex_init(&service.clients_lock, NULL);
+    pthread_cond_init(&service.clients_done, NULL);
+    service.pool = threads > 1 ? pool_create(threads) : NULL;
+    bool loaded_pub = load_pub(&service, public_key_file);
+    bool loaded_priv = load_priv(&service, private_key_file);
+    if (!loaded_pub && !loaded_priv) {
+        fprintf(stderr, "Error: Cannot open %s or %s\n", public_key_file,
+                private_key_file);
+        exit(1);
+    }
+
+    int listener = ss_service_listen(socket_path);
+    if (listener < 0) {
+        fprintf(stderr, "Error: Cannot listen on %s\n", socket_path);
+        exit(1);
+    }
+
+    // No SA_RESTART, so a signal interrupts accept and ends the loop
+    struct sigaction action = { 0 };
+    action.sa_handler = handle_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);  // A vanished client must not kill the daemon
+
+    if (service.verbose) {
+        fprintf(stderr, "Listening on %s (encrypt: %s, decrypt: %s)\n",
+                socket_path, loaded_pub ? "yes" : "no",
+                !loaded_priv        ? "no"
+                : service.key.has_crt ? "yes, CRT"
+                                      : "yes");
+    }
+
+    // Every connection gets its own thread; the pool parallelises within
+    // each request.
+    while (!stopping) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        start_client(&service, client);
+    }
+
+    close(listener);
+    unlink(socket_path);
+
+    // Connections still open finish their request or time out
+    pthread_mutex_lock(&service.clients_lock);
+    while (service.clients > 0) {
+        pthread_cond_wait(&service.clients_done, &service.clients_lock);
+    }
+    pthread_mutex_unlock(&service.clients_lock);
+    if (service.has_pub) {
+        mpz_clear(service.modulus_n);
+    }
+    if (service.has_priv) {
+        ss_priv_key_clear(&service.key);
+    }
+    pool_destroy(service.pool);
+    return 0;
+}
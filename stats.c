@@ -0,0 +1,78 @@
+#include "stats.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static atomic_bool enabled = false;
+static _Atomic uint64_t counters[STATS_COUNT];
+static uint64_t started = 0;
+
+// JSON field names, indexed by stats_counter_t; timers are printed in ms
+static const char *const names[STATS_COUNT] = {
+    "prime_candidates",     "prime_sieve_rejected", "prime_trial_rejected",
+    "prime_base2_rejected", "prime_lucas_rejected", "prime_random_rejected",
+    "primes_found",         "prime_pool_hits",      "prime_pool_misses",
+    "make_pub_attempts",    "blocks_encrypted",     "blocks_decrypted",
+    "bytes_in",             "bytes_out",            "powm_ms",
+    "io_ms",                "parse_ms",
+};
+
+static bool is_timer(stats_counter_t counter) {
+    return counter == STATS_POWM_NS || counter == STATS_IO_NS ||
+           counter == STATS_PARSE_NS;
+}
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void stats_enable(void) {
+    started = clock_ns();
+    atomic_store(&enabled, true);
+}
+
+bool stats_enabled(void) {
+    return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+void stats_add(stats_counter_t counter, uint64_t amount) {
+    if (stats_enabled()) {
+        atomic_fetch_add_explicit(&counters[counter], amount,
+                                  memory_order_relaxed);
+    }
+}
+
+uint64_t stats_now(void) {
+    return stats_enabled() ? clock_ns() : 0;
+}
+
+void stats_add_since(stats_counter_t counter, uint64_t start) {
+    if (stats_enabled()) {
+        stats_add(counter, clock_ns() - start);
+    }
+}
+
+uint64_t stats_get(stats_counter_t counter) {
+    return atomic_load_explicit(&counters[counter], memory_order_relaxed);
+}
+
+void stats_print(FILE *out, const char *program) {
+    double wall = stats_enabled() ? (double)(clock_ns() - started) / 1e6 : 0.0;
+    fprintf(out, "{\"program\": \"%s\", \"wall_ms\": %.3f", program, wall);
+    for (int i = 0; i < STATS_COUNT; i++) {
+        if (is_timer((stats_counter_t)i)) {
+            fprintf(out, ", \"%s\": %.3f", names[i],
+                    (double)stats_get((stats_counter_t)i) / 1e6);
+        } else {
+            fprintf(out, ", \"%s\": %" PRIu64, names[i],
+                    stats_get((stats_counter_t)i));
+        }
+    }
+    fprintf(out, "}\n");
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//
+// Process-wide counters and phase timers behind the -v output of keygen,
+// encrypt and decrypt. Everything is off until stats_enable is called, and
+// while off every update is a single relaxed load, so the hot paths can be
+// instrumented unconditionally. Counters are atomic and may be updated from
+// pool workers; timers running on several workers add up, so they measure
+// thread time rather than wall time.
+//
+typedef enum {
+    STATS_PRIME_CANDIDATES,       // candidates considered by make_prime
+    STATS_PRIME_SIEVE_REJECTED,   // ruled out by the residue sieve
+    STATS_PRIME_TRIAL_REJECTED,   // ruled out by the small-prime gcd
+    STATS_PRIME_BASE2_REJECTED,   // failed the base-2 Miller-Rabin round
+    STATS_PRIME_LUCAS_REJECTED,   // failed the strong Lucas test
+    STATS_PRIME_RANDOM_REJECTED,  // failed a random-base Miller-Rabin round
+    STATS_PRIMES_FOUND,
+    STATS_PRIME_POOL_HITS,        // primes drawn from a prime pool
+    STATS_PRIME_POOL_MISSES,      // pool had no prime of the size wanted
+    STATS_MAKE_PUB_ATTEMPTS,      // iterations of the ss_make_pub p, q loop
+    STATS_BLOCKS_ENCRYPTED,
+    STATS_BLOCKS_DECRYPTED,
+    STATS_BYTES_IN,
+    STATS_BYTES_OUT,
+    STATS_POWM_NS,                // modular exponentiation of blocks
+    STATS_IO_NS,                  // fread and fwrite of blocks
+    STATS_PARSE_NS,               // hex parsing and formatting of blocks
+    STATS_COUNT
+} stats_counter_t;
+
+//
+// Turns collection on and starts the wall clock reported by stats_print.
+//
+void stats_enable(void);
+
+//
+// Returns true once stats_enable has been called.
+//
+bool stats_enabled(void);
+
+//
+// Adds amount to a counter; does nothing while collection is off.
+//
+void stats_add(stats_counter_t counter, uint64_t amount);
+
+//
+// Returns a monotonic timestamp in nanoseconds for stats_add_since, or 0
+// without reading the clock while collection is off.
+//
+uint64_t stats_now(void);
+
+//
+// Adds the nanoseconds elapsed since start, a stats_now timestamp, to a
+// timer; does nothing while collection is off.
+//
+void stats_add_since(stats_counter_t counter, uint64_t start);
+
+//
+// Returns the current value of a counter.
+//
+uint64_t stats_get(stats_counter_t counter);
+
+//
+// Writes every counter as a single-line JSON object, with timers in
+// milliseconds, followed by a newline.
+//
+// out:     where to write, usually stderr.
+// program: the name reported in the "program" field.
+//
+void stats_print(FILE *out, const char *program);